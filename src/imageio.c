@@ -23,9 +23,26 @@
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
+#include <limits.h>
 #include <string.h>
 #include <assert.h>
 #include <png.h>
+#include <zlib.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGEIO_X86
+#include <immintrin.h>
+#endif
 #include "imageio.h"
 #include "blending.h"
 
@@ -41,7 +58,7 @@
  *	Miscellaneous Utility functions...
  */
 /* (x,y) to bitmap array index mapping macros */
-#define pixel_index( x, y, byte_count, width )		((size_t) ((width) * (y) * (byte_count) + (x) * (byte_count)))
+#define pixel_index( x, y, byte_count, width )		((size_t) (width) * (y) * (byte_count) + (size_t) (x) * (byte_count))
 #define linear_interpolate( alpha, x2, x1 ) ( x1 + alpha * ( x2 - x1 ) )
 #define lerp linear_interpolate
 #define bilinear_interpolate( alpha, beta, x1, x2, x3, x4 )		(lerp( beta, lerp( alpha, x1, x2 ), lerp( alpha, x3, x4 ) ))
@@ -53,6 +70,10 @@
 #define bilinear_interpolate( alpha, beta, x1, x2, x3, x4 )		(lerp( beta, lerp( alpha, x1, x2 ), lerp( alpha, x3, x4 ) ))
 #define bilerp bilinear_interpolate
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 #define convertRGBtoBGR    imageio_swap_red_and_blue
 #define convertBGRtoRGB    imageio_swap_red_and_blue
 
@@ -142,390 +163,1957 @@ typedef struct pvr_header {
     uint32_t num_surfs;
 } pvr_header_t;
 
+/*
+ *  Raw. The header is padded to RAW_ALIGNMENT and is followed by level 0
+ *  and then each mip level, all with rows padded to RAW_ALIGNMENT.
+ */
+#define RAW_MAGIC          "IRAW"
+#define RAW_VERSION        1
+#define RAW_ALIGNMENT      64
+#define RAW_MAX_LEVELS     16
+#define RAW_FLAG_CHECKSUM  0x1
+
+typedef struct raw_header {
+	uint8_t  magic[ 4 ];
+	uint16_t version;
+	uint16_t header_size;                 /* offset of level 0 */
+	uint32_t width;                       /* of level 0 */
+	uint32_t height;
+	uint8_t  bit_depth;
+	uint8_t  channels;
+	uint8_t  layout;                      /* imageio_layout_t */
+	uint8_t  levels;
+	uint32_t flags;
+	uint64_t data_size;                   /* bytes of all levels */
+	uint32_t checksums[ RAW_MAX_LEVELS ]; /* crc32 of each level's rows, without the padding */
+} raw_header_t;
 
-static __inline bool imageio_bitmap_load ( const char* filename, bitmap_info_header_t* info_header, uint8_t** bitmap );
-static __inline bool imageio_bitmap_save ( const char* filename, uint32_t width, uint32_t height, uint32_t bit_depth, uint8_t* imageData );
-static __inline bool imageio_targa_load  ( const char* filename, targa_file_header_t* p_file_header, uint8_t** bitmap );
-static __inline bool imageio_targa_save  ( const char* filename, targa_file_header_t* p_file_header, uint8_t* bitmap );
-static __inline bool imageio_pvr_load    ( const char* filename, pvr_header_t* p_header, uint8_t** bitmap );
-
-static __inline bool imageio_png_load ( const char* filename, image_t* image );
-static __inline bool imageio_png_save ( const char* filename, const image_t* image );
 
-static __inline bool imageio_resize_nearest_neighbor      ( uint32_t src_width, uint32_t src_height, uint32_t srcBitsPerPixel, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint32_t dstBitsPerPixel, uint8_t* dst_bitmap );
-static __inline bool imageio_resize_bilinear_rgba         ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t byte_count );
-static __inline bool imageio_resize_bilinear_sharper_rgba ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t byte_count );
-static __inline bool imageio_resize_bilinear_rgb          ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t byte_count );
-static __inline bool imageio_resize_bilinear_sharper_rgb  ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t byte_count );
-static __inline bool imageio_resize_bicubic_rgba          ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t byte_count );
-static __inline bool imageio_resize_bicubic_rgb           ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap, uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t byte_count );
+/*
+ * Where a codec puts the decoded rows: the caller's buffer, or one the
+ * codec allocates when pixels is NULL. A stride of 0 packs rows tightly.
+ */
+typedef struct decode_target {
+	uint8_t* pixels;
+	size_t   size;
+	size_t   stride;
+	uint32_t alignment; /* rows of an allocated buffer are padded to this */
+	bool     allocated;
+} decode_target_t;
 
-static __inline bool is_power_of_2( uint16_t x )
+/*
+ * Memory that libpng and zlib allocate from while one image is coded. It
+ * is handed out by bumping a pointer and taken back all at once when the
+ * image is done, so a decoder or encoder that is reused mallocs nothing
+ * for the codec once the block has grown to fit.
+ */
+typedef struct png_arena {
+	uint8_t* block;
+	size_t   size;
+	size_t   used;
+	size_t   overflow;  /* bytes allocated outside the block this time */
+	void*    extra;     /* those allocations, linked through their first bytes */
+} png_arena_t;
+
+static uint8_t* image_alloc ( size_t size, uint32_t alignment );
+static bool     image_free  ( uint8_t* pixels );
+static void     pixel_set_release ( void );
+
+static bool decode_target_prepare ( decode_target_t* target, uint32_t height, size_t row_size );
+static void decode_target_release ( decode_target_t* target );
+static bool image_load            ( image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options, decode_target_t* target, png_arena_t* arena );
+static bool image_save            ( const image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_save_options_t* options, png_arena_t* arena );
+
+static __inline uint32_t layout_channels ( imageio_layout_t layout, uint32_t native_channels );
+
+static __inline bool imageio_bitmap_load_header ( imageio_io_t* io, bitmap_file_header_t* file_header, bitmap_info_header_t* info_header );
+static __inline bool imageio_bitmap_load ( imageio_io_t* io, bitmap_info_header_t* info_header, imageio_layout_t layout, decode_target_t* target );
+static __inline bool imageio_bitmap_save_header ( imageio_io_t* io, uint32_t width, uint32_t height, uint32_t bit_depth );
+static __inline bool imageio_bitmap_save ( imageio_io_t* io, uint32_t width, uint32_t height, uint32_t bit_depth, size_t pitch, const uint8_t* imageData );
+static __inline bool imageio_targa_load_header ( imageio_io_t* io, targa_file_header_t* p_file_header );
+static __inline bool imageio_targa_load  ( imageio_io_t* io, targa_file_header_t* p_file_header, imageio_layout_t layout, decode_target_t* target );
+static __inline bool imageio_targa_save_header ( imageio_io_t* io, targa_file_header_t* p_file_header );
+static __inline bool imageio_targa_save  ( imageio_io_t* io, targa_file_header_t* p_file_header, size_t pitch, const uint8_t* bitmap );
+static __inline bool imageio_pvr_load    ( imageio_io_t* io, pvr_header_t* p_header, decode_target_t* target );
+static __inline bool imageio_raw_load_header ( imageio_io_t* io, raw_header_t* header );
+static __inline bool imageio_raw_load    ( imageio_io_t* io, raw_header_t* header, imageio_layout_t layout, decode_target_t* target );
+static __inline bool imageio_raw_save    ( imageio_io_t* io, const image_t* img, const imageio_raw_options_t* options );
+
+static __inline bool imageio_png_probe ( imageio_io_t* io, imageio_info_t* info );
+static __inline bool imageio_png_load ( imageio_io_t* io, image_t* image, imageio_layout_t layout, decode_target_t* target, png_arena_t* arena );
+static __inline bool imageio_png_save ( imageio_io_t* io, const image_t* image, const imageio_save_options_t* options, png_arena_t* arena );
+
+
+static __inline bool is_power_of_2( uint32_t x )
 {
 	return (x & (x - 1)) == 0;
 }
 
-bool imageio_load( image_t* img, const char* filename, image_file_format_t* fmt )
+/*
+ *  Allocator hooks. Every heap allocation the library makes, including
+ *  those of libpng and zlib, goes through these so a caller can account
+ *  for it or carve it out of its own arena.
+ */
+static void* default_alloc( size_t size, void* user )
 {
-	bool result = false;
-	const char* extension = strrchr( filename, '.' );
-	image_file_format_t format = IMAGEIO_PNG;
+	(void) user;
+	return malloc( size );
+}
 
-	if( extension )
-	{
-		extension += 1;
+static void* default_realloc( void* ptr, size_t size, void* user )
+{
+	(void) user;
+	return realloc( ptr, size );
+}
 
-		if( strcasecmp( "png", extension ) == 0 )
-		{
-			format = IMAGEIO_PNG;
-		}
-		else if( strcasecmp( "bmp", extension ) == 0 )
-		{
-			format = IMAGEIO_BMP;
-		}
-		else if( strcasecmp( "tga", extension ) == 0 )
-		{
-			format = IMAGEIO_TGA;
-		}
-		else if( strcasecmp( "pvr", extension ) == 0 || strcasecmp( "pvrtc", extension ) == 0 )
-		{
-			format = IMAGEIO_PVR;
-		}
-		else
-		{
-			goto failure;
-		}
-	}
+static void default_free( void* ptr, void* user )
+{
+	(void) user;
+	free( ptr );
+}
 
-	if( imageio_image_load( img, filename, format ) )
-	{
-		if( format == IMAGEIO_PVR )
-		{
-			if( !is_power_of_2(img->width) || !is_power_of_2(img->height) )
-			{
-				   /* iOS devices require texture dimensions to be
-					* a power of 2.
-					*/
-				   imageio_image_destroy( img );
-				   goto failure;
-			}
-		}
+static struct allocator {
+	imageio_alloc_fxn   alloc;
+	imageio_realloc_fxn realloc;
+	imageio_free_fxn    free;
+	void*               user;
+} allocator = { default_alloc, default_realloc, default_free, NULL };
 
-		result = true;
+bool imageio_set_allocator( imageio_alloc_fxn alloc, imageio_realloc_fxn realloc, imageio_free_fxn free, void* user )
+{
+	if( (alloc || realloc || free) && (!alloc || !realloc || !free) )
+	{
+		return false;
 	}
 
-	if( fmt )
+	pixel_set_release( );
+
+	if( !alloc && !realloc && !free )
 	{
-		*fmt = format;
+		allocator.alloc   = default_alloc;
+		allocator.realloc = default_realloc;
+		allocator.free    = default_free;
+		allocator.user    = NULL;
+		return true;
 	}
 
-failure:
-	return result;
+	allocator.alloc   = alloc;
+	allocator.realloc = realloc;
+	allocator.free    = free;
+	allocator.user    = user;
+	return true;
 }
 
-bool imageio_image_load( image_t* img, const char* filename, image_file_format_t format )
+static __inline void* imageio_malloc( size_t size )
 {
-	bool result = false;
-	#ifdef NDEBUG
-	img->pixels = NULL;
-	#endif
+	return allocator.alloc( size, allocator.user );
+}
 
-	switch( format )
+static __inline void* imageio_calloc( size_t count, size_t size )
+{
+	void* ptr;
+
+	if( size && count > SIZE_MAX / size )
 	{
-		case IMAGEIO_BMP:
-		{
-			bitmap_info_header_t bmpInfoHeader;
-			result = imageio_bitmap_load( filename, &bmpInfoHeader, &img->pixels );
-			if( result )
-			{
-				assert( img->pixels != NULL );
-				img->bit_depth = (uint8_t) bmpInfoHeader.biBitCount;
-				img->channels  = bmpInfoHeader.biBitCount >> 3;
-				img->width     = bmpInfoHeader.biWidth;
-				img->height    = bmpInfoHeader.biHeight;
-			}
-			break;
-		}
-		case IMAGEIO_TGA:
-		{
-			targa_file_header_t tgaHeader;
-			result = imageio_targa_load( filename, &tgaHeader, &img->pixels );
-			if( result )
-			{
-				assert( img->pixels != NULL );
-				img->bit_depth = tgaHeader.bitCount;
-				img->channels  = tgaHeader.bitCount >> 3;
-				img->width     = tgaHeader.width;
-				img->height    = tgaHeader.height;
-			}
-			break;
-		}
-		case IMAGEIO_PNG:
-		{
-			result = imageio_png_load( filename, img );
-			break;
-		}
-		case IMAGEIO_PVR:
-		{
-			pvr_header_t header;
-			result = imageio_pvr_load( filename, &header, &img->pixels );
-			if( result )
-			{
-				assert( img->pixels != NULL );
-				img->bit_depth = header.bit_depth;
-				img->channels  = header.bitmask_alpha > 0 ? 4 : 3;
-				img->width     = header.width;
-				img->height    = header.height;
-			}
-			break;
-		}
-		default:
-			break;
+		return NULL;
 	}
 
-	if( !result )
+	ptr = allocator.alloc( count * size, allocator.user );
+
+	if( ptr )
 	{
-		img->bit_depth = 0;
-		img->channels  = 0;
-		img->width     = 0;
-		img->height    = 0;
-		img->pixels    = 0;
+		memset( ptr, 0, count * size );
 	}
 
-	return result;
+	return ptr;
 }
 
-bool imageio_image_save( const image_t* img, const char* filename, image_file_format_t format )
+static __inline void* imageio_realloc( void* ptr, size_t size )
 {
-	bool result = false;
+	return allocator.realloc( ptr, size, allocator.user );
+}
 
-	switch( format )
+void imageio_free( void* ptr )
+{
+	if( ptr )
 	{
-		case IMAGEIO_BMP:
+		allocator.free( ptr, allocator.user );
+	}
+}
+
+/*
+ *  Row-band thread pool. A kernel splits its output rows into bands, and the
+ *  bands are run by the calling thread together with the pool's workers.
+ *  Bands write disjoint rows, so the output is identical to the serial path.
+ */
+#define PARALLEL_MIN_BAND_BYTES   (64 * 1024)  /* don't bother with smaller bands */
+#define PARALLEL_MAX_THREADS      64
+
+typedef void (*parallel_rows_fxn)( void* context, uint32_t first, uint32_t last, uint32_t band );
+
+static uint32_t imageio_threads = 1;
+
+#ifndef _WIN32
+static struct thread_pool {
+	pthread_mutex_t lock;
+	pthread_mutex_t busy;      /* held by the thread whose job is running */
+	pthread_cond_t wake;
+	pthread_cond_t finished;
+	pthread_t workers[ PARALLEL_MAX_THREADS ];
+	uint32_t worker_count;
+	uint32_t generation;       /* bumped for every job */
+	bool shutdown;
+	parallel_rows_fxn fxn;
+	void* context;
+	uint32_t rows;
+	uint32_t bands;
+	uint32_t next_band;
+	uint32_t pending;
+} pool = {
+	.lock     = PTHREAD_MUTEX_INITIALIZER,
+	.busy     = PTHREAD_MUTEX_INITIALIZER,
+	.wake     = PTHREAD_COND_INITIALIZER,
+	.finished = PTHREAD_COND_INITIALIZER,
+};
+
+/* Must be called with pool.lock held. */
+static void thread_pool_run_bands( void )
+{
+	while( pool.next_band < pool.bands )
+	{
+		uint32_t band          = pool.next_band++;
+		uint32_t first         = (uint32_t) ((uint64_t) pool.rows * band / pool.bands);
+		uint32_t last          = (uint32_t) ((uint64_t) pool.rows * (band + 1) / pool.bands);
+		parallel_rows_fxn fxn  = pool.fxn;
+		void* context          = pool.context;
+
+		pthread_mutex_unlock( &pool.lock );
+		fxn( context, first, last, band );
+		pthread_mutex_lock( &pool.lock );
+
+		if( --pool.pending == 0 )
 		{
-			result = imageio_bitmap_save( filename, img->width, img->height, img->bit_depth, img->pixels );
-			assert( img->pixels != NULL );
-			break;
+			pthread_cond_signal( &pool.finished );
 		}
-		case IMAGEIO_TGA:
+	}
+}
+
+static void* thread_pool_worker( void* arg )
+{
+	uint32_t generation;
+
+	pthread_mutex_lock( &pool.lock );
+	generation = pool.generation;
+
+	for( ;; )
+	{
+		while( !pool.shutdown && pool.generation == generation )
 		{
-			targa_file_header_t tgaFileHeader;
-			tgaFileHeader.bitCount = img->bit_depth;
-			tgaFileHeader.width = img->width;
-			tgaFileHeader.height = img->height;
-			result = imageio_targa_save( filename, &tgaFileHeader, img->pixels );
-			break;
+			pthread_cond_wait( &pool.wake, &pool.lock );
 		}
-		case IMAGEIO_PNG:
+
+		if( pool.shutdown )
 		{
-			result = imageio_png_save( filename, img );
 			break;
 		}
-		default:
-			break;
-	}
 
+		generation = pool.generation;
+		thread_pool_run_bands( );
+	}
 
-	return result;
+	pthread_mutex_unlock( &pool.lock );
+	return arg;
 }
+#endif
 
-bool imageio_image_create( image_t* img, uint16_t width, uint16_t height, uint8_t bit_depth )
+static void parallel_rows( uint32_t rows, size_t row_size, uint32_t max_bands, parallel_rows_fxn fxn, void* context )
 {
-	bool result = false;
+	uint32_t bands = imageio_threads;
+	size_t most_bands = ((size_t) rows * row_size) / PARALLEL_MIN_BAND_BYTES;
 
-	if( img )
-	{
-		img->bit_depth = bit_depth;
-		img->channels  = bit_depth >> 3;
-		img->width     = width;
-		img->height    = height;
-		img->pixels    = malloc( img->width * img->height * img->channels );
+	if( max_bands > 0 && bands > max_bands ) bands = max_bands;
+	if( bands > most_bands ) bands = (uint32_t) most_bands;
+	if( bands > rows ) bands = rows;
 
-		result = img->pixels != NULL;
-	}
+	#ifndef _WIN32
+	/* If another thread already owns the pool, just run serially. */
+	if( bands > 1 && pthread_mutex_trylock( &pool.busy ) == 0 )
+	{
+		if( pool.worker_count > 0 )
+		{
+			pthread_mutex_lock( &pool.lock );
+			pool.fxn       = fxn;
+			pool.context   = context;
+			pool.rows      = rows;
+			pool.bands     = bands;
+			pool.next_band = 0;
+			pool.pending   = bands;
+			pool.generation++;
+			pthread_cond_broadcast( &pool.wake );
+
+			thread_pool_run_bands( );
+
+			while( pool.pending > 0 )
+			{
+				pthread_cond_wait( &pool.finished, &pool.lock );
+			}
 
-	return result;
-}
+			pthread_mutex_unlock( &pool.lock );
+			pthread_mutex_unlock( &pool.busy );
+			return;
+		}
 
-void imageio_image_destroy( image_t* img )
-{
-	free( img->pixels );
-	#ifdef NDEBUG
-	img->pixels = NULL;
+		pthread_mutex_unlock( &pool.busy );
+	}
 	#endif
+
+	if( rows > 0 )
+	{
+		fxn( context, 0, rows, 0 );
+	}
 }
 
-bool imageio_bitmap_load( const char* filename, bitmap_info_header_t* info_header, uint8_t** bitmap )
+void imageio_set_thread_count( uint32_t count )
 {
-	bitmap_file_header_t bmp_file_header;
-	register uint32_t imageIdx = 0;
-	unsigned short bytesPerPixel = 0;
-	uint32_t bitmapSize = 0;
-	uint32_t scanlineBytes = 0;
-	uint32_t stride = 0;
-	FILE* filePtr = fopen( filename, "rb" );
+	#ifndef _WIN32
+	uint32_t i;
 
-	if( !filePtr )
+	if( count == 0 )
 	{
-		*bitmap = NULL;
-		return false;
+		long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+		count = cpus > 0 ? (uint32_t) cpus : 1;
 	}
 
-	fread( &bmp_file_header.bfType, sizeof(uint16_t), 1, filePtr );
-	fread( &bmp_file_header.bfSize, sizeof(uint32_t), 1, filePtr );
-	fread( &bmp_file_header.bfReserved1, sizeof(uint16_t), 1, filePtr );
-	fread( &bmp_file_header.bfReserved2, sizeof(uint16_t), 1, filePtr );
-	fread( &bmp_file_header.bfOffBits, sizeof(uint32_t), 1, filePtr );
-
-	if( bmp_file_header.bfType != BITMAP_ID )
+	if( count > PARALLEL_MAX_THREADS )
 	{
-		fclose(filePtr);
-		*bitmap = NULL;
-		return false;
+		count = PARALLEL_MAX_THREADS;
 	}
 
-	fread( info_header, sizeof(bitmap_info_header_t), 1, filePtr );
-	bytesPerPixel = info_header->biBitCount >> 3;
-	scanlineBytes = info_header->biWidth * bytesPerPixel;
-	stride = (info_header->biWidth * bytesPerPixel + 3) & ~3;
-	fseek( filePtr, bmp_file_header.bfOffBits, SEEK_SET );
-
-	bitmapSize = scanlineBytes * info_header->biHeight;
-	*bitmap = (uint8_t*) malloc( bitmapSize );
+	pthread_mutex_lock( &pool.busy );
 
-#ifdef NDEBUG
-	memset( *bitmap, 0, bitmapSize );
-#endif
+	pthread_mutex_lock( &pool.lock );
+	pool.shutdown = true;
+	pthread_cond_broadcast( &pool.wake );
+	pthread_mutex_unlock( &pool.lock );
 
-	/* check if allocation failed... */
-	if( *bitmap == NULL )
+	for( i = 0; i < pool.worker_count; i++ )
 	{
-		fclose( filePtr );
-		return false;
+		pthread_join( pool.workers[ i ], NULL );
 	}
 
-	for( imageIdx = 0; imageIdx < bitmapSize; imageIdx += scanlineBytes )
+	pool.shutdown     = false;
+	pool.worker_count = 0;
+
+	/* the calling thread is the first thread */
+	while( pool.worker_count + 1 < count &&
+	       pthread_create( &pool.workers[ pool.worker_count ], NULL, thread_pool_worker, NULL ) == 0 )
 	{
-		// read in pixels and skip padding...
-		fread( *bitmap + imageIdx, scanlineBytes, 1, filePtr );
-		fseek( filePtr, stride - scanlineBytes, SEEK_CUR );
+		pool.worker_count++;
 	}
 
-	convertBGRtoRGB( info_header->biWidth, info_header->biHeight, bytesPerPixel, *bitmap );
-
-	fclose( filePtr );
-	return true;
+	imageio_threads = pool.worker_count + 1;
+	pthread_mutex_unlock( &pool.busy );
+	#else
+	(void) count;
+	#endif
 }
 
-bool imageio_bitmap_save( const char* filename, uint32_t width, uint32_t height, uint32_t bit_depth, uint8_t* imageData )
+uint32_t imageio_thread_count( void )
 {
-	FILE* filePtr;
-	bitmap_file_header_t bmp_file_header;
-	bitmap_info_header_t info_header;
-	uint8_t nullByte;
-	uint32_t imageIdx = 0;
-	uint32_t bitmapIdx = 0;
-	uint32_t bytesPerPixel = bit_depth >> 3;
-	uint32_t stride = (width * bytesPerPixel + 3) & ~3;
-	uint32_t scanlineBytes = width * bytesPerPixel;
+	return imageio_threads;
+}
 
-	if( (filePtr = fopen(filename, "wb")) == NULL )
-	{
-		return false;
-	}
+/*
+ *  Runtime CPU dispatch. The hot kernels come in scalar, SSE2, SSSE3 and
+ *  AVX2 flavors which are all compiled into the library; the table for the
+ *  best level the CPU supports is picked on first use. Every level
+ *  produces the same bytes.
+ */
+#if defined(IMAGEIO_X86)
+#define TARGET_SSE2   __attribute__((target("sse2")))
+#define TARGET_SSSE3  __attribute__((target("ssse3")))
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#endif
 
-	/* Define the bmp_file_header */
-	bmp_file_header.bfSize = sizeof(bitmap_file_header_t);
-	bmp_file_header.bfType = BITMAP_ID;
-	bmp_file_header.bfReserved1 = 0;
-	bmp_file_header.bfReserved2 = 0;
-	bmp_file_header.bfOffBits = sizeof(bitmap_file_header_t) + sizeof(bitmap_info_header_t);
-	/* Define the info_header */
-	info_header.biSize = sizeof(bitmap_info_header_t);
-	info_header.biPlanes = 1;
-	info_header.biBitCount = bit_depth;
-	info_header.biCompression = BI_RGB;		/* No compression */
-	info_header.biSizeImage = stride * height;  /* w * h * (4 bytes) */
-	info_header.biXPelsPerMeter = 0;
-	info_header.biYPelsPerMeter = 0;
-	info_header.biClrUsed = 0;
-	info_header.biClrImportant = 0;
-	info_header.biWidth = width;
-	info_header.biHeight = height;
+struct resample;
 
-	convertRGBtoBGR( width, height, bytesPerPixel, imageData );
+typedef struct cpu_kernels {
+	void     (*swap_red_and_blue)   ( uint8_t* bitmap, size_t count, uint32_t byte_count );
+	void     (*blend_span)          ( uint8_t* dst, const uint8_t* src, size_t count, blend_mode_t mode );
+	void     (*resample_horizontal) ( const struct resample* r, const uint8_t* src_row, int16_t* dst_row );
+	void     (*resample_vertical)   ( const int16_t* const* rows, const int16_t* weights, uint32_t taps, int32_t* accum, uint8_t* dst_row, size_t row_size );
+	uint32_t (*bilinear_row_rgba)   ( const imageio_resize_plan_t* plan, const uint8_t* top, const uint8_t* bottom, uint32_t fy, uint8_t* dst_row );
+	void     (*rgb_to_yuv444)       ( uint8_t* bitmap, size_t count, uint32_t byte_count );
+	void     (*yuv444_to_rgb)       ( uint8_t* bitmap, size_t count, uint32_t byte_count );
+} cpu_kernels_t;
 
-	fwrite( &bmp_file_header, sizeof(bitmap_file_header_t), 1, filePtr );
-	fwrite( &info_header, sizeof(bitmap_info_header_t), 1, filePtr );
+static const cpu_kernels_t* cpu_kernels( void );
 
-	for( imageIdx = 0, bitmapIdx = 0; imageIdx <  info_header.biSizeImage; imageIdx += stride, bitmapIdx += scanlineBytes )
-	{
-		fwrite( imageData + bitmapIdx, scanlineBytes, 1, filePtr );
-		fwrite( &nullByte, 1, stride - scanlineBytes, filePtr );
-	}
+/*
+ *  I/O. The codecs only read, write and skip forward through an
+ *  imageio_io_t, so files, memory buffers and user callbacks all share
+ *  the same code.
+ */
+static size_t file_read( void* user, void* buffer, size_t size )
+{
+	return fread( buffer, 1, size, (FILE*) user );
+}
 
-	fclose( filePtr );
-	return true;
+static size_t file_write( void* user, const void* buffer, size_t size )
+{
+	return fwrite( buffer, 1, size, (FILE*) user );
 }
 
-bool imageio_targa_load( const char* filename, targa_file_header_t* p_file_header, uint8_t** bitmap )
+static int file_seek( void* user, long offset, int whence )
 {
-	uint32_t colorMode;		/* 4 for RGBA or 3 for RGB */
-	uint32_t imageSize = 0;
-	FILE* filePtr = fopen( filename, "rb" );
+	return fseek( (FILE*) user, offset, whence );
+}
 
-	if( !filePtr )
-	{
-		return false;
-	}
+static __inline void file_io( imageio_io_t* io, FILE* file )
+{
+	io->user  = file;
+	io->read  = file_read;
+	io->write = file_write;
+	io->seek  = file_seek;
+}
 
-	/* read in first two bytes we don't need */
-	fread( p_file_header, sizeof(targa_file_header_t), 1, filePtr );
+typedef struct memory_stream {
+	const uint8_t* data;
+	uint8_t* buffer;    /* when writing */
+	size_t size;
+	size_t capacity;
+	size_t position;
+} memory_stream_t;
 
+static size_t memory_read( void* user, void* buffer, size_t size )
+{
+	memory_stream_t* stream = (memory_stream_t*) user;
+	size_t available = stream->position < stream->size ? stream->size - stream->position : 0;
 
-	if( (p_file_header->imageTypeCode != 2) && (p_file_header->imageTypeCode != 3) )
+	if( size > available )
 	{
-		fclose( filePtr );
-		return false;
+		size = available;
 	}
 
-	/* colorMode-> 3 = BGR, 4 = BGRA */
-	colorMode = p_file_header->bitCount >> 3; // bytes per pixel
+	memcpy( buffer, stream->data + stream->position, size );
+	stream->position += size;
+	return size;
+}
+
+static size_t memory_write( void* user, const void* buffer, size_t size )
+{
+	memory_stream_t* stream = (memory_stream_t*) user;
 
+	if( stream->position + size > stream->capacity )
+	{
+		size_t capacity = stream->capacity ? stream->capacity : 4096;
+		uint8_t* grown;
 
-	imageSize = p_file_header->width * p_file_header->height * colorMode;
+		while( capacity < stream->position + size )
+		{
+			capacity *= 2;
+		}
 
-	*bitmap = (uint8_t*) malloc( imageSize );
+		grown = (uint8_t*) imageio_realloc( stream->buffer, capacity );
 
-	/* check if allocation failed... */
-	if( *bitmap == NULL )
-	{
-		return false;
+		if( !grown )
+		{
+			return 0;
+		}
+
+		stream->buffer   = grown;
+		stream->data     = grown;
+		stream->capacity = capacity;
 	}
 
-	fread( *bitmap, 1, imageSize, filePtr );
+	memcpy( stream->buffer + stream->position, buffer, size );
+	stream->position += size;
 
-	/* indexed color mode not handled!!! */
-	convertBGRtoRGB( p_file_header->width, p_file_header->height, colorMode, *bitmap );
+	if( stream->position > stream->size )
+	{
+		stream->size = stream->position;
+	}
 
-	fclose( filePtr );
-	return true;
+	return size;
 }
 
-bool imageio_targa_save( const char* filename, targa_file_header_t* p_file_header, uint8_t* bitmap )
+static int memory_seek( void* user, long offset, int whence )
 {
-	FILE* filePtr;
-	long imageSize;		/* size of the Targa image */
-	uint32_t colorMode = p_file_header->bitCount >> 3; /* 4 for RGBA or 3 for RGB */
+	memory_stream_t* stream = (memory_stream_t*) user;
+	long base;
 
-	if( ( filePtr = fopen( filename, "wb" ) ) == NULL )
+	switch( whence )
 	{
-		return false;
+		case SEEK_SET: base = 0; break;
+		case SEEK_CUR: base = (long) stream->position; break;
+		case SEEK_END: base = (long) stream->size; break;
+		default: return -1;
 	}
 
-	p_file_header->imageIDLength     = 0;
-	p_file_header->imageTypeCode     = 2;
-	p_file_header->colorMapOrigin    = 0;
+	if( base + offset < 0 )
+	{
+		return -1;
+	}
+
+	stream->position = (size_t) (base + offset);
+	return 0;
+}
+
+static __inline void memory_io( imageio_io_t* io, memory_stream_t* stream )
+{
+	io->user  = stream;
+	io->read  = memory_read;
+	io->write = memory_write;
+	io->seek  = memory_seek;
+}
+
+static __inline bool io_read( imageio_io_t* io, void* buffer, size_t size )
+{
+	return io->read( io->user, buffer, size ) == size;
+}
+
+static __inline bool io_write( imageio_io_t* io, const void* buffer, size_t size )
+{
+	return io->write( io->user, buffer, size ) == size;
+}
+
+/* Skips forward; streams without seek are read through. */
+static bool io_skip( imageio_io_t* io, size_t count )
+{
+	uint8_t scratch[ 256 ];
+
+	if( count == 0 )
+	{
+		return true;
+	}
+
+	if( io->seek && count <= LONG_MAX )
+	{
+		return io->seek( io->user, (long) count, SEEK_CUR ) == 0;
+	}
+
+	while( count > 0 )
+	{
+		size_t size = count < sizeof(scratch) ? count : sizeof(scratch);
+
+		if( !io_read( io, scratch, size ) )
+		{
+			return false;
+		}
+
+		count -= size;
+	}
+
+	return true;
+}
+
+static bool format_from_extension( const char* filename, image_file_format_t* format )
+{
+	const char* extension = strrchr( filename, '.' );
+
+	if( !extension )
+	{
+		return false;
+	}
+
+	extension += 1;
+
+	if( strcasecmp( "png", extension ) == 0 )
+	{
+		*format = IMAGEIO_PNG;
+	}
+	else if( strcasecmp( "bmp", extension ) == 0 )
+	{
+		*format = IMAGEIO_BMP;
+	}
+	else if( strcasecmp( "tga", extension ) == 0 )
+	{
+		*format = IMAGEIO_TGA;
+	}
+	else if( strcasecmp( "pvr", extension ) == 0 || strcasecmp( "pvrtc", extension ) == 0 )
+	{
+		*format = IMAGEIO_PVR;
+	}
+	else if( strcasecmp( "raw", extension ) == 0 )
+	{
+		*format = IMAGEIO_RAW;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Recognizes a format from the first bytes of a file. PNG, BMP, PVR and
+ * RAW have magic numbers; Targa has none, so a header that describes an
+ * uncompressed image the Targa loader accepts is taken as one.
+ */
+static bool format_from_magic( const uint8_t* header, size_t size, image_file_format_t* format )
+{
+	if( size >= 8 && png_sig_cmp( (png_const_bytep) header, 0, 8 ) == 0 )
+	{
+		*format = IMAGEIO_PNG;
+	}
+	else if( size >= 2 && header[ 0 ] == 'B' && header[ 1 ] == 'M' )
+	{
+		*format = IMAGEIO_BMP;
+	}
+	else if( size >= sizeof(pvr_header_t) && memcmp( header + offsetof(pvr_header_t, pvr_tag), "PVR!", 4 ) == 0 )
+	{
+		*format = IMAGEIO_PVR;
+	}
+	else if( size >= 4 && memcmp( header, RAW_MAGIC, 4 ) == 0 )
+	{
+		*format = IMAGEIO_RAW;
+	}
+	else if( size >= sizeof(targa_file_header_t) &&
+	         header[ 1 ] == 0 &&                                           /* colorMapType */
+	         (header[ 2 ] == 2 || header[ 2 ] == 3) &&                     /* imageTypeCode */
+	         (header[ 12 ] | header[ 13 ]) != 0 &&                         /* width */
+	         (header[ 14 ] | header[ 15 ]) != 0 &&                         /* height */
+	         (header[ 16 ] == 8 || header[ 16 ] == 16 || header[ 16 ] == 24 || header[ 16 ] == 32) )
+	{
+		*format = IMAGEIO_TGA;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/* Picks the decoder from the magic bytes (falling back to the extension
+ * when nothing matches) and rewinds the file for it.
+ */
+static bool format_from_file( FILE* file, const char* filename, image_file_format_t* format )
+{
+	uint8_t header[ sizeof(pvr_header_t) ];
+	size_t header_size = fread( header, 1, sizeof(header), file );
+
+	if( !format_from_magic( header, header_size, format ) &&
+	    !format_from_extension( filename, format ) )
+	{
+		return false;
+	}
+
+	return fseek( file, 0, SEEK_SET ) == 0;
+}
+
+/*
+ * Opens the file once, sniffs the format and decodes from the same stream.
+ */
+bool imageio_load( image_t* img, const char* filename, image_file_format_t* fmt )
+{
+	bool result = false;
+	image_file_format_t format = IMAGEIO_PNG;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
+
+	img->bit_depth = 0;
+	img->channels  = 0;
+	img->width     = 0;
+	img->height    = 0;
+	img->pixels    = 0;
+	img->stride    = 0;
+
+	if( !file )
+	{
+		return false;
+	}
+
+	if( !format_from_file( file, filename, &format ) )
+	{
+		goto failure;
+	}
+
+	if( fmt )
+	{
+		*fmt = format;
+	}
+
+	file_io( &io, file );
+
+	if( imageio_image_load_io( img, &io, format ) )
+	{
+		if( format == IMAGEIO_PVR )
+		{
+			if( !is_power_of_2(img->width) || !is_power_of_2(img->height) )
+			{
+				   /* iOS devices require texture dimensions to be
+					* a power of 2.
+					*/
+				   imageio_image_destroy( img );
+				   goto failure;
+			}
+		}
+
+		result = true;
+	}
+
+failure:
+	fclose( file );
+	return result;
+}
+
+bool imageio_image_load( image_t* img, const char* filename, image_file_format_t format )
+{
+	return imageio_image_load_ex( img, filename, format, NULL );
+}
+
+bool imageio_image_load_ex( image_t* img, const char* filename, image_file_format_t format, const imageio_load_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_image_load_io_ex( img, &io, format, options );
+		fclose( file );
+	}
+	else
+	{
+		img->bit_depth = 0;
+		img->channels  = 0;
+		img->width     = 0;
+		img->height    = 0;
+		img->pixels    = 0;
+		img->stride    = 0;
+	}
+
+	return result;
+}
+
+bool imageio_image_load_memory( image_t* img, const void* data, size_t size, image_file_format_t format )
+{
+	return imageio_image_load_memory_ex( img, data, size, format, NULL );
+}
+
+bool imageio_image_load_memory_ex( image_t* img, const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options )
+{
+	memory_stream_t stream;
+	imageio_io_t io;
+
+	memset( &stream, 0, sizeof(stream) );
+	stream.data = (const uint8_t*) data;
+	stream.size = size;
+	memory_io( &io, &stream );
+	io.write = NULL;
+
+	return imageio_image_load_io_ex( img, &io, format, options );
+}
+
+bool imageio_image_load_io( image_t* img, imageio_io_t* io, image_file_format_t format )
+{
+	return imageio_image_load_io_ex( img, io, format, NULL );
+}
+
+bool imageio_image_load_io_ex( image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options )
+{
+	decode_target_t target;
+
+	memset( &target, 0, sizeof(target) );
+	if( options && options->row_alignment > 1 )
+	{
+		if( (options->row_alignment & (options->row_alignment - 1)) != 0 )
+		{
+			memset( img, 0, sizeof(image_t) );
+			return false;
+		}
+		target.alignment = options->row_alignment;
+	}
+	return image_load( img, io, format, options, &target, NULL );
+}
+
+bool imageio_image_load_into( image_t* img, void* dst, size_t dst_size, size_t stride, const char* filename, image_file_format_t format, const imageio_load_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_image_load_io_into( img, dst, dst_size, stride, &io, format, options );
+		fclose( file );
+	}
+	else
+	{
+		img->bit_depth = 0;
+		img->channels  = 0;
+		img->width     = 0;
+		img->height    = 0;
+		img->pixels    = 0;
+		img->stride    = 0;
+	}
+
+	return result;
+}
+
+bool imageio_image_load_memory_into( image_t* img, void* dst, size_t dst_size, size_t stride, const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options )
+{
+	memory_stream_t stream;
+	imageio_io_t io;
+
+	memset( &stream, 0, sizeof(stream) );
+	stream.data = (const uint8_t*) data;
+	stream.size = size;
+	memory_io( &io, &stream );
+	io.write = NULL;
+
+	return imageio_image_load_io_into( img, dst, dst_size, stride, &io, format, options );
+}
+
+bool imageio_image_load_io_into( image_t* img, void* dst, size_t dst_size, size_t stride, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options )
+{
+	decode_target_t target;
+
+	if( !dst )
+	{
+		memset( img, 0, sizeof(image_t) );
+		return false;
+	}
+
+	target.pixels    = (uint8_t*) dst;
+	target.size      = dst_size;
+	target.stride    = stride;
+	target.alignment = 0;
+	target.allocated = false;
+	return image_load( img, io, format, options, &target, NULL );
+}
+
+bool image_load( image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options, decode_target_t* target, png_arena_t* arena )
+{
+	bool result = false;
+	imageio_layout_t layout = options ? options->layout : IMAGEIO_LAYOUT_NATIVE;
+
+	switch( format )
+	{
+		case IMAGEIO_BMP:
+		{
+			bitmap_info_header_t bmpInfoHeader;
+			result = imageio_bitmap_load( io, &bmpInfoHeader, layout, target );
+			if( result )
+			{
+				img->pixels    = target->pixels;
+				img->channels  = layout_channels( layout, bmpInfoHeader.biBitCount >> 3 );
+				img->bit_depth = layout == IMAGEIO_LAYOUT_NATIVE ? (uint8_t) bmpInfoHeader.biBitCount : img->channels << 3;
+				img->width     = bmpInfoHeader.biWidth;
+				img->height    = bmpInfoHeader.biHeight;
+			}
+			break;
+		}
+		case IMAGEIO_TGA:
+		{
+			targa_file_header_t tgaHeader;
+			result = imageio_targa_load( io, &tgaHeader, layout, target );
+			if( result )
+			{
+				img->pixels    = target->pixels;
+				img->channels  = layout_channels( layout, tgaHeader.bitCount >> 3 );
+				img->bit_depth = img->channels << 3;
+				img->width     = tgaHeader.width;
+				img->height    = tgaHeader.height;
+			}
+			break;
+		}
+		case IMAGEIO_PNG:
+		{
+			result = imageio_png_load( io, img, layout, target, arena );
+			break;
+		}
+		case IMAGEIO_PVR:
+		{
+			pvr_header_t header;
+			/* the pixel data is handed over as stored */
+			result = layout == IMAGEIO_LAYOUT_NATIVE &&
+			         imageio_pvr_load( io, &header, target );
+			if( result )
+			{
+				img->pixels    = target->pixels;
+				img->bit_depth = header.bit_depth;
+				img->channels  = header.bitmask_alpha > 0 ? 4 : 3;
+				img->width     = header.width;
+				img->height    = header.height;
+			}
+			break;
+		}
+		case IMAGEIO_RAW:
+		{
+			raw_header_t header;
+			result = imageio_raw_load( io, &header, layout, target );
+			if( result )
+			{
+				img->pixels    = target->pixels;
+				img->bit_depth = header.bit_depth;
+				img->channels  = header.channels;
+				img->width     = header.width;
+				img->height    = header.height;
+			}
+			break;
+		}
+		default:
+			break;
+	}
+
+	if( result )
+	{
+		/* PVR data has no rows */
+		img->stride = format == IMAGEIO_PVR ? 0 : target->stride;
+	}
+	else
+	{
+		img->bit_depth = 0;
+		img->channels  = 0;
+		img->width     = 0;
+		img->height    = 0;
+		img->pixels    = 0;
+		img->stride    = 0;
+	}
+
+	return result;
+}
+
+bool imageio_probe( imageio_info_t* info, const char* filename, image_file_format_t format )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_probe_io( info, &io, format );
+		fclose( file );
+	}
+	else
+	{
+		memset( info, 0, sizeof(imageio_info_t) );
+	}
+
+	return result;
+}
+
+bool imageio_probe_memory( imageio_info_t* info, const void* data, size_t size, image_file_format_t format )
+{
+	memory_stream_t stream;
+	imageio_io_t io;
+
+	memset( &stream, 0, sizeof(stream) );
+	stream.data = (const uint8_t*) data;
+	stream.size = size;
+	memory_io( &io, &stream );
+	io.write = NULL;
+
+	return imageio_probe_io( info, &io, format );
+}
+
+bool imageio_probe_io( imageio_info_t* info, imageio_io_t* io, image_file_format_t format )
+{
+	bool result = false;
+
+	memset( info, 0, sizeof(imageio_info_t) );
+	info->format = format;
+
+	switch( format )
+	{
+		case IMAGEIO_BMP:
+		{
+			bitmap_file_header_t bmpFileHeader;
+			bitmap_info_header_t bmpInfoHeader;
+			result = imageio_bitmap_load_header( io, &bmpFileHeader, &bmpInfoHeader ) &&
+			         bmpInfoHeader.biWidth > 0 && bmpInfoHeader.biHeight > 0;
+			if( result )
+			{
+				info->bit_depth = (uint8_t) bmpInfoHeader.biBitCount;
+				info->channels  = bmpInfoHeader.biBitCount >> 3;
+				info->width     = bmpInfoHeader.biWidth;
+				info->height    = bmpInfoHeader.biHeight;
+			}
+			break;
+		}
+		case IMAGEIO_TGA:
+		{
+			targa_file_header_t tgaHeader;
+			result = imageio_targa_load_header( io, &tgaHeader );
+			if( result )
+			{
+				info->bit_depth = tgaHeader.bitCount;
+				info->channels  = tgaHeader.bitCount >> 3;
+				info->width     = tgaHeader.width;
+				info->height    = tgaHeader.height;
+			}
+			break;
+		}
+		case IMAGEIO_PNG:
+		{
+			result = imageio_png_probe( io, info );
+			break;
+		}
+		case IMAGEIO_PVR:
+		{
+			pvr_header_t header;
+			result = io_read( io, &header, sizeof(pvr_header_t) ) &&
+			         header.header_length >= sizeof(pvr_header_t);
+			if( result )
+			{
+				info->bit_depth = header.bit_depth;
+				info->channels  = header.bitmask_alpha > 0 ? 4 : 3;
+				info->width     = header.width;
+				info->height    = header.height;
+			}
+			break;
+		}
+		case IMAGEIO_RAW:
+		{
+			raw_header_t header;
+			result = imageio_raw_load_header( io, &header );
+			if( result )
+			{
+				info->bit_depth = header.bit_depth;
+				info->channels  = header.channels;
+				info->width     = header.width;
+				info->height    = header.height;
+			}
+			break;
+		}
+		default:
+			break;
+	}
+
+	if( !result )
+	{
+		memset( info, 0, sizeof(imageio_info_t) );
+		info->format = format;
+	}
+
+	return result;
+}
+
+bool imageio_image_save( const image_t* img, const char* filename, image_file_format_t format )
+{
+	return imageio_image_save_ex( img, filename, format, NULL );
+}
+
+bool imageio_image_save_ex( const image_t* img, const char* filename, image_file_format_t format, const imageio_save_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file;
+
+	if( format != IMAGEIO_BMP && format != IMAGEIO_TGA && format != IMAGEIO_PNG && format != IMAGEIO_RAW )
+	{
+		return false;
+	}
+
+	file = fopen( filename, "wb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_image_save_io_ex( img, &io, format, options );
+		result = fclose( file ) == 0 && result;
+	}
+
+	return result;
+}
+
+bool imageio_image_save_memory( const image_t* img, void** data, size_t* size, image_file_format_t format )
+{
+	return imageio_image_save_memory_ex( img, data, size, format, NULL );
+}
+
+bool imageio_image_save_memory_ex( const image_t* img, void** data, size_t* size, image_file_format_t format, const imageio_save_options_t* options )
+{
+	memory_stream_t stream;
+	imageio_io_t io;
+
+	memset( &stream, 0, sizeof(stream) );
+	memory_io( &io, &stream );
+
+	if( !imageio_image_save_io_ex( img, &io, format, options ) )
+	{
+		imageio_free( stream.buffer );
+		*data = NULL;
+		*size = 0;
+		return false;
+	}
+
+	*data = stream.buffer;
+	*size = stream.size;
+	return true;
+}
+
+bool imageio_image_save_io( const image_t* img, imageio_io_t* io, image_file_format_t format )
+{
+	return imageio_image_save_io_ex( img, io, format, NULL );
+}
+
+bool imageio_image_save_io_ex( const image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_save_options_t* options )
+{
+	return image_save( img, io, format, options, NULL );
+}
+
+bool image_save( const image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_save_options_t* options, png_arena_t* arena )
+{
+	bool result = false;
+
+	switch( format )
+	{
+		case IMAGEIO_BMP:
+		{
+			result = imageio_bitmap_save( io, img->width, img->height, img->bit_depth, imageio_image_stride( img ), img->pixels );
+			assert( img->pixels != NULL );
+			break;
+		}
+		case IMAGEIO_TGA:
+		{
+			targa_file_header_t tgaFileHeader;
+			/* the TGA header only has room for 16-bit dimensions */
+			if( img->width > UINT16_MAX || img->height > UINT16_MAX )
+			{
+				break;
+			}
+			tgaFileHeader.bitCount = img->bit_depth;
+			tgaFileHeader.width = img->width;
+			tgaFileHeader.height = img->height;
+			result = imageio_targa_save( io, &tgaFileHeader, imageio_image_stride( img ), img->pixels );
+			break;
+		}
+		case IMAGEIO_PNG:
+		{
+			result = imageio_png_save( io, img, options, arena );
+			break;
+		}
+		case IMAGEIO_RAW:
+		{
+			result = imageio_raw_save( io, img, NULL );
+			break;
+		}
+		default:
+			break;
+	}
+
+
+	return result;
+}
+
+/* An image_t that shares the view's pixels, for the codecs. */
+static bool image_from_view( image_t* img, const imageio_view_t* view )
+{
+	img->width     = view->width;
+	img->height    = view->height;
+	img->bit_depth = view->channels << 3;
+	img->channels  = view->channels;
+	img->pixels    = view->pixels;
+	img->stride    = view->stride;
+	return true;
+}
+
+bool imageio_image_save_view( const imageio_view_t* view, const char* filename, image_file_format_t format )
+{
+	image_t img;
+	return image_from_view( &img, view ) && imageio_image_save( &img, filename, format );
+}
+
+bool imageio_image_save_view_memory( const imageio_view_t* view, void** data, size_t* size, image_file_format_t format )
+{
+	image_t img;
+
+	if( !image_from_view( &img, view ) )
+	{
+		*data = NULL;
+		*size = 0;
+		return false;
+	}
+
+	return imageio_image_save_memory( &img, data, size, format );
+}
+
+bool imageio_image_save_view_io( const imageio_view_t* view, imageio_io_t* io, image_file_format_t format )
+{
+	image_t img;
+	return image_from_view( &img, view ) && imageio_image_save_io( &img, io, format );
+}
+
+/*
+ *  Pixel buffers. Every image the library allocates gets its pixels from
+ *  image_alloc, so aligned and unaligned images are freed the same way.
+ *  Callers have always been free to build an image_t around pixels they
+ *  malloc'd and hand it to imageio_image_destroy, so the pixels image_alloc
+ *  hands out are kept in a set (open addressing, linear probing) and
+ *  anything not in it goes to free().
+ */
+#define PIXEL_SET_MIN_CAPACITY  64
+
+static struct pixel_set {
+	uint8_t** slots;       /* NULL where empty */
+	size_t    capacity;    /* a power of 2 */
+	size_t    count;
+	#ifndef _WIN32
+	pthread_mutex_t lock;
+	#else
+	SRWLOCK lock;
+	#endif
+} pixel_set = {
+	.slots    = NULL,
+	.capacity = 0,
+	.count    = 0,
+	#ifndef _WIN32
+	.lock     = PTHREAD_MUTEX_INITIALIZER,
+	#else
+	.lock     = SRWLOCK_INIT,
+	#endif
+};
+
+static __inline void pixel_set_lock( void )
+{
+	#ifndef _WIN32
+	pthread_mutex_lock( &pixel_set.lock );
+	#else
+	AcquireSRWLockExclusive( &pixel_set.lock );
+	#endif
+}
+
+static __inline void pixel_set_unlock( void )
+{
+	#ifndef _WIN32
+	pthread_mutex_unlock( &pixel_set.lock );
+	#else
+	ReleaseSRWLockExclusive( &pixel_set.lock );
+	#endif
+}
+
+static __inline size_t pixel_set_hash( const uint8_t* pixels, size_t mask )
+{
+	size_t h = (size_t) ((uintptr_t) pixels >> 4);
+
+	h ^= h >> 15;
+	h *= 0x2c1b3c6dU;
+	h ^= h >> 12;
+	return h & mask;
+}
+
+/* Must be called with the lock held. */
+static bool pixel_set_grow( void )
+{
+	size_t capacity = pixel_set.capacity ? 2 * pixel_set.capacity : PIXEL_SET_MIN_CAPACITY;
+	uint8_t** slots = (uint8_t**) imageio_calloc( capacity, sizeof(uint8_t*) );
+	size_t i, j;
+
+	if( !slots )
+	{
+		return false;
+	}
+
+	for( i = 0; i < pixel_set.capacity; i++ )
+	{
+		if( pixel_set.slots[ i ] )
+		{
+			j = pixel_set_hash( pixel_set.slots[ i ], capacity - 1 );
+
+			while( slots[ j ] )
+			{
+				j = (j + 1) & (capacity - 1);
+			}
+
+			slots[ j ] = pixel_set.slots[ i ];
+		}
+	}
+
+	imageio_free( pixel_set.slots );
+	pixel_set.slots    = slots;
+	pixel_set.capacity = capacity;
+	return true;
+}
+
+static bool pixel_set_add( uint8_t* pixels )
+{
+	bool result = true;
+	size_t i;
+
+	pixel_set_lock( );
+
+	/* kept at most half full */
+	if( 2 * (pixel_set.count + 1) > pixel_set.capacity )
+	{
+		result = pixel_set_grow( );
+	}
+
+	if( result )
+	{
+		i = pixel_set_hash( pixels, pixel_set.capacity - 1 );
+
+		while( pixel_set.slots[ i ] )
+		{
+			i = (i + 1) & (pixel_set.capacity - 1);
+		}
+
+		pixel_set.slots[ i ] = pixels;
+		pixel_set.count++;
+	}
+
+	pixel_set_unlock( );
+	return result;
+}
+
+/* Returns whether pixels were in the set. */
+static bool pixel_set_remove( const uint8_t* pixels )
+{
+	bool found = false;
+	size_t mask, i, j, home;
+
+	pixel_set_lock( );
+
+	mask = pixel_set.capacity - 1;
+	i    = pixel_set.capacity > 0 ? pixel_set_hash( pixels, mask ) : 0;
+
+	while( pixel_set.capacity > 0 && pixel_set.slots[ i ] && !found )
+	{
+		found = pixel_set.slots[ i ] == pixels;
+		i     = found ? i : (i + 1) & mask;
+	}
+
+	if( found )
+	{
+		/* close the gap, so every entry stays reachable from its home slot */
+		pixel_set.slots[ i ] = NULL;
+		pixel_set.count--;
+
+		for( j = (i + 1) & mask; pixel_set.slots[ j ]; j = (j + 1) & mask )
+		{
+			home = pixel_set_hash( pixel_set.slots[ j ], mask );
+
+			if( ((j - home) & mask) >= ((j - i) & mask) )
+			{
+				pixel_set.slots[ i ] = pixel_set.slots[ j ];
+				pixel_set.slots[ j ] = NULL;
+				i = j;
+			}
+		}
+	}
+
+	pixel_set_unlock( );
+	return found;
+}
+
+/* The table came from the allocator that is being replaced; nothing is in it by then. */
+void pixel_set_release( void )
+{
+	pixel_set_lock( );
+
+	if( pixel_set.count == 0 )
+	{
+		imageio_free( pixel_set.slots );
+		pixel_set.slots    = NULL;
+		pixel_set.capacity = 0;
+	}
+
+	pixel_set_unlock( );
+}
+
+uint8_t* image_alloc( size_t size, uint32_t alignment )
+{
+	uint8_t* block;
+	uint8_t* pixels;
+
+	if( alignment < sizeof(void*) )
+	{
+		alignment = sizeof(void*);
+	}
+
+	if( size > SIZE_MAX - alignment - sizeof(void*) )
+	{
+		return NULL;
+	}
+
+	/* The block the allocator handed out is kept just below the pixels. */
+	block = (uint8_t*) imageio_malloc( size + alignment + sizeof(void*) );
+
+	if( !block )
+	{
+		return NULL;
+	}
+
+	pixels = block + sizeof(void*);
+	pixels += (alignment - ((uintptr_t) pixels & (alignment - 1))) & (alignment - 1);
+	memcpy( pixels - sizeof(void*), &block, sizeof(void*) );
+
+	if( !pixel_set_add( pixels ) )
+	{
+		imageio_free( block );
+		return NULL;
+	}
+
+	return pixels;
+}
+
+/* Frees pixels from image_alloc; returns false (and does nothing) for any others. */
+bool image_free( uint8_t* pixels )
+{
+	void* block;
+
+	if( !pixels || !pixel_set_remove( pixels ) )
+	{
+		return false;
+	}
+
+	memcpy( &block, pixels - sizeof(void*), sizeof(void*) );
+	imageio_free( block );
+	return true;
+}
+
+static __inline size_t align_up( size_t size, uint32_t alignment )
+{
+	return alignment > 1 ? (size + alignment - 1) & ~((size_t) alignment - 1) : size;
+}
+
+/* stride * height, checked so that huge images fail instead of wrapping. */
+static __inline bool image_bytes( size_t stride, uint32_t height, size_t* size )
+{
+	if( height > 0 && stride > SIZE_MAX / height )
+	{
+		return false;
+	}
+
+	*size = stride * height;
+	return true;
+}
+
+bool imageio_image_create( image_t* img, uint32_t width, uint32_t height, uint8_t bit_depth )
+{
+	bool result = false;
+
+	size_t size;
+
+	if( img && (uint64_t) width * (bit_depth >> 3) <= SIZE_MAX &&
+	    image_bytes( (size_t) width * (bit_depth >> 3), height, &size ) )
+	{
+		img->bit_depth = bit_depth;
+		img->channels  = bit_depth >> 3;
+		img->width     = width;
+		img->height    = height;
+		img->stride    = (size_t) img->width * img->channels;
+		img->pixels    = image_alloc( size, 0 );
+
+		result = img->pixels != NULL;
+	}
+
+	return result;
+}
+
+bool imageio_image_create_aligned( image_t* img, uint32_t width, uint32_t height, uint8_t bit_depth, uint32_t alignment )
+{
+	bool result = false;
+
+	if( alignment == 0 )
+	{
+		alignment = IMAGEIO_ROW_ALIGNMENT;
+	}
+
+	size_t size;
+
+	if( img && (alignment & (alignment - 1)) == 0 && (uint64_t) width * (bit_depth >> 3) <= SIZE_MAX - alignment &&
+	    image_bytes( align_up( (size_t) width * (bit_depth >> 3), alignment ), height, &size ) )
+	{
+		img->bit_depth = bit_depth;
+		img->channels  = bit_depth >> 3;
+		img->width     = width;
+		img->height    = height;
+		img->stride    = align_up( (size_t) img->width * img->channels, alignment );
+		img->pixels    = image_alloc( size, alignment );
+
+		result = img->pixels != NULL;
+	}
+
+	return result;
+}
+
+bool imageio_image_view( imageio_view_t* view, const image_t* img, uint32_t x, uint32_t y, uint32_t width, uint32_t height )
+{
+	imageio_view_t whole;
+
+	whole.pixels   = img->pixels;
+	whole.width    = img->width;
+	whole.height   = img->height;
+	whole.stride   = imageio_image_stride( img );
+	whole.channels = img->bit_depth >> 3;
+
+	return imageio_view_crop( view, &whole, x, y, width, height );
+}
+
+bool imageio_view_crop( imageio_view_t* view, const imageio_view_t* parent, uint32_t x, uint32_t y, uint32_t width, uint32_t height )
+{
+	if( (uint64_t) x + width > parent->width || (uint64_t) y + height > parent->height )
+	{
+		return false;
+	}
+
+	view->pixels   = parent->pixels + y * parent->stride + (size_t) x * parent->channels;
+	view->width    = width;
+	view->height   = height;
+	view->stride   = parent->stride;
+	view->channels = parent->channels;
+	return true;
+}
+
+void imageio_image_destroy( image_t* img )
+{
+	/* pixels the caller set up themselves came from malloc */
+	if( !image_free( img->pixels ) )
+	{
+		free( img->pixels );
+	}
+
+	#ifdef NDEBUG
+	img->pixels = NULL;
+	#endif
+}
+
+bool decode_target_prepare( decode_target_t* target, uint32_t height, size_t row_size )
+{
+	size_t needed;
+
+	if( target->pixels )
+	{
+		if( target->stride == 0 )
+		{
+			target->stride = row_size;
+		}
+
+		/* the caller's buffer is too small */
+		if( target->stride < row_size || !image_bytes( target->stride, height > 0 ? height - 1 : 0, &needed ) )
+		{
+			return false;
+		}
+
+		return height == 0 || (needed <= SIZE_MAX - row_size && target->size >= needed + row_size);
+	}
+
+	if( row_size > SIZE_MAX - target->alignment )
+	{
+		return false;
+	}
+
+	target->stride    = align_up( row_size, target->alignment );
+	if( !image_bytes( target->stride, height, &needed ) )
+	{
+		return false;
+	}
+
+	target->pixels    = image_alloc( needed, target->alignment );
+	target->size      = needed;
+	target->allocated = true;
+
+	return target->pixels != NULL;
+}
+
+void decode_target_release( decode_target_t* target )
+{
+	if( target->allocated )
+	{
+		image_free( target->pixels );
+		target->pixels    = NULL;
+		target->allocated = false;
+	}
+}
+
+/*
+ *  Pixel layouts. BMP and TGA store BGR(A) or 8-bit gray; each row is
+ *  converted to the requested layout as it is read so that loading is a
+ *  single pass over the pixels.
+ */
+static __inline uint32_t layout_channels( imageio_layout_t layout, uint32_t native_channels )
+{
+	switch( layout )
+	{
+		case IMAGEIO_LAYOUT_RGBA8:
+		case IMAGEIO_LAYOUT_BGRA8:
+			return 4;
+		case IMAGEIO_LAYOUT_RGB8:
+		case IMAGEIO_LAYOUT_BGR8:
+			return 3;
+		case IMAGEIO_LAYOUT_GRAY8:
+			return 1;
+		default:
+			return native_channels;
+	}
+}
+
+/* Rec. 709 luma with libpng's default weights; gray stays gray. */
+static __inline uint8_t layout_luma( uint32_t r, uint32_t g, uint32_t b )
+{
+	return (uint8_t) ((6968 * r + 23434 * g + 2366 * b) >> 15);
+}
+
+static void layout_convert_bgr_row( const uint8_t* src, uint32_t src_channels, uint8_t* dst, imageio_layout_t layout, uint32_t width )
+{
+	const uint32_t dst_channels = layout_channels( layout, src_channels );
+	uint32_t x;
+
+	if( (src_channels == 4 && layout == IMAGEIO_LAYOUT_BGRA8) ||
+	    (src_channels == 3 && layout == IMAGEIO_LAYOUT_BGR8) )
+	{
+		memcpy( dst, src, (size_t) width * src_channels );
+		return;
+	}
+
+	for( x = 0; x < width; x++, src += src_channels, dst += dst_channels )
+	{
+		uint8_t b = src[ 0 ];
+		uint8_t g = src_channels == 1 ? b : src[ 1 ];
+		uint8_t r = src_channels == 1 ? b : src[ 2 ];
+		uint8_t a = src_channels == 4 ? src[ 3 ] : 0xff;
+
+		switch( layout )
+		{
+			case IMAGEIO_LAYOUT_RGBA8:
+				dst[ 0 ] = r; dst[ 1 ] = g; dst[ 2 ] = b; dst[ 3 ] = a;
+				break;
+			case IMAGEIO_LAYOUT_BGRA8:
+				dst[ 0 ] = b; dst[ 1 ] = g; dst[ 2 ] = r; dst[ 3 ] = a;
+				break;
+			case IMAGEIO_LAYOUT_RGB8:
+				dst[ 0 ] = r; dst[ 1 ] = g; dst[ 2 ] = b;
+				break;
+			case IMAGEIO_LAYOUT_BGR8:
+				dst[ 0 ] = b; dst[ 1 ] = g; dst[ 2 ] = r;
+				break;
+			case IMAGEIO_LAYOUT_GRAY8:
+				dst[ 0 ] = src_channels == 1 ? b : layout_luma( r, g, b );
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/* Only 8-bit gray, BGR and BGRA sources can be converted. */
+static __inline bool layout_supported( imageio_layout_t layout, uint32_t src_channels )
+{
+	if( layout == IMAGEIO_LAYOUT_NATIVE )
+	{
+		return src_channels > 0;
+	}
+
+	return (layout == IMAGEIO_LAYOUT_RGBA8 || layout == IMAGEIO_LAYOUT_BGRA8 ||
+	        layout == IMAGEIO_LAYOUT_RGB8  || layout == IMAGEIO_LAYOUT_BGR8  ||
+	        layout == IMAGEIO_LAYOUT_GRAY8) &&
+	       (src_channels == 1 || src_channels == 3 || src_channels == 4);
+}
+
+bool imageio_bitmap_load_header( imageio_io_t* io, bitmap_file_header_t* file_header, bitmap_info_header_t* info_header )
+{
+	if( !io_read( io, &file_header->bfType, sizeof(uint16_t) ) ||
+	    !io_read( io, &file_header->bfSize, sizeof(uint32_t) ) ||
+	    !io_read( io, &file_header->bfReserved1, sizeof(uint16_t) ) ||
+	    !io_read( io, &file_header->bfReserved2, sizeof(uint16_t) ) ||
+	    !io_read( io, &file_header->bfOffBits, sizeof(uint32_t) ) )
+	{
+		return false;
+	}
+
+	if( file_header->bfType != BITMAP_ID )
+	{
+		return false;
+	}
+
+	return io_read( io, info_header, sizeof(bitmap_info_header_t) );
+}
+
+bool imageio_bitmap_load( imageio_io_t* io, bitmap_info_header_t* info_header, imageio_layout_t layout, decode_target_t* target )
+{
+	bitmap_file_header_t bmp_file_header;
+	register uint32_t y = 0;
+	unsigned short bytesPerPixel = 0;
+	size_t scanlineBytes = 0;
+	size_t dstScanlineBytes = 0;
+	size_t stride = 0;
+	uint8_t* row = NULL;
+	const uint32_t headers_size = 14 + sizeof(bitmap_info_header_t);
+
+	if( !imageio_bitmap_load_header( io, &bmp_file_header, info_header ) ||
+	    bmp_file_header.bfOffBits < headers_size ||
+	    !io_skip( io, bmp_file_header.bfOffBits - headers_size ) )
+	{
+		return false;
+	}
+
+	/* bottom-up images only */
+	if( info_header->biWidth <= 0 || info_header->biHeight <= 0 )
+	{
+		return false;
+	}
+
+	bytesPerPixel = info_header->biBitCount >> 3;
+	scanlineBytes = (size_t) info_header->biWidth * bytesPerPixel;
+	stride = (scanlineBytes + 3) & ~(size_t) 3;
+
+	if( !layout_supported( layout, bytesPerPixel ) )
+	{
+		return false;
+	}
+
+	dstScanlineBytes = (size_t) info_header->biWidth * layout_channels( layout, bytesPerPixel );
+
+	/* check if the buffer is too small or allocation failed... */
+	if( !decode_target_prepare( target, info_header->biHeight, dstScanlineBytes ) )
+	{
+		return false;
+	}
+
+#ifdef NDEBUG
+	if( target->allocated )
+	{
+		memset( target->pixels, 0, target->size );
+	}
+#endif
+
+	if( layout != IMAGEIO_LAYOUT_NATIVE )
+	{
+		row = (uint8_t*) imageio_malloc( scanlineBytes );
+
+		if( !row )
+		{
+			goto failure;
+		}
+	}
+
+	for( y = 0; y < (uint32_t) info_header->biHeight; y++ )
+	{
+		uint8_t* dst = target->pixels + y * target->stride;
+
+		// read in pixels and skip padding...
+		if( !io_read( io, row ? row : dst, scanlineBytes ) ||
+		    (y + 1 < (uint32_t) info_header->biHeight && !io_skip( io, stride - scanlineBytes )) )
+		{
+			goto failure;
+		}
+
+		if( row )
+		{
+			layout_convert_bgr_row( row, bytesPerPixel, dst, layout, info_header->biWidth );
+		}
+		else if( bytesPerPixel > 1 )
+		{
+			cpu_kernels( )->swap_red_and_blue( dst, info_header->biWidth, bytesPerPixel );
+		}
+	}
+
+	imageio_free( row );
+	return true;
+
+failure:
+	imageio_free( row );
+	decode_target_release( target );
+	return false;
+}
+
+bool imageio_bitmap_save_header( imageio_io_t* io, uint32_t width, uint32_t height, uint32_t bit_depth )
+{
+	bitmap_file_header_t bmp_file_header;
+	bitmap_info_header_t info_header;
+	size_t stride = ((size_t) width * (bit_depth >> 3) + 3) & ~(size_t) 3;
+
+	/* biWidth and biHeight are signed */
+	if( width > INT32_MAX || height > INT32_MAX )
+	{
+		return false;
+	}
+
+	/* Define the bmp_file_header */
+	bmp_file_header.bfSize = sizeof(bitmap_file_header_t);
+	bmp_file_header.bfType = BITMAP_ID;
+	bmp_file_header.bfReserved1 = 0;
+	bmp_file_header.bfReserved2 = 0;
+	bmp_file_header.bfOffBits = sizeof(bitmap_file_header_t) + sizeof(bitmap_info_header_t);
+	/* Define the info_header */
+	info_header.biSize = sizeof(bitmap_info_header_t);
+	info_header.biPlanes = 1;
+	info_header.biBitCount = bit_depth;
+	info_header.biCompression = BI_RGB;		/* No compression */
+	info_header.biSizeImage = (uint64_t) stride * height <= UINT32_MAX ? (uint32_t) (stride * height) : 0;  /* 0 is allowed for BI_RGB */
+	info_header.biXPelsPerMeter = 0;
+	info_header.biYPelsPerMeter = 0;
+	info_header.biClrUsed = 0;
+	info_header.biClrImportant = 0;
+	info_header.biWidth = width;
+	info_header.biHeight = height;
+
+	return io_write( io, &bmp_file_header, sizeof(bitmap_file_header_t) ) &&
+	       io_write( io, &info_header, sizeof(bitmap_info_header_t) );
+}
+
+/* Copies an RGB(A) row into a BMP/TGA scanline as BGR(A); gray is copied. */
+static __inline void scanline_from_rgb( uint8_t* scanline, const uint8_t* row, uint32_t width, uint32_t bytes_per_pixel )
+{
+	memcpy( scanline, row, (size_t) width * bytes_per_pixel );
+
+	if( bytes_per_pixel >= 3 )
+	{
+		cpu_kernels( )->swap_red_and_blue( scanline, width, bytes_per_pixel );
+	}
+}
+
+/*
+ * Writes the rows of a BMP or TGA, stride bytes each, through one scanline
+ * buffer whose padding is zeroed once. Each row goes out in a single write
+ * and the caller's pixels are left as they were. Gray rows without padding
+ * need no copy and are written straight from the image.
+ */
+static bool save_bgr_rows( imageio_io_t* io, uint32_t width, uint32_t height, uint32_t bytes_per_pixel, size_t pitch, const uint8_t* pixels, size_t stride )
+{
+	const size_t row_size = (size_t) width * bytes_per_pixel;
+	uint8_t* scanline = NULL;
+	bool result = true;
+	uint32_t y;
+
+	if( bytes_per_pixel < 3 && stride == row_size )
+	{
+		for( y = 0; result && y < height; y++ )
+		{
+			result = io_write( io, pixels + y * pitch, row_size );
+		}
+
+		return result;
+	}
+
+	scanline = (uint8_t*) imageio_calloc( 1, stride ? stride : 1 );
+
+	if( !scanline )
+	{
+		return false;
+	}
+
+	for( y = 0; result && y < height; y++ )
+	{
+		scanline_from_rgb( scanline, pixels + y * pitch, width, bytes_per_pixel );
+		result = io_write( io, scanline, stride );
+	}
+
+	imageio_free( scanline );
+	return result;
+}
+
+bool imageio_bitmap_save( imageio_io_t* io, uint32_t width, uint32_t height, uint32_t bit_depth, size_t pitch, const uint8_t* imageData )
+{
+	uint32_t bytesPerPixel = bit_depth >> 3;
+	size_t stride = ((size_t) width * bytesPerPixel + 3) & ~(size_t) 3;
+
+	return imageio_bitmap_save_header( io, width, height, bit_depth ) &&
+	       save_bgr_rows( io, width, height, bytesPerPixel, pitch, imageData, stride );
+}
+
+bool imageio_targa_load_header( imageio_io_t* io, targa_file_header_t* p_file_header )
+{
+	if( !io_read( io, p_file_header, sizeof(targa_file_header_t) ) )
+	{
+		return false;
+	}
+
+	/* only uncompressed RGB and black and white images are handled */
+	return p_file_header->imageTypeCode == 2 || p_file_header->imageTypeCode == 3;
+}
+
+bool imageio_targa_load( imageio_io_t* io, targa_file_header_t* p_file_header, imageio_layout_t layout, decode_target_t* target )
+{
+	uint32_t colorMode;		/* 4 for RGBA or 3 for RGB */
+	size_t scanlineBytes = 0;
+	size_t dstScanlineBytes = 0;
+	uint32_t y;
+	uint8_t* row = NULL;
+
+	if( !imageio_targa_load_header( io, p_file_header ) )
+	{
+		return false;
+	}
+
+	/* colorMode-> 3 = BGR, 4 = BGRA */
+	colorMode = p_file_header->bitCount >> 3; // bytes per pixel
+
+	if( !layout_supported( layout, colorMode ) )
+	{
+		return false;
+	}
+
+	scanlineBytes    = (size_t) p_file_header->width * colorMode;
+	dstScanlineBytes = (size_t) p_file_header->width * layout_channels( layout, colorMode );
+
+	/* check if the buffer is too small or allocation failed... */
+	if( !decode_target_prepare( target, p_file_header->height, dstScanlineBytes ) )
+	{
+		return false;
+	}
+
+	if( layout == IMAGEIO_LAYOUT_NATIVE && target->stride == scanlineBytes )
+	{
+		if( !io_read( io, target->pixels, scanlineBytes * p_file_header->height ) )
+		{
+			decode_target_release( target );
+			return false;
+		}
+
+		/* indexed color mode not handled!!! */
+		if( colorMode > 1 )
+		{
+			convertBGRtoRGB( p_file_header->width, p_file_header->height, colorMode, target->pixels );
+		}
+		return true;
+	}
+
+	if( layout != IMAGEIO_LAYOUT_NATIVE )
+	{
+		row = (uint8_t*) imageio_malloc( scanlineBytes );
+
+		if( !row )
+		{
+			decode_target_release( target );
+			return false;
+		}
+	}
+
+	for( y = 0; y < p_file_header->height; y++ )
+	{
+		uint8_t* dst = target->pixels + y * target->stride;
+
+		if( !io_read( io, row ? row : dst, scanlineBytes ) )
+		{
+			break;
+		}
+
+		if( row )
+		{
+			layout_convert_bgr_row( row, colorMode, dst, layout, p_file_header->width );
+		}
+		else if( colorMode > 1 )
+		{
+			cpu_kernels( )->swap_red_and_blue( dst, p_file_header->width, colorMode );
+		}
+	}
+
+	imageio_free( row );
+
+	if( y < p_file_header->height )
+	{
+		decode_target_release( target );
+		return false;
+	}
+
+	return true;
+}
+
+bool imageio_targa_save_header( imageio_io_t* io, targa_file_header_t* p_file_header )
+{
+	uint32_t colorMode = p_file_header->bitCount >> 3; /* 4 for RGBA or 3 for RGB */
+
+	p_file_header->imageIDLength     = 0;
+	p_file_header->imageTypeCode     = 2;
+	p_file_header->colorMapOrigin    = 0;
 	p_file_header->colorMapLength    = 0;
 	p_file_header->colorMapEntrySize = 0;
 	p_file_header->colorMapType      = 0;
@@ -533,1006 +2121,4559 @@ bool imageio_targa_save( const char* filename, targa_file_header_t* p_file_heade
 	p_file_header->imageYOrigin      = 0;
 	p_file_header->imageDescriptor   = colorMode == 4 ? 0x08 : 0x00;
 
-	assert( p_file_header->imageTypeCode == 0x2 || p_file_header->imageTypeCode == 0x3 ); // must be 2 or 3
+	assert( p_file_header->imageTypeCode == 0x2 || p_file_header->imageTypeCode == 0x3 ); // must be 2 or 3
+
+	return io_write( io, p_file_header, sizeof(targa_file_header_t) );
+}
+
+bool imageio_targa_save( imageio_io_t* io, targa_file_header_t* p_file_header, size_t pitch, const uint8_t* bitmap )
+{
+	uint32_t colorMode = p_file_header->bitCount >> 3; /* 4 for RGBA or 3 for RGB */
+
+	/* Targa rows aren't padded */
+	return imageio_targa_save_header( io, p_file_header ) &&
+	       save_bgr_rows( io, p_file_header->width, p_file_header->height, colorMode, pitch, bitmap, (size_t) p_file_header->width * colorMode );
+}
+
+bool imageio_pvr_load( imageio_io_t* io, pvr_header_t* p_header, decode_target_t* target )
+{
+	/* Read in pvr header */
+	if( !io_read( io, p_header, sizeof(pvr_header_t) ) )
+	{
+		return false;
+	}
+
+	/* Jump to start of pixel data */
+	if( p_header->header_length < sizeof(pvr_header_t) ||
+	    !io_skip( io, p_header->header_length - sizeof(pvr_header_t) ) )
+	{
+		return false;
+	}
+
+	/* the pixel data is copied as one block */
+	target->stride    = 0;
+	target->alignment = 0;
+	if( !decode_target_prepare( target, 1, p_header->data_length ) )
+	{
+		return false;
+	}
+
+	if( !io_read( io, target->pixels, p_header->data_length ) )
+	{
+		decode_target_release( target );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ *  Raw images. Every level's rows are padded to RAW_ALIGNMENT, so where a
+ *  level starts follows from the header alone: level n + 1 is half the size
+ *  of level n (but at least 1 pixel) and comes right after it.
+ */
+static const uint8_t raw_padding[ RAW_ALIGNMENT ] = { 0 };
+
+/* The size, stride and file offset of a level; false if they don't fit. */
+static bool raw_level_geometry( const raw_header_t* header, uint32_t level, uint32_t* width, uint32_t* height, size_t* stride, size_t* offset )
+{
+	const uint32_t pixel_size = header->bit_depth >> 3;
+	uint32_t w = header->width;
+	uint32_t h = header->height;
+	size_t o = header->header_size;
+	size_t s, size;
+	uint32_t i;
+
+	for( i = 0; ; i++ )
+	{
+		if( w > (SIZE_MAX - RAW_ALIGNMENT) / pixel_size )
+		{
+			return false;
+		}
+
+		s = align_up( (size_t) w * pixel_size, RAW_ALIGNMENT );
+
+		if( i == level )
+		{
+			break;
+		}
+
+		if( !image_bytes( s, h, &size ) || size > SIZE_MAX - o )
+		{
+			return false;
+		}
+
+		o += size;
+		w  = w > 1 ? w >> 1 : 1;
+		h  = h > 1 ? h >> 1 : 1;
+	}
+
+	*width  = w;
+	*height = h;
+	*stride = s;
+	*offset = o;
+	return true;
+}
+
+/* crc32 takes 32-bit lengths. */
+static uLong raw_checksum( uLong crc, const uint8_t* data, size_t size )
+{
+	while( size > 0 )
+	{
+		uInt length = size > 0x40000000 ? 0x40000000 : (uInt) size;
+		crc   = crc32( crc, data, length );
+		data += length;
+		size -= length;
+	}
+
+	return crc;
+}
+
+static uLong raw_level_checksum( const uint8_t* pixels, uint32_t height, size_t stride, size_t row_size )
+{
+	uLong crc = crc32( 0L, Z_NULL, 0 );
+	uint32_t y;
+
+	for( y = 0; y < height; y++ )
+	{
+		crc = raw_checksum( crc, pixels + (size_t) y * stride, row_size );
+	}
+
+	return crc;
+}
+
+bool imageio_raw_load_header( imageio_io_t* io, raw_header_t* header )
+{
+	uint32_t width, height;
+	size_t stride, end;
+
+	if( !io_read( io, header, sizeof(raw_header_t) ) ||
+	    memcmp( header->magic, RAW_MAGIC, 4 ) != 0 ||
+	    header->version != RAW_VERSION ||
+	    header->header_size < sizeof(raw_header_t) ||
+	    header->header_size % RAW_ALIGNMENT != 0 ||
+	    header->width == 0 || header->height == 0 ||
+	    header->bit_depth == 0 || header->bit_depth % 8 != 0 || header->channels != header->bit_depth >> 3 ||
+	    header->layout > IMAGEIO_LAYOUT_BGR8 ||
+	    (header->layout != IMAGEIO_LAYOUT_NATIVE && layout_channels( header->layout, 0 ) != header->channels) ||
+	    header->levels == 0 || header->levels > RAW_MAX_LEVELS )
+	{
+		return false;
+	}
+
+	/* the levels have to add up to what the header says */
+	if( !raw_level_geometry( header, header->levels, &width, &height, &stride, &end ) ||
+	    end - header->header_size != header->data_size )
+	{
+		return false;
+	}
+
+	return io_skip( io, header->header_size - sizeof(raw_header_t) );
+}
+
+bool imageio_raw_load( imageio_io_t* io, raw_header_t* header, imageio_layout_t layout, decode_target_t* target )
+{
+	uint32_t width, height, y;
+	size_t stride, offset, row_size;
+	uLong crc = crc32( 0L, Z_NULL, 0 );
+	uint8_t* row;
+
+	/* the pixels are handed over as stored */
+	if( !imageio_raw_load_header( io, header ) ||
+	    (layout != IMAGEIO_LAYOUT_NATIVE && layout != header->layout) )
+	{
+		return false;
+	}
+
+	raw_level_geometry( header, 0, &width, &height, &stride, &offset );
+	row_size = (size_t) width * (header->bit_depth >> 3);
+
+	if( !decode_target_prepare( target, height, row_size ) )
+	{
+		return false;
+	}
+
+	for( y = 0; y < height; y++ )
+	{
+		row = target->pixels + (size_t) y * target->stride;
+
+		if( !io_read( io, row, row_size ) ||
+		    (y + 1 < height && !io_skip( io, stride - row_size )) )
+		{
+			goto failure;
+		}
+
+		crc = raw_checksum( crc, row, row_size );
+	}
+
+	if( (header->flags & RAW_FLAG_CHECKSUM) && crc != header->checksums[ 0 ] )
+	{
+		goto failure;
+	}
+
+	return true;
+
+failure:
+	decode_target_release( target );
+	return false;
+}
+
+/* Halves a level of 8-bit channels with a 2x2 box. */
+static void raw_downsample( const uint8_t* src, size_t src_stride, uint32_t src_width, uint32_t src_height,
+                            uint8_t* dst, size_t dst_stride, uint32_t dst_width, uint32_t dst_height, uint32_t channels )
+{
+	uint32_t x, y, c;
+
+	for( y = 0; y < dst_height; y++ )
+	{
+		const uint8_t* row0 = src + (size_t) (2 * y) * src_stride;
+		const uint8_t* row1 = src + (size_t) (2 * y + 1 < src_height ? 2 * y + 1 : src_height - 1) * src_stride;
+		uint8_t* out        = dst + (size_t) y * dst_stride;
+
+		for( x = 0; x < dst_width; x++ )
+		{
+			size_t x0 = (size_t) (2 * x) * channels;
+			size_t x1 = (size_t) (2 * x + 1 < src_width ? 2 * x + 1 : src_width - 1) * channels;
+
+			for( c = 0; c < channels; c++ )
+			{
+				*out++ = (uint8_t) ((row0[ x0 + c ] + row0[ x1 + c ] + row1[ x0 + c ] + row1[ x1 + c ] + 2) >> 2);
+			}
+		}
+	}
+}
+
+bool imageio_raw_save( imageio_io_t* io, const image_t* img, const imageio_raw_options_t* options )
+{
+	const imageio_raw_options_t defaults = { IMAGEIO_LAYOUT_NATIVE, 1, true };
+	uint8_t* levels[ RAW_MAX_LEVELS ] = { NULL };
+	const uint8_t* src;
+	raw_header_t header;
+	uint32_t width[ RAW_MAX_LEVELS ], height[ RAW_MAX_LEVELS ], end_width, end_height;
+	size_t stride[ RAW_MAX_LEVELS ], src_stride, end_stride, offset, size, row_size;
+	uint32_t level, y, count;
+	bool result = false;
+
+	if( !options )
+	{
+		options = &defaults;
+	}
+
+	/* whatever is saved has to load again */
+	if( !img->pixels || img->width == 0 || img->height == 0 ||
+	    img->bit_depth == 0 || img->bit_depth % 8 != 0 || img->channels != img->bit_depth >> 3 ||
+	    options->layout > IMAGEIO_LAYOUT_BGR8 ||
+	    (options->layout != IMAGEIO_LAYOUT_NATIVE && layout_channels( options->layout, 0 ) != img->channels) )
+	{
+		return false;
+	}
+
+	count = options->levels > 1 ? options->levels : 1;
+
+	memset( &header, 0, sizeof(raw_header_t) );
+	memcpy( header.magic, RAW_MAGIC, 4 );
+	header.version     = RAW_VERSION;
+	header.header_size = (uint16_t) align_up( sizeof(raw_header_t), RAW_ALIGNMENT );
+	header.width       = img->width;
+	header.height      = img->height;
+	header.bit_depth   = img->bit_depth;
+	header.channels    = img->channels;
+	header.layout      = (uint8_t) options->layout;
+	header.flags       = options->checksum ? RAW_FLAG_CHECKSUM : 0;
+
+	if( options->layout == IMAGEIO_LAYOUT_NATIVE )
+	{
+		header.layout = img->channels == 4 ? IMAGEIO_LAYOUT_RGBA8 :
+		                img->channels == 3 ? IMAGEIO_LAYOUT_RGB8 :
+		                img->channels == 1 ? IMAGEIO_LAYOUT_GRAY8 : IMAGEIO_LAYOUT_NATIVE;
+	}
+
+	/* stop once a level is 1x1 */
+	for( level = 0; level < count && level < RAW_MAX_LEVELS; level++ )
+	{
+		header.levels = (uint8_t) (level + 1);
+
+		if( !raw_level_geometry( &header, level, &width[ level ], &height[ level ], &stride[ level ], &offset ) )
+		{
+			return false;
+		}
+
+		if( width[ level ] == 1 && height[ level ] == 1 )
+		{
+			break;
+		}
+	}
+
+	if( !raw_level_geometry( &header, header.levels, &end_width, &end_height, &end_stride, &offset ) )
+	{
+		return false;
+	}
+
+	header.data_size = offset - header.header_size;
+	row_size         = (size_t) img->width * (img->bit_depth >> 3);
+
+	/* the mips are built (and everything is summed) before the header goes out */
+	for( level = 1; level < header.levels; level++ )
+	{
+		src        = level == 1 ? img->pixels : levels[ level - 1 ];
+		src_stride = level == 1 ? imageio_image_stride( img ) : stride[ level - 1 ];
+
+		if( !image_bytes( stride[ level ], height[ level ], &size ) ||
+		    (levels[ level ] = image_alloc( size, RAW_ALIGNMENT )) == NULL )
+		{
+			goto failure;
+		}
+
+		raw_downsample( src, src_stride, width[ level - 1 ], height[ level - 1 ],
+		                levels[ level ], stride[ level ], width[ level ], height[ level ], img->channels );
+	}
+
+	if( options->checksum )
+	{
+		header.checksums[ 0 ] = (uint32_t) raw_level_checksum( img->pixels, img->height, imageio_image_stride( img ), row_size );
+
+		for( level = 1; level < header.levels; level++ )
+		{
+			header.checksums[ level ] = (uint32_t) raw_level_checksum( levels[ level ], height[ level ], stride[ level ], (size_t) width[ level ] * img->channels );
+		}
+	}
+
+	if( !io_write( io, &header, sizeof(raw_header_t) ) ||
+	    !io_write( io, raw_padding, header.header_size - sizeof(raw_header_t) ) )
+	{
+		goto failure;
+	}
+
+	for( level = 0; level < header.levels; level++ )
+	{
+		src        = level == 0 ? img->pixels : levels[ level ];
+		src_stride = level == 0 ? imageio_image_stride( img ) : stride[ level ];
+		size       = (size_t) width[ level ] * (img->bit_depth >> 3);
+
+		for( y = 0; y < height[ level ]; y++ )
+		{
+			if( !io_write( io, src + (size_t) y * src_stride, size ) ||
+			    !io_write( io, raw_padding, stride[ level ] - size ) )
+			{
+				goto failure;
+			}
+		}
+	}
+
+	result = true;
+
+failure:
+	for( level = 1; level < RAW_MAX_LEVELS; level++ )
+	{
+		image_free( levels[ level ] );
+	}
+
+	return result;
+}
+
+bool imageio_image_save_raw( const image_t* img, const char* filename, const imageio_raw_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "wb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_image_save_raw_io( img, &io, options );
+		result = fclose( file ) == 0 && result;
+	}
+
+	return result;
+}
+
+bool imageio_image_save_raw_io( const image_t* img, imageio_io_t* io, const imageio_raw_options_t* options )
+{
+	return imageio_raw_save( io, img, options );
+}
+
+static void png_io_read( png_structp png_ptr, png_bytep data, png_size_t length )
+{
+	imageio_io_t* io = (imageio_io_t*) png_get_io_ptr( png_ptr );
+
+	if( !io_read( io, data, length ) )
+	{
+		png_error( png_ptr, "read error" );
+	}
+}
+
+static void png_io_write( png_structp png_ptr, png_bytep data, png_size_t length )
+{
+	imageio_io_t* io = (imageio_io_t*) png_get_io_ptr( png_ptr );
+
+	if( !io_write( io, data, length ) )
+	{
+		png_error( png_ptr, "write error" );
+	}
+}
+
+static void png_io_flush( png_structp png_ptr )
+{
+	(void) png_ptr;
+}
+
+/* Codecs that aren't given an arena allocate through the library's allocator. */
+static png_voidp png_heap_malloc( png_structp png_ptr, png_alloc_size_t size )
+{
+	(void) png_ptr;
+	return imageio_malloc( size );
+}
+
+static void png_heap_free( png_structp png_ptr, png_voidp ptr )
+{
+	(void) png_ptr;
+	imageio_free( ptr );
+}
+
+#define PNG_ARENA_ALIGNMENT  16
+
+static void* png_arena_alloc( png_arena_t* arena, size_t size )
+{
+	uint8_t* extra;
+
+	if( size > SIZE_MAX - 2 * PNG_ARENA_ALIGNMENT )
+	{
+		return NULL;
+	}
+
+	size = align_up( size, PNG_ARENA_ALIGNMENT );
+
+	if( size <= arena->size - arena->used )
+	{
+		arena->used += size;
+		return arena->block + arena->used - size;
+	}
+
+	/* doesn't fit this time; the block grows to fit at the next reset */
+	extra = (uint8_t*) imageio_malloc( PNG_ARENA_ALIGNMENT + size );
+
+	if( !extra )
+	{
+		return NULL;
+	}
+
+	*(void**) extra  = arena->extra;
+	arena->extra     = extra;
+	arena->overflow += size;
+	return extra + PNG_ARENA_ALIGNMENT;
+}
+
+static png_voidp png_arena_malloc( png_structp png_ptr, png_alloc_size_t size )
+{
+	return png_arena_alloc( (png_arena_t*) png_get_mem_ptr( png_ptr ), size );
+}
+
+/* Everything is given back by png_arena_reset. */
+static void png_arena_free( png_structp png_ptr, png_voidp ptr )
+{
+	(void) png_ptr;
+	(void) ptr;
+}
+
+static void png_arena_reset( png_arena_t* arena )
+{
+	size_t needed = arena->used + arena->overflow;
+
+	while( arena->extra )
+	{
+		void* next = *(void**) arena->extra;
+		imageio_free( arena->extra );
+		arena->extra = next;
+	}
+
+	if( needed > arena->size )
+	{
+		imageio_free( arena->block );
+		arena->block = (uint8_t*) imageio_malloc( needed );
+		arena->size  = arena->block ? needed : 0;
+	}
+
+	arena->used     = 0;
+	arena->overflow = 0;
+}
+
+static void png_arena_release( png_arena_t* arena )
+{
+	/* nothing is needed next time */
+	arena->used     = 0;
+	arena->overflow = 0;
+	png_arena_reset( arena );
+	imageio_free( arena->block );
+	memset( arena, 0, sizeof(png_arena_t) );
+}
+
+/*
+ * The layout a PNG is loaded as. Palettes are expanded to RGB; grayscale
+ * is not supported.
+ */
+static bool png_layout( png_byte color_type, png_byte bits_per_channel, uint8_t* bit_depth, uint8_t* channels )
+{
+	switch( color_type )
+	{
+		case PNG_COLOR_TYPE_PALETTE:
+		case PNG_COLOR_TYPE_RGB:
+			*bit_depth = 3 * bits_per_channel;
+			*channels  = 3;
+			return true;
+		case PNG_COLOR_TYPE_RGB_ALPHA:
+			*bit_depth = 4 * bits_per_channel;
+			*channels  = 4;
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool imageio_png_probe( imageio_io_t* io, imageio_info_t* info )
+{
+	png_structp png_ptr;
+	png_infop info_ptr;
+	uint8_t header[8];
+	bool result;
+
+	if( !io_read( io, header, sizeof(header) ) || png_sig_cmp( header, 0, sizeof(header) ) )
+	{
+		return false;
+	}
+
+	png_ptr = png_create_read_struct_2( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_heap_malloc, png_heap_free );
+
+	if( !png_ptr )
+	{
+		return false;
+	}
+
+	info_ptr = png_create_info_struct( png_ptr );
+	if( !info_ptr )
+	{
+		png_destroy_read_struct( &png_ptr, (png_infopp) NULL, (png_infopp) NULL );
+		return false;
+	}
+
+	if( setjmp(png_jmpbuf(png_ptr)) )
+	{
+		png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+		return false;
+	}
+
+	png_set_read_fn( png_ptr, io, png_io_read );
+	png_set_sig_bytes( png_ptr, sizeof(header) );
+	/* libpng stops at 1000000 pixels by default */
+	png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+	/* reads the chunks up to the first IDAT and stops */
+	png_read_info( png_ptr, info_ptr );
+
+	info->width  = png_get_image_width( png_ptr, info_ptr );
+	info->height = png_get_image_height( png_ptr, info_ptr );
+	result = png_layout( png_get_color_type( png_ptr, info_ptr ), png_get_bit_depth( png_ptr, info_ptr ), &info->bit_depth, &info->channels );
+
+	png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+	return result;
+}
+
+/*
+ * Sets up libpng's transforms so that rows come out of the decoder
+ * already in the requested 8-bit layout.
+ */
+static void png_set_layout( png_structp png_ptr, png_infop info_ptr, imageio_layout_t layout )
+{
+	png_byte color_type = png_get_color_type( png_ptr, info_ptr );
+	bool is_gray = (color_type & PNG_COLOR_MASK_COLOR) == 0;
+	bool has_alpha = (color_type & PNG_COLOR_MASK_ALPHA) != 0;
+	bool wants_alpha = layout == IMAGEIO_LAYOUT_RGBA8 || layout == IMAGEIO_LAYOUT_BGRA8;
+
+	png_set_strip_16( png_ptr );
+
+	if( color_type == PNG_COLOR_TYPE_PALETTE )
+	{
+		png_set_palette_to_rgb( png_ptr );
+	}
+	else if( is_gray )
+	{
+		png_set_expand_gray_1_2_4_to_8( png_ptr );
+	}
+
+	if( png_get_valid( png_ptr, info_ptr, PNG_INFO_tRNS ) )
+	{
+		if( wants_alpha )
+		{
+			png_set_tRNS_to_alpha( png_ptr );
+			has_alpha = true;
+		}
+	}
+
+	if( wants_alpha )
+	{
+		if( is_gray )
+		{
+			png_set_gray_to_rgb( png_ptr );
+		}
+		if( !has_alpha )
+		{
+			png_set_filler( png_ptr, 0xff, PNG_FILLER_AFTER );
+		}
+		if( layout == IMAGEIO_LAYOUT_BGRA8 )
+		{
+			png_set_bgr( png_ptr );
+		}
+	}
+	else
+	{
+		if( has_alpha )
+		{
+			png_set_strip_alpha( png_ptr );
+		}
+		if( (layout == IMAGEIO_LAYOUT_RGB8 || layout == IMAGEIO_LAYOUT_BGR8) && is_gray )
+		{
+			png_set_gray_to_rgb( png_ptr );
+		}
+		if( layout == IMAGEIO_LAYOUT_BGR8 )
+		{
+			png_set_bgr( png_ptr );
+		}
+		if( layout == IMAGEIO_LAYOUT_GRAY8 && !is_gray )
+		{
+			/* 21265 and 71515 (in 1/100000) become the 6968 and 23434 (in
+			 * 1/32768) that layout_luma() uses. The gamma is pinned to 1.0
+			 * so libpng takes the plain weighted sum, as BMP/TGA do,
+			 * instead of converting through linear light.
+			 */
+			png_set_rgb_to_gray_fixed( png_ptr, PNG_ERROR_ACTION_NONE, 21265, 71515 );
+			png_set_gamma_fixed( png_ptr, PNG_FP_1, PNG_FP_1 );
+		}
+	}
+}
+
+bool imageio_png_load( imageio_io_t* io, image_t* image, imageio_layout_t layout, decode_target_t* target, png_arena_t* arena )
+{
+	png_structp png_ptr;
+	png_infop info_ptr;
+	uint8_t header[8];
+
+	/* test if a png */
+	if( !io_read( io, header, sizeof(header) ) || png_sig_cmp( header, 0, sizeof(header) ) )
+	{
+		/* not a png file */
+		return false;
+	}
+
+	/* initialize stuff */
+	png_ptr = png_create_read_struct_2( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+	                                    arena, arena ? png_arena_malloc : png_heap_malloc, arena ? png_arena_free : png_heap_free );
+
+	if( !png_ptr )
+	{
+		return false;
+	}
+
+	info_ptr = png_create_info_struct( png_ptr );
+	if( !info_ptr )
+	{
+        png_destroy_read_struct( &png_ptr, (png_infopp) NULL, (png_infopp) NULL );
+		return false;
+	}
+
+	if( setjmp(png_jmpbuf(png_ptr)) )
+	{
+        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+		return false;
+	}
+
+	png_set_read_fn( png_ptr, io, png_io_read );
+	png_set_sig_bytes( png_ptr, sizeof(header) );
+	/* libpng stops at 1000000 pixels by default */
+	png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+	png_read_info( png_ptr, info_ptr );
+
+	//png_uint_32 width, height;
+	//int bits_per_channel, color_type, interlace_type;
+	//png_get_IHDR( png_ptr, info_ptr, &width, &height, &bits_per_channel, &color_type, &interlace_type, NULL, NULL );
+
+	//png_byte interlace_type   = png_get_interlace_type( png_ptr, info_ptr );
+	png_byte color_type       = png_get_color_type( png_ptr, info_ptr );
+	png_byte bits_per_channel = png_get_bit_depth( png_ptr, info_ptr );
+
+	image->width  = png_get_image_width( png_ptr, info_ptr );
+	image->height = png_get_image_height( png_ptr, info_ptr );
+
+	if( layout != IMAGEIO_LAYOUT_NATIVE )
+	{
+		if( !layout_supported( layout, 1 ) )
+		{
+			png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+			return false;
+		}
+
+		png_set_layout( png_ptr, info_ptr, layout );
+		image->channels  = layout_channels( layout, 0 );
+		image->bit_depth = image->channels << 3;
+	}
+	else if( !png_layout( color_type, bits_per_channel, &image->bit_depth, &image->channels ) )
+	{
+		png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+		return false;
+	}
+	else if( color_type == PNG_COLOR_TYPE_PALETTE )
+	{
+		/* expanded to RGB */
+		png_set_palette_to_rgb( png_ptr );
+	}
+
+	#if 0
+	int screen_gamma = PNG_DEFAULT_sRGB;  /* A good guess for a PC monitor */
+	int intent;
+
+	if( png_get_sRGB( png_ptr, info_ptr, &intent ) != 0 )
+	{
+		png_set_gamma( png_ptr, screen_gamma, PNG_DEFAULT_sRGB );
+	}
+	else
+	{
+		double image_gamma;
+		if( png_get_gAMA( png_ptr, info_ptr, &image_gamma ) != 0 )
+		{
+			png_set_gamma( png_ptr, screen_gamma, image_gamma );
+		}
+		else
+		{
+			png_set_gamma( png_ptr, screen_gamma, 0.45455 );
+		}
+	}
+	#endif
+	#if 0
+	if( (color_type & PNG_COLOR_MASK_COLOR) != 0 )
+	{
+		/* Flip the RGB pixels to BGR (or RGBA to BGRA) */
+		png_set_bgr(png_ptr);
+	}
+	#endif
+
+	/*number_of_passes = png_set_interlace_handling( png_ptr );*/
+	png_read_update_info( png_ptr, info_ptr);
+
+    png_size_t row_bytes = png_get_rowbytes( png_ptr, info_ptr );
+
+	if( layout != IMAGEIO_LAYOUT_NATIVE && row_bytes != (png_size_t) image->width * image->channels )
+	{
+		png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+		return false;
+	}
+
+	/* check if the buffer is too small or allocation failed... */
+	if( !decode_target_prepare( target, image->height, row_bytes ) )
+	{
+        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+        return false;
+	}
+
+	image->pixels = target->pixels;
+
+    /* row_pointers is for pointing to image->pixels for reading the png with libpng */
+    png_bytep* row_pointers = png_malloc_warn( png_ptr, (png_alloc_size_t) image->height * sizeof(png_bytep) );
+
+    if( !row_pointers )
+    {
+        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+        decode_target_release( target );
+        return false;
+    }
+
+	/* set the individual row_pointers to point at the correct offsets of image->pixels */
+    png_uint_32 i;
+    for( i = 0; i < image->height; i++ )
+    {
+        row_pointers[ i ] = image->pixels + i * target->stride;
+    }
+
+	if( setjmp(png_jmpbuf(png_ptr)) )
+	{
+		png_free( png_ptr, row_pointers );
+        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+        decode_target_release( target );
+		return false;
+	}
+
+	png_read_image( png_ptr, row_pointers );
+
+	png_free( png_ptr, row_pointers );
+	row_pointers = NULL;
+	png_read_end( png_ptr, info_ptr );
+    png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
+
+	return true;
+}
+
+/*
+ * Resolves the save options into settings: fields left at 0 fall back to
+ * the preset. The DEFAULT preset leaves everything at 0, which keeps
+ * libpng's own choices.
+ */
+static void png_save_settings( const imageio_save_options_t* options, imageio_save_options_t* settings )
+{
+	static const imageio_save_options_t presets[] = {
+		{ IMAGEIO_PNG_DEFAULT,  0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PRESET,   0 },
+		{ IMAGEIO_PNG_FASTEST,  1, IMAGEIO_PNG_STRATEGY_RLE,    IMAGEIO_PNG_FILTER_SUB,      64 * 1024 },
+		{ IMAGEIO_PNG_BALANCED, 4, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_ADAPTIVE, 64 * 1024 },
+		{ IMAGEIO_PNG_SMALLEST, 9, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_ADAPTIVE, 64 * 1024 },
+	};
+
+	if( !options || (uint32_t) options->png_preset > IMAGEIO_PNG_SMALLEST )
+	{
+		*settings = presets[ IMAGEIO_PNG_DEFAULT ];
+		return;
+	}
+
+	*settings = presets[ options->png_preset ];
+
+	if( options->png_level != 0 )
+	{
+		settings->png_level = options->png_level;
+	}
+
+	if( options->png_strategy != IMAGEIO_PNG_STRATEGY_PRESET )
+	{
+		settings->png_strategy = options->png_strategy;
+	}
+
+	if( options->png_filter != IMAGEIO_PNG_FILTER_PRESET )
+	{
+		settings->png_filter = options->png_filter;
+	}
+
+	if( options->png_buffer_size != 0 )
+	{
+		settings->png_buffer_size = options->png_buffer_size;
+	}
+}
+
+/* zlib's level for the settings. */
+static int png_settings_level( const imageio_save_options_t* settings )
+{
+	if( settings->png_level == IMAGEIO_PNG_STORED )
+	{
+		return Z_NO_COMPRESSION;
+	}
+
+	return settings->png_level >= 1 && settings->png_level <= 9 ? settings->png_level : Z_DEFAULT_COMPRESSION;
+}
+
+/* zlib's strategy for the settings; libpng picks Z_FILTERED for filtered rows. */
+static int png_settings_strategy( const imageio_save_options_t* settings )
+{
+	static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE };
+
+	if( settings->png_strategy > IMAGEIO_PNG_STRATEGY_PRESET && settings->png_strategy <= IMAGEIO_PNG_STRATEGY_RLE )
+	{
+		return strategies[ settings->png_strategy ];
+	}
+
+	return settings->png_filter == IMAGEIO_PNG_FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+}
+
+static void png_set_save_options( png_structp png_ptr, const imageio_save_options_t* settings )
+{
+	static const int filters[] = { PNG_ALL_FILTERS, PNG_ALL_FILTERS, PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH };
+
+	if( settings->png_level != 0 )
+	{
+		png_set_compression_level( png_ptr, png_settings_level( settings ) );
+	}
+
+	if( settings->png_strategy > IMAGEIO_PNG_STRATEGY_PRESET && settings->png_strategy <= IMAGEIO_PNG_STRATEGY_RLE )
+	{
+		png_set_compression_strategy( png_ptr, png_settings_strategy( settings ) );
+	}
+
+	if( settings->png_filter > IMAGEIO_PNG_FILTER_PRESET && settings->png_filter <= IMAGEIO_PNG_FILTER_PAETH )
+	{
+		png_set_filter( png_ptr, PNG_FILTER_TYPE_BASE, filters[ settings->png_filter ] );
+	}
+
+	if( settings->png_buffer_size > 0 )
+	{
+		png_set_compression_buffer_size( png_ptr, settings->png_buffer_size );
+	}
+}
+
+/*
+ *  Striped PNG encoding. A large image is cut into horizontal stripes of
+ *  about PNG_STRIPE_BYTES that are filtered and deflated on the thread pool,
+ *  each as a raw deflate stream of its own. Every stripe but the last ends
+ *  on a Z_FULL_FLUSH, so the stripes are byte aligned and can be joined
+ *  into one zlib stream; its adler32 is put together from the stripes'
+ *  with adler32_combine. As in pigz, a stripe's window is primed with the
+ *  last 32K of filtered rows before it, and the stripes depend only on the
+ *  image, so the file is the same whatever the thread count.
+ */
+#define PNG_STRIPE_BYTES       (1024 * 1024)  /* smaller stripes compress worse */
+#define PNG_STRIPE_WINDOW      32768          /* deflate's window */
+#define PNG_CHUNK_MAX_BYTES    (1 << 30)      /* chunk lengths must fit in 31 bits */
+
+typedef struct png_stripe {
+	uint8_t* data;      /* deflated rows */
+	size_t   size;
+	size_t   capacity;
+	uLong    adler;     /* of the filtered rows */
+	size_t   length;    /* bytes of filtered rows */
+	bool     failed;
+} png_stripe_t;
+
+typedef struct png_stripes_job {
+	const image_t* image;
+	size_t stride;
+	uint32_t bytes_per_pixel;
+	uint32_t rows_per_stripe;
+	uint32_t dictionary_rows;   /* rows before a stripe that fill the window */
+	int level;
+	int strategy;
+	imageio_png_filter_t filter; /* ADAPTIVE tries all five on each row */
+	const uint8_t* zeros;       /* the row above row 0 */
+	png_arena_t* arena;         /* zlib's state comes from here when given */
+	#ifndef _WIN32
+	pthread_mutex_t lock;       /* bands share the arena */
+	#endif
+	png_stripe_t* stripes;
+	uint32_t stripe_count;
+} png_stripes_job_t;
+
+static __inline uint8_t png_paeth( uint8_t a, uint8_t b, uint8_t c )
+{
+	int p  = (int) a + b - c;
+	int pa = abs( p - a );
+	int pb = abs( p - b );
+	int pc = abs( p - c );
+
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/* Writes the filter type byte and the filtered row to out. prev is the row above (zeros for row 0). */
+static void png_filter_row( uint32_t type, const uint8_t* row, const uint8_t* prev, size_t row_size, uint32_t bpp, uint8_t* out )
+{
+	size_t i;
+
+	*out++ = (uint8_t) type;
+
+	switch( type )
+	{
+		case PNG_FILTER_VALUE_SUB:
+			for( i = 0; i < row_size; i++ )
+			{
+				out[ i ] = (uint8_t) (row[ i ] - (i >= bpp ? row[ i - bpp ] : 0));
+			}
+			break;
+		case PNG_FILTER_VALUE_UP:
+			for( i = 0; i < row_size; i++ )
+			{
+				out[ i ] = (uint8_t) (row[ i ] - prev[ i ]);
+			}
+			break;
+		case PNG_FILTER_VALUE_AVG:
+			for( i = 0; i < row_size; i++ )
+			{
+				out[ i ] = (uint8_t) (row[ i ] - (((i >= bpp ? row[ i - bpp ] : 0) + prev[ i ]) >> 1));
+			}
+			break;
+		case PNG_FILTER_VALUE_PAETH:
+			for( i = 0; i < row_size; i++ )
+			{
+				out[ i ] = (uint8_t) (row[ i ] - png_paeth( i >= bpp ? row[ i - bpp ] : 0, prev[ i ], i >= bpp ? prev[ i - bpp ] : 0 ));
+			}
+			break;
+		default:
+			memcpy( out, row, row_size );
+			break;
+	}
+}
+
+/* libpng's heuristic: the smallest sum of the filtered bytes taken as signed. */
+static size_t png_filter_cost( const uint8_t* filtered, size_t row_size )
+{
+	size_t i, sum = 0;
+
+	for( i = 0; i < row_size; i++ )
+	{
+		sum += filtered[ i ] < 128 ? filtered[ i ] : 256 - filtered[ i ];
+	}
+
+	return sum;
+}
+
+/* With an arena, everything is given back when the encoder is done with the image. */
+static void* png_stripe_alloc( png_stripes_job_t* job, size_t size, bool zeroed )
+{
+	void* ptr;
+
+	if( !job->arena )
+	{
+		return zeroed ? imageio_calloc( 1, size ) : imageio_malloc( size );
+	}
+
+	#ifndef _WIN32
+	pthread_mutex_lock( &job->lock );
+	#endif
+	ptr = png_arena_alloc( job->arena, size );
+	#ifndef _WIN32
+	pthread_mutex_unlock( &job->lock );
+	#endif
+
+	if( ptr && zeroed )
+	{
+		memset( ptr, 0, size );
+	}
+
+	return ptr;
+}
+
+static void png_stripe_free( png_stripes_job_t* job, void* ptr )
+{
+	if( !job->arena )
+	{
+		imageio_free( ptr );
+	}
+}
+
+static voidpf png_stripe_zalloc( voidpf opaque, uInt items, uInt size )
+{
+	if( size > 0 && items > SIZE_MAX / size )
+	{
+		return NULL;
+	}
+
+	return png_stripe_alloc( (png_stripes_job_t*) opaque, (size_t) items * size, true );
+}
+
+static void png_stripe_zfree( voidpf opaque, voidpf ptr )
+{
+	png_stripe_free( (png_stripes_job_t*) opaque, ptr );
+}
+
+/* Moves the stripe's deflated bytes to a buffer of capacity bytes. */
+static bool png_stripe_grow( png_stripes_job_t* job, png_stripe_t* stripe, size_t capacity )
+{
+	uint8_t* grown = (uint8_t*) png_stripe_alloc( job, capacity, false );
+
+	if( !grown )
+	{
+		return false;
+	}
+
+	memcpy( grown, stripe->data, stripe->size );
+	png_stripe_free( job, stripe->data );
+	stripe->data     = grown;
+	stripe->capacity = capacity;
+	return true;
+}
+
+/* Deflates size bytes into the stripe, growing its buffer as needed. */
+
+static bool png_stripe_deflate( png_stripes_job_t* job, png_stripe_t* stripe, z_stream* strm, const uint8_t* data, size_t size, int flush )
+{
+	int ret;
+
+	do
+	{
+		uInt length   = size > 0x40000000 ? 0x40000000 : (uInt) size;
+		int  step     = length == size ? flush : Z_NO_FLUSH;
+
+		strm->next_in  = (Bytef*) data;
+		strm->avail_in = length;
+		data += length;
+		size -= length;
+
+		for( ;; )
+		{
+			if( strm->avail_out == 0 )
+			{
+				size_t grow = stripe->capacity < UINT_MAX ? stripe->capacity : UINT_MAX;
+
+				stripe->size = stripe->capacity;
+
+				if( !png_stripe_grow( job, stripe, stripe->capacity + grow ) )
+				{
+					return false;
+				}
+
+				strm->next_out  = stripe->data + stripe->size;
+				strm->avail_out = (uInt) grow;
+			}
+
+			ret = deflate( strm, step );
+
+			if( ret == Z_STREAM_ERROR )
+			{
+				return false;
+			}
+
+			if( step == Z_FINISH ? ret == Z_STREAM_END : (strm->avail_in == 0 && strm->avail_out > 0) )
+			{
+				break;
+			}
+		}
+	} while( size > 0 );
+
+	stripe->size = (size_t) (strm->next_out - stripe->data);
+	return true;
+}
+
+/* Filters row y into one of the two rows in lines and returns it. */
+static uint8_t* png_stripe_filter( const png_stripes_job_t* job, uint32_t y, uint8_t* lines )
+{
+	const size_t row_size = (size_t) job->image->width * job->bytes_per_pixel;
+	const uint8_t* row    = job->image->pixels + (size_t) y * job->stride;
+	const uint8_t* prev   = y > 0 ? row - job->stride : job->zeros;
+	uint8_t* best         = lines;
+	uint8_t* trial        = lines + row_size + 1;
+	uint32_t type;
+
+	if( job->filter == IMAGEIO_PNG_FILTER_ADAPTIVE )
+	{
+		size_t best_cost = SIZE_MAX;
+
+		for( type = PNG_FILTER_VALUE_NONE; type < PNG_FILTER_VALUE_LAST; type++ )
+		{
+			size_t cost;
+			png_filter_row( type, row, prev, row_size, job->bytes_per_pixel, trial );
+			cost = png_filter_cost( trial + 1, row_size );
+
+			if( cost < best_cost )
+			{
+				uint8_t* swap = best;
+				best      = trial;
+				trial     = swap;
+				best_cost = cost;
+			}
+		}
+	}
+	else
+	{
+		png_filter_row( job->filter - IMAGEIO_PNG_FILTER_NONE, row, prev, row_size, job->bytes_per_pixel, best );
+	}
+
+	return best;
+}
+
+/* The zlib header goes in the first two bytes of stripe 0; each stripe leaves room for it. */
+static bool png_stripe_encode( png_stripes_job_t* job, z_stream* strm, uint32_t index, uint8_t* lines, uint8_t* dictionary )
+{
+	png_stripe_t* stripe  = &job->stripes[ index ];
+	const image_t* image  = job->image;
+	const size_t row_size = (size_t) image->width * job->bytes_per_pixel;
+	const uint32_t first  = index * job->rows_per_stripe;
+	const uint32_t last   = first + job->rows_per_stripe < image->height ? first + job->rows_per_stripe : image->height;
+	uint32_t y;
+
+	stripe->adler  = adler32( 0L, Z_NULL, 0 );
+	stripe->length = (size_t) (last - first) * (row_size + 1);
+
+	if( deflateReset( strm ) != Z_OK )
+	{
+		return false;
+	}
+
+	if( first > 0 )
+	{
+		uint32_t rows = first < job->dictionary_rows ? first : job->dictionary_rows;
+		size_t length = (size_t) rows * (row_size + 1);
+		size_t skip   = length > PNG_STRIPE_WINDOW ? length - PNG_STRIPE_WINDOW : 0;
+
+		for( y = first - rows; y < first; y++ )
+		{
+			memcpy( dictionary + (size_t) (y - (first - rows)) * (row_size + 1), png_stripe_filter( job, y, lines ), row_size + 1 );
+		}
+
+		if( deflateSetDictionary( strm, dictionary + skip, (uInt) (length - skip) ) != Z_OK )
+		{
+			return false;
+		}
+	}
+
+	stripe->capacity = (size_t) deflateBound( strm, (uLong) (stripe->length < ULONG_MAX ? stripe->length : ULONG_MAX) ) + 64;
+	stripe->capacity = stripe->capacity < UINT_MAX ? stripe->capacity : UINT_MAX;
+	stripe->data     = (uint8_t*) png_stripe_alloc( job, stripe->capacity, false );
+
+	if( !stripe->data )
+	{
+		return false;
+	}
+
+	strm->next_out  = stripe->data + 2;
+	strm->avail_out = (uInt) (stripe->capacity - 2);
+
+	for( y = first; y < last; y++ )
+	{
+		uint8_t* best = png_stripe_filter( job, y, lines );
+
+		stripe->adler = adler32( stripe->adler, best, (uInt) (row_size + 1) );
+
+		if( !png_stripe_deflate( job, stripe, strm, best, row_size + 1,
+		                         y + 1 < last ? Z_NO_FLUSH : last == image->height ? Z_FINISH : Z_FULL_FLUSH ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Encodes stripes [first, last) with one deflate state. */
+static void png_stripe_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	png_stripes_job_t* job = (png_stripes_job_t*) context;
+	const size_t row_size  = (size_t) job->image->width * job->bytes_per_pixel;
+	uint8_t* lines         = (uint8_t*) png_stripe_alloc( job, 2 * (row_size + 1), false );
+	uint8_t* dictionary    = (uint8_t*) png_stripe_alloc( job, (size_t) job->dictionary_rows * (row_size + 1), false );
+	z_stream strm;
+	uint32_t index;
+
+	(void) band;
+
+	memset( &strm, 0, sizeof(strm) );
+	strm.zalloc = png_stripe_zalloc;
+	strm.zfree  = png_stripe_zfree;
+	strm.opaque = job;
+
+	if( !lines || !dictionary ||
+	    deflateInit2( &strm, job->level, Z_DEFLATED, -15, 8, job->strategy ) != Z_OK )
+	{
+		png_stripe_free( job, lines );
+		png_stripe_free( job, dictionary );
+		return;
+	}
+
+	for( index = first; index < last; index++ )
+	{
+		job->stripes[ index ].failed = !png_stripe_encode( job, &strm, index, lines, dictionary );
+	}
+
+	deflateEnd( &strm );
+	png_stripe_free( job, lines );
+	png_stripe_free( job, dictionary );
+}
+
+/* Writes a chunk's length, type, data and crc. */
+static bool png_write_chunk_io( imageio_io_t* io, const char* type, const uint8_t* data, size_t size )
+{
+	uint8_t header[ 8 ];
+	uint8_t crc[ 4 ];
+
+	png_save_uint_32( header, (png_uint_32) size );
+	memcpy( header + 4, type, 4 );
+	png_save_uint_32( crc, (png_uint_32) raw_checksum( crc32( crc32( 0L, Z_NULL, 0 ), header + 4, 4 ), data, size ) );
+
+	return io_write( io, header, sizeof(header) ) &&
+	       io_write( io, data, size ) &&
+	       io_write( io, crc, sizeof(crc) );
+}
+
+static bool png_save_striped( imageio_io_t* io, const image_t* image, const imageio_save_options_t* settings, png_arena_t* arena )
+{
+	static const uint8_t signature[ 8 ] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	png_stripes_job_t stripes_job;
+	png_stripes_job_t* job = &stripes_job;
+	const size_t chunk_size = settings->png_buffer_size > 0 ? settings->png_buffer_size : PNG_CHUNK_MAX_BYTES;
+	size_t row_size;
+	uint8_t header[ 13 ];
+	uLong adler;
+	uint32_t band, count = 0;
+	size_t offset, size;
+	int level;
+	bool result = false;
+
+	memset( job, 0, sizeof(png_stripes_job_t) );
+	#ifndef _WIN32
+	pthread_mutex_init( &job->lock, NULL );
+	#endif
+
+	job->image           = image;
+	job->stride          = imageio_image_stride( image );
+	job->bytes_per_pixel = image->bit_depth >> 3;
+	job->level           = png_settings_level( settings );
+	job->strategy        = png_settings_strategy( settings );
+	job->filter          = settings->png_filter > IMAGEIO_PNG_FILTER_ADAPTIVE && settings->png_filter <= IMAGEIO_PNG_FILTER_PAETH ?
+	                       settings->png_filter : IMAGEIO_PNG_FILTER_ADAPTIVE;
+	job->arena           = arena;
+
+	row_size             = (size_t) image->width * job->bytes_per_pixel;
+	job->rows_per_stripe = row_size + 1 < PNG_STRIPE_BYTES ? (uint32_t) (PNG_STRIPE_BYTES / (row_size + 1)) : 1;
+	job->dictionary_rows = (uint32_t) ((PNG_STRIPE_WINDOW + row_size) / (row_size + 1));
+	job->stripe_count    = (image->height + job->rows_per_stripe - 1) / job->rows_per_stripe;
+	job->stripes         = (png_stripe_t*) png_stripe_alloc( job, (size_t) job->stripe_count * sizeof(png_stripe_t), true );
+	job->zeros           = (const uint8_t*) png_stripe_alloc( job, row_size, true );
+
+	if( !job->stripes || !job->zeros )
+	{
+		goto failure;
+	}
+
+	for( band = 0; band < job->stripe_count; band++ )
+	{
+		job->stripes[ band ].failed = true;
+	}
+
+	parallel_rows( job->stripe_count, (size_t) job->rows_per_stripe * (row_size + 1), 0, png_stripe_band, job );
+
+	adler = adler32( 0L, Z_NULL, 0 );
+	for( count = 0; count < job->stripe_count; count++ )
+	{
+		if( job->stripes[ count ].failed )
+		{
+			goto failure;
+		}
+
+		adler = adler32_combine( adler, job->stripes[ count ].adler, (z_off_t) job->stripes[ count ].length );
+	}
+
+	/* the zlib header (32K window, FLEVEL like zlib's) and the adler32 trailer */
+	level = job->level == Z_DEFAULT_COMPRESSION ? 6 : job->level;
+	job->stripes[ 0 ].data[ 0 ] = 0x78;
+	job->stripes[ 0 ].data[ 1 ] = (uint8_t) ((job->strategy >= Z_HUFFMAN_ONLY || level < 2 ? 0 :
+	                                          level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+	job->stripes[ 0 ].data[ 1 ] += 31 - (0x78 * 256 + job->stripes[ 0 ].data[ 1 ]) % 31;
+
+	if( job->stripes[ count - 1 ].capacity - job->stripes[ count - 1 ].size < 4 &&
+	    !png_stripe_grow( job, &job->stripes[ count - 1 ], job->stripes[ count - 1 ].size + 4 ) )
+	{
+		goto failure;
+	}
+
+	png_save_uint_32( job->stripes[ count - 1 ].data + job->stripes[ count - 1 ].size, (png_uint_32) adler );
+	job->stripes[ count - 1 ].size += 4;
+
+	png_save_uint_32( header, image->width );
+	png_save_uint_32( header + 4, image->height );
+	header[ 8 ]  = 8;
+	header[ 9 ]  = job->bytes_per_pixel == 4 ? PNG_COLOR_TYPE_RGB_ALPHA :
+	               job->bytes_per_pixel == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY;
+	header[ 10 ] = PNG_COMPRESSION_TYPE_BASE;
+	header[ 11 ] = PNG_FILTER_TYPE_BASE;
+	header[ 12 ] = PNG_INTERLACE_NONE;
+
+	if( !io_write( io, signature, sizeof(signature) ) ||
+	    !png_write_chunk_io( io, "IHDR", header, sizeof(header) ) )
+	{
+		goto failure;
+	}
+
+	/* stripes after the first skip the room left for the zlib header */
+	for( band = 0; band < count; band++ )
+	{
+		for( offset = band == 0 ? 0 : 2; offset < job->stripes[ band ].size; offset += size )
+		{
+			size = job->stripes[ band ].size - offset;
+			size = size < chunk_size ? size : chunk_size;
+
+			if( !png_write_chunk_io( io, "IDAT", job->stripes[ band ].data + offset, size ) )
+			{
+				goto failure;
+			}
+		}
+	}
+
+	result = png_write_chunk_io( io, "IEND", NULL, 0 );
+
+failure:
+	for( band = 0; job->stripes && band < job->stripe_count; band++ )
+	{
+		png_stripe_free( job, job->stripes[ band ].data );
+	}
+
+	png_stripe_free( job, job->stripes );
+	png_stripe_free( job, (void*) job->zeros );
+	#ifndef _WIN32
+	pthread_mutex_destroy( &job->lock );
+	#endif
+	return result;
+}
+
+bool imageio_png_save( imageio_io_t* io, const image_t* image, const imageio_save_options_t* options, png_arena_t* arena )
+{
+	png_structp png_ptr;
+	png_infop info_ptr;
+	imageio_save_options_t settings;
+	size_t image_size;
+
+	if( !image )
+	{
+		return false;
+	}
+
+	png_save_settings( options, &settings );
+
+	/* large 8-bit images are deflated in stripes, on however many threads there are */
+	if( (image->bit_depth == 8 || image->bit_depth == 24 || image->bit_depth == 32) &&
+	    image_bytes( (size_t) image->width * (image->bit_depth >> 3), image->height, &image_size ) &&
+	    image_size >= 2 * PNG_STRIPE_BYTES )
+	{
+		return png_save_striped( io, image, &settings, arena );
+	}
+
+	/* initialize stuff */
+	png_ptr = png_create_write_struct_2( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+	                                     arena, arena ? png_arena_malloc : png_heap_malloc, arena ? png_arena_free : png_heap_free );
+
+	if( !png_ptr )
+	{
+		return false;
+	}
+
+	info_ptr = png_create_info_struct( png_ptr );
+
+	if( !info_ptr)
+	{
+        png_destroy_write_struct( &png_ptr, (png_infopp) NULL );
+		return false;
+	}
+
+	if( setjmp(png_jmpbuf(png_ptr)))
+	{
+        png_destroy_write_struct( &png_ptr, &info_ptr );
+		return false;
+	}
+
+	png_set_write_fn( png_ptr, io, png_io_write, png_io_flush );
+	png_set_user_limits( png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+	png_set_save_options( png_ptr, &settings );
+
+	int bit_depth       = 8;
+	int color_type      = PNG_COLOR_TYPE_RGB_ALPHA;
+	int bytes_per_pixel = image->bit_depth >> 3;
+
+
+	switch( bytes_per_pixel )
+	{
+		case 4:
+
+			color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+			break;
+		case 3:
+		case 2:
+			color_type = PNG_COLOR_TYPE_RGB;
+			break;
+		case 1:
+			color_type = PNG_COLOR_TYPE_GRAY;
+			break;
+		default:
+			png_destroy_write_struct( &png_ptr, &info_ptr );
+			return false;
+	}
+
+
+	png_set_IHDR( png_ptr, info_ptr, image->width, image->height,
+	              bit_depth, color_type, PNG_INTERLACE_NONE,
+	              PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+
+	png_write_info( png_ptr, info_ptr );
+
+    /* row_pointers is for pointing to image->pixels for reading the png with libpng */
+    png_bytep* row_pointers = png_malloc_warn( png_ptr, (png_alloc_size_t) image->height * sizeof(png_bytep) );
+
+    if( !row_pointers )
+    {
+		png_destroy_write_struct( &png_ptr, &info_ptr );
+        return false;
+    }
+
+	/* set the individual row_pointers to point at the correct offsets of image->pixels */
+	size_t row_stride = imageio_image_stride( image );
+    png_uint_32 i;
+    for( i = 0; i < image->height; i++ )
+    {
+        //row_pointers[ image->height - 1 - i] = image->pixels + i * row_stride;
+        row_pointers[ i ] = image->pixels + i * row_stride;
+    }
+
+	if( setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_free( png_ptr, row_pointers );
+		png_destroy_write_struct( &png_ptr, &info_ptr );
+		return false;
+	}
+
+	png_write_image( png_ptr, row_pointers );
+	png_write_end( png_ptr, NULL );
+	png_free( png_ptr, row_pointers );
+	png_destroy_write_struct( &png_ptr, &info_ptr );
+
+	return true;
+}
+
+/* Sets up the transforms for reading rows in the given layout once the
+ * header has been read, and fills in what the rows will look like.
+ */
+static bool png_read_setup( png_structp png_ptr, png_infop info_ptr, imageio_layout_t layout, imageio_info_t* info, size_t* row_size )
+{
+	png_byte color_type = png_get_color_type( png_ptr, info_ptr );
+
+	info->width  = png_get_image_width( png_ptr, info_ptr );
+	info->height = png_get_image_height( png_ptr, info_ptr );
+
+	if( layout != IMAGEIO_LAYOUT_NATIVE )
+	{
+		if( !layout_supported( layout, 1 ) )
+		{
+			return false;
+		}
+
+		png_set_layout( png_ptr, info_ptr, layout );
+		info->channels  = layout_channels( layout, 0 );
+		info->bit_depth = info->channels << 3;
+	}
+	else if( !png_layout( color_type, png_get_bit_depth( png_ptr, info_ptr ), &info->bit_depth, &info->channels ) )
+	{
+		return false;
+	}
+	else if( color_type == PNG_COLOR_TYPE_PALETTE )
+	{
+		png_set_palette_to_rgb( png_ptr );
+	}
+
+	png_read_update_info( png_ptr, info_ptr );
+	*row_size = png_get_rowbytes( png_ptr, info_ptr );
+
+	return layout == IMAGEIO_LAYOUT_NATIVE ||
+	       *row_size == (size_t) info->width * info->channels;
+}
+
+/*
+ *  Streaming reads. The reader keeps the codec's state between calls so
+ *  only one row (BMP/TGA layout conversion) or libpng's row buffers are
+ *  held, never the whole image.
+ */
+struct imageio_reader {
+	imageio_io_t io;
+	memory_stream_t stream;
+	FILE* file;
+	imageio_info_t info;        /* of the rows handed out */
+	imageio_layout_t layout;
+	uint32_t source_channels;   /* bytes per pixel in a BMP/TGA file */
+	size_t row_size;            /* bytes per row handed out */
+	size_t source_row_size;     /* bytes per row in a BMP/TGA file */
+	size_t padding;             /* BMP rows are padded to 4 bytes */
+	uint32_t row;               /* next row to read */
+	uint8_t* scratch;           /* file row when the layout is converted */
+	bool failed;
+	png_structp png_ptr;
+	png_infop info_ptr;
+};
+
+static bool reader_bitmap_open( imageio_reader_t* reader )
+{
+	bitmap_file_header_t file_header;
+	bitmap_info_header_t info_header;
+	const uint32_t headers_size = 14 + sizeof(bitmap_info_header_t);
+
+	if( !imageio_bitmap_load_header( &reader->io, &file_header, &info_header ) ||
+	    file_header.bfOffBits < headers_size ||
+	    !io_skip( &reader->io, file_header.bfOffBits - headers_size ) ||
+	    info_header.biWidth <= 0 || info_header.biHeight <= 0 )
+	{
+		return false;
+	}
+
+	reader->source_channels = info_header.biBitCount >> 3;
+	reader->source_row_size = (size_t) info_header.biWidth * reader->source_channels;
+	reader->padding         = ((reader->source_row_size + 3) & ~(size_t) 3) - reader->source_row_size;
+	reader->info.width      = info_header.biWidth;
+	reader->info.height     = info_header.biHeight;
+	reader->info.channels   = layout_channels( reader->layout, reader->source_channels );
+	reader->info.bit_depth  = reader->layout == IMAGEIO_LAYOUT_NATIVE ? (uint8_t) info_header.biBitCount : reader->info.channels << 3;
+
+	return layout_supported( reader->layout, reader->source_channels );
+}
+
+static bool reader_targa_open( imageio_reader_t* reader )
+{
+	targa_file_header_t header;
+
+	if( !imageio_targa_load_header( &reader->io, &header ) )
+	{
+		return false;
+	}
+
+	reader->source_channels = header.bitCount >> 3;
+	reader->source_row_size = (size_t) header.width * reader->source_channels;
+	reader->info.width      = header.width;
+	reader->info.height     = header.height;
+	reader->info.channels   = layout_channels( reader->layout, reader->source_channels );
+	reader->info.bit_depth  = reader->info.channels << 3;
+
+	return layout_supported( reader->layout, reader->source_channels );
+}
+
+static bool reader_png_open( imageio_reader_t* reader )
+{
+	uint8_t header[8];
+
+	if( !io_read( &reader->io, header, sizeof(header) ) || png_sig_cmp( header, 0, sizeof(header) ) )
+	{
+		return false;
+	}
+
+	reader->png_ptr = png_create_read_struct_2( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_heap_malloc, png_heap_free );
+
+	if( !reader->png_ptr )
+	{
+		return false;
+	}
+
+	reader->info_ptr = png_create_info_struct( reader->png_ptr );
+
+	if( !reader->info_ptr || setjmp(png_jmpbuf(reader->png_ptr)) )
+	{
+		return false;
+	}
+
+	png_set_read_fn( reader->png_ptr, &reader->io, png_io_read );
+	png_set_sig_bytes( reader->png_ptr, sizeof(header) );
+	png_set_user_limits( reader->png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+
+	png_read_info( reader->png_ptr, reader->info_ptr );
+
+	/* the passes of an interlaced image need the whole image in memory */
+	if( png_get_interlace_type( reader->png_ptr, reader->info_ptr ) != PNG_INTERLACE_NONE )
+	{
+		return false;
+	}
+
+	return png_read_setup( reader->png_ptr, reader->info_ptr, reader->layout, &reader->info, &reader->row_size );
+}
+
+static imageio_reader_t* reader_open( imageio_reader_t* reader, image_file_format_t format, const imageio_load_options_t* options )
+{
+	bool result = false;
+
+	reader->layout      = options ? options->layout : IMAGEIO_LAYOUT_NATIVE;
+	reader->info.format = format;
+
+	switch( format )
+	{
+		case IMAGEIO_BMP:
+			result = reader_bitmap_open( reader );
+			break;
+		case IMAGEIO_TGA:
+			result = reader_targa_open( reader );
+			break;
+		case IMAGEIO_PNG:
+			result = reader_png_open( reader );
+			break;
+		default:
+			break;
+	}
+
+	if( result && format != IMAGEIO_PNG )
+	{
+		reader->row_size = (size_t) reader->info.width * reader->info.channels;
+
+		if( reader->layout != IMAGEIO_LAYOUT_NATIVE )
+		{
+			reader->scratch = (uint8_t*) imageio_malloc( reader->source_row_size );
+			result = reader->scratch != NULL;
+		}
+	}
+
+	if( !result )
+	{
+		imageio_reader_close( reader );
+		return NULL;
+	}
+
+	return reader;
+}
+
+imageio_reader_t* imageio_reader_open( const char* filename, image_file_format_t format, const imageio_load_options_t* options )
+{
+	imageio_reader_t* reader = (imageio_reader_t*) imageio_calloc( 1, sizeof(imageio_reader_t) );
+
+	if( !reader )
+	{
+		return NULL;
+	}
+
+	reader->file = fopen( filename, "rb" );
+
+	if( !reader->file )
+	{
+		imageio_free( reader );
+		return NULL;
+	}
+
+	file_io( &reader->io, reader->file );
+	return reader_open( reader, format, options );
+}
+
+imageio_reader_t* imageio_reader_open_memory( const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options )
+{
+	imageio_reader_t* reader = (imageio_reader_t*) imageio_calloc( 1, sizeof(imageio_reader_t) );
+
+	if( !reader )
+	{
+		return NULL;
+	}
+
+	reader->stream.data = (const uint8_t*) data;
+	reader->stream.size = size;
+	memory_io( &reader->io, &reader->stream );
+	reader->io.write = NULL;
+	return reader_open( reader, format, options );
+}
+
+imageio_reader_t* imageio_reader_open_io( imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options )
+{
+	imageio_reader_t* reader = (imageio_reader_t*) imageio_calloc( 1, sizeof(imageio_reader_t) );
+
+	if( !reader )
+	{
+		return NULL;
+	}
+
+	reader->io = *io;
+	return reader_open( reader, format, options );
+}
+
+const imageio_info_t* imageio_reader_info( const imageio_reader_t* reader )
+{
+	return &reader->info;
+}
+
+static bool reader_png_read_rows( imageio_reader_t* reader, uint8_t* dst, size_t stride, uint32_t count )
+{
+	uint32_t i;
+
+	if( setjmp(png_jmpbuf(reader->png_ptr)) )
+	{
+		return false;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		png_read_row( reader->png_ptr, dst + i * stride, NULL );
+	}
+
+	if( count > 0 && reader->row + count == reader->info.height )
+	{
+		png_read_end( reader->png_ptr, NULL );
+	}
+
+	return true;
+}
+
+uint32_t imageio_reader_read_rows( imageio_reader_t* reader, void* dst, size_t stride, uint32_t count )
+{
+	uint8_t* rows = (uint8_t*) dst;
+	uint32_t i;
+
+	if( reader->failed || !dst )
+	{
+		return 0;
+	}
+
+	if( stride == 0 )
+	{
+		stride = reader->row_size;
+	}
+
+	if( count > reader->info.height - reader->row )
+	{
+		count = reader->info.height - reader->row;
+	}
+
+	if( reader->info.format == IMAGEIO_PNG )
+	{
+		/* a libpng error leaves no way to tell how far it got */
+		if( !reader_png_read_rows( reader, rows, stride, count ) )
+		{
+			reader->failed = true;
+			return 0;
+		}
+
+		reader->row += count;
+		return count;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		uint8_t* row = rows + i * stride;
+
+		if( !io_read( &reader->io, reader->scratch ? reader->scratch : row, reader->source_row_size ) ||
+		    (reader->row + 1 < reader->info.height && !io_skip( &reader->io, reader->padding )) )
+		{
+			reader->failed = true;
+			break;
+		}
+
+		if( reader->scratch )
+		{
+			layout_convert_bgr_row( reader->scratch, reader->source_channels, row, reader->layout, reader->info.width );
+		}
+		else if( reader->source_channels > 1 )
+		{
+			cpu_kernels( )->swap_red_and_blue( row, reader->info.width, reader->source_channels );
+		}
+
+		reader->row++;
+	}
+
+	return i;
+}
+
+bool imageio_reader_failed( const imageio_reader_t* reader )
+{
+	return reader->failed;
+}
+
+void imageio_reader_close( imageio_reader_t* reader )
+{
+	if( reader )
+	{
+		if( reader->png_ptr )
+		{
+			png_destroy_read_struct( &reader->png_ptr, reader->info_ptr ? &reader->info_ptr : NULL, NULL );
+		}
+
+		if( reader->file )
+		{
+			fclose( reader->file );
+		}
+
+		imageio_free( reader->scratch );
+		imageio_free( reader );
+	}
+}
+
+/*
+ *  Region loads. BMP and TGA rows have a fixed size, so whatever is
+ *  outside the rectangle is skipped with io_skip (a seek when the io has
+ *  one). PNG rows have to be decoded in order, so the rows above the
+ *  rectangle are decoded into a scratch row and dropped.
+ */
+static bool reader_skip_rows( imageio_reader_t* reader, uint8_t* row, uint32_t count )
+{
+	if( reader->info.format == IMAGEIO_PNG )
+	{
+		while( count-- > 0 )
+		{
+			if( imageio_reader_read_rows( reader, row, 0, 1 ) != 1 )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	if( count > 0 && !io_skip( &reader->io, (reader->source_row_size + reader->padding) * count ) )
+	{
+		return false;
+	}
+
+	reader->row += count;
+	return true;
+}
+
+static bool reader_read_span( imageio_reader_t* reader, uint8_t* dst, uint32_t x, uint32_t width )
+{
+	size_t before = (size_t) x * reader->source_channels;
+	size_t span   = (size_t) width * reader->source_channels;
+	size_t after  = reader->source_row_size - before - span;
+
+	if( reader->row + 1 < reader->info.height )
+	{
+		after += reader->padding;
+	}
+
+	if( !io_skip( &reader->io, before ) ||
+	    !io_read( &reader->io, reader->scratch ? reader->scratch : dst, span ) ||
+	    !io_skip( &reader->io, after ) )
+	{
+		return false;
+	}
+
+	if( reader->scratch )
+	{
+		layout_convert_bgr_row( reader->scratch, reader->source_channels, dst, reader->layout, width );
+	}
+	else if( reader->source_channels > 1 )
+	{
+		cpu_kernels( )->swap_red_and_blue( dst, width, reader->source_channels );
+	}
+
+	reader->row++;
+	return true;
+}
+
+bool imageio_image_load_region_io( image_t* img, imageio_io_t* io, image_file_format_t format, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const imageio_load_options_t* options )
+{
+	imageio_reader_t* reader = NULL;
+	const imageio_info_t* info;
+	decode_target_t target;
+	uint8_t* row = NULL;
+	uint32_t bytes_per_pixel;
+	uint32_t i;
+
+	memset( img, 0, sizeof(image_t) );
+	memset( &target, 0, sizeof(target) );
+
+	if( options && options->row_alignment > 1 )
+	{
+		if( (options->row_alignment & (options->row_alignment - 1)) != 0 )
+		{
+			return false;
+		}
+		target.alignment = options->row_alignment;
+	}
+
+	reader = imageio_reader_open_io( io, format, options );
+
+	if( !reader )
+	{
+		return false;
+	}
+
+	info            = imageio_reader_info( reader );
+	bytes_per_pixel = info->bit_depth >> 3;
+
+	if( width == 0 || height == 0 ||
+	    (uint64_t) x + width > info->width || (uint64_t) y + height > info->height )
+	{
+		goto failure;
+	}
+
+	if( info->format == IMAGEIO_PNG )
+	{
+		row = (uint8_t*) imageio_malloc( reader->row_size );
+
+		if( !row )
+		{
+			goto failure;
+		}
+	}
+
+	if( !decode_target_prepare( &target, height, (size_t) width * bytes_per_pixel ) ||
+	    !reader_skip_rows( reader, row, y ) )
+	{
+		goto failure;
+	}
+
+	for( i = 0; i < height; i++ )
+	{
+		uint8_t* dst = target.pixels + i * target.stride;
+
+		if( row )
+		{
+			if( imageio_reader_read_rows( reader, row, 0, 1 ) != 1 )
+			{
+				goto failure;
+			}
+
+			memcpy( dst, row + (size_t) x * bytes_per_pixel, (size_t) width * bytes_per_pixel );
+		}
+		else if( !reader_read_span( reader, dst, x, width ) )
+		{
+			goto failure;
+		}
+	}
+
+	img->width     = width;
+	img->height    = height;
+	img->bit_depth = info->bit_depth;
+	img->channels  = info->channels;
+	img->pixels    = target.pixels;
+	img->stride    = target.stride;
+
+	imageio_free( row );
+	imageio_reader_close( reader );
+	return true;
+
+failure:
+	decode_target_release( &target );
+	imageio_free( row );
+	imageio_reader_close( reader );
+	return false;
+}
+
+bool imageio_image_load_region( image_t* img, const char* filename, image_file_format_t format, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const imageio_load_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_image_load_region_io( img, &io, format, x, y, width, height, options );
+		fclose( file );
+	}
+	else
+	{
+		memset( img, 0, sizeof(image_t) );
+	}
+
+	return result;
+}
+
+/*
+ *  Memory mapped images. The headers are parsed with the usual readers
+ *  over a memory stream on the mapping; the pixels are never touched.
+ */
+static void* map_file( const char* filename, size_t* size )
+{
+	void* data = NULL;
+	#ifdef _WIN32
+	HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	HANDLE mapping;
+	LARGE_INTEGER file_size;
+
+	if( file == INVALID_HANDLE_VALUE )
+	{
+		return NULL;
+	}
+
+	if( GetFileSizeEx( file, &file_size ) && file_size.QuadPart > 0 && (uint64_t) file_size.QuadPart <= SIZE_MAX )
+	{
+		mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+
+		if( mapping )
+		{
+			data  = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			*size = (size_t) file_size.QuadPart;
+			CloseHandle( mapping );
+		}
+	}
+
+	CloseHandle( file );
+	#else
+	int fd = open( filename, O_RDONLY );
+	struct stat st;
+
+	if( fd < 0 )
+	{
+		return NULL;
+	}
+
+	if( fstat( fd, &st ) == 0 && st.st_size > 0 && (uint64_t) st.st_size <= SIZE_MAX )
+	{
+		data = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+
+		if( data == MAP_FAILED )
+		{
+			data = NULL;
+		}
+
+		*size = (size_t) st.st_size;
+	}
+
+	close( fd );
+	#endif
+	return data;
+}
+
+static void unmap_file( void* data, size_t size )
+{
+	#ifdef _WIN32
+	UnmapViewOfFile( data );
+	#else
+	munmap( data, size );
+	#endif
+}
+
+static bool map_bitmap( imageio_mapped_image_t* img, imageio_io_t* io )
+{
+	bitmap_file_header_t file_header;
+	bitmap_info_header_t info_header;
+
+	if( !imageio_bitmap_load_header( io, &file_header, &info_header ) ||
+	    info_header.biCompression != BI_RGB ||
+	    info_header.biWidth <= 0 || info_header.biHeight <= 0 )
+	{
+		return false;
+	}
+
+	img->bit_depth     = (uint8_t) info_header.biBitCount;
+	img->view.width    = info_header.biWidth;
+	img->view.height   = info_header.biHeight;
+	img->view.channels = info_header.biBitCount >> 3;
+	img->view.stride   = ((size_t) img->view.width * img->view.channels + 3) & ~(size_t) 3;
+	img->data          = (const uint8_t*) img->mapping + file_header.bfOffBits;
+	return file_header.bfOffBits <= img->mapping_size;
+}
+
+static bool map_targa( imageio_mapped_image_t* img, imageio_io_t* io )
+{
+	targa_file_header_t header;
+
+	if( !imageio_targa_load_header( io, &header ) || header.colorMapType != 0 )
+	{
+		return false;
+	}
+
+	img->bit_depth     = header.bitCount;
+	img->view.width    = header.width;
+	img->view.height   = header.height;
+	img->view.channels = header.bitCount >> 3;
+	img->view.stride   = (size_t) img->view.width * img->view.channels;
+	img->data          = (const uint8_t*) img->mapping + sizeof(targa_file_header_t) + header.imageIDLength;
+	return sizeof(targa_file_header_t) + header.imageIDLength <= img->mapping_size;
+}
+
+static bool map_pvr( imageio_mapped_image_t* img, imageio_io_t* io )
+{
+	pvr_header_t header;
+
+	if( !io_read( io, &header, sizeof(pvr_header_t) ) ||
+	    header.header_length < sizeof(pvr_header_t) ||
+	    header.header_length > img->mapping_size ||
+	    header.data_length > img->mapping_size - header.header_length )
+	{
+		return false;
+	}
+
+	/* PVR data has no rows */
+	img->bit_depth     = header.bit_depth;
+	img->view.width    = header.width;
+	img->view.height   = header.height;
+	img->view.channels = header.bitmask_alpha > 0 ? 4 : 3;
+	img->view.stride   = 0;
+	img->data          = (const uint8_t*) img->mapping + header.header_length;
+	img->size          = header.data_length;
+	return true;
+}
+
+static bool map_raw( imageio_mapped_image_t* img, imageio_io_t* io )
+{
+	raw_header_t header;
+	uint32_t width, height;
+	size_t offset;
+
+	if( !imageio_raw_load_header( io, &header ) ||
+	    header.data_size > img->mapping_size - header.header_size )
+	{
+		return false;
+	}
+
+	raw_level_geometry( &header, 0, &width, &height, &img->view.stride, &offset );
+	img->bit_depth     = header.bit_depth;
+	img->layout        = (imageio_layout_t) header.layout;
+	img->levels        = header.levels;
+	img->view.width    = width;
+	img->view.height   = height;
+	img->view.channels = header.bit_depth >> 3;
+	img->data          = (const uint8_t*) img->mapping + offset;
+	img->size          = (size_t) header.data_size;
+	return true;
+}
+
+bool imageio_image_map( imageio_mapped_image_t* img, const char* filename, image_file_format_t format )
+{
+	memory_stream_t stream;
+	imageio_io_t io;
+	size_t offset;
+	bool result = false;
+
+	memset( img, 0, sizeof(imageio_mapped_image_t) );
+	img->format  = format;
+	img->levels  = 1;
+	img->mapping = map_file( filename, &img->mapping_size );
+
+	if( !img->mapping )
+	{
+		return false;
+	}
+
+	memset( &stream, 0, sizeof(stream) );
+	stream.data = (const uint8_t*) img->mapping;
+	stream.size = img->mapping_size;
+	memory_io( &io, &stream );
+	io.write = NULL;
+
+	switch( format )
+	{
+		case IMAGEIO_BMP:
+			result = map_bitmap( img, &io );
+			break;
+		case IMAGEIO_TGA:
+			result = map_targa( img, &io );
+			break;
+		case IMAGEIO_PVR:
+			result = map_pvr( img, &io );
+			break;
+		case IMAGEIO_RAW:
+			result = map_raw( img, &io );
+			break;
+		default:
+			break;
+	}
+
+	if( result && (format == IMAGEIO_BMP || format == IMAGEIO_TGA) )
+	{
+		/* only 8-bit gray, BGR and BGRA can be handed out as they are */
+		offset      = (size_t) (img->data - (const uint8_t*) img->mapping);
+		img->layout = img->view.channels == 4 ? IMAGEIO_LAYOUT_BGRA8 :
+		              img->view.channels == 3 ? IMAGEIO_LAYOUT_BGR8 : IMAGEIO_LAYOUT_GRAY8;
+		result      = (img->bit_depth == 8 || img->bit_depth == 24 || img->bit_depth == 32) &&
+		              img->view.width > 0 && img->view.height > 0 &&
+		              image_bytes( img->view.stride, img->view.height - 1, &img->size ) &&
+		              img->size <= img->mapping_size - offset &&
+		              (size_t) img->view.width * img->view.channels <= img->mapping_size - offset - img->size;
+
+		img->size += (size_t) img->view.width * img->view.channels;
+	}
+
+	if( !result )
+	{
+		imageio_image_unmap( img );
+		return false;
+	}
+
+	img->view.pixels = (uint8_t*) img->data;
+	return true;
+}
+
+void imageio_image_unmap( imageio_mapped_image_t* img )
+{
+	if( img->mapping )
+	{
+		unmap_file( img->mapping, img->mapping_size );
+	}
+
+	memset( img, 0, sizeof(imageio_mapped_image_t) );
+}
+
+bool imageio_raw_level( const imageio_mapped_image_t* img, uint32_t level, imageio_view_t* view )
+{
+	raw_header_t header;
+	size_t offset;
+
+	if( img->format != IMAGEIO_RAW || !img->mapping || level >= img->levels )
+	{
+		return false;
+	}
+
+	/* checked when it was mapped */
+	memcpy( &header, img->mapping, sizeof(raw_header_t) );
+	raw_level_geometry( &header, level, &view->width, &view->height, &view->stride, &offset );
+	view->pixels   = (uint8_t*) img->mapping + offset;
+	view->channels = header.bit_depth >> 3;
+	return true;
+}
+
+/* Reads every page of the mapping, so it isn't done by imageio_image_map. */
+bool imageio_raw_verify( const imageio_mapped_image_t* img )
+{
+	raw_header_t header;
+	imageio_view_t view;
+	uint32_t level;
+
+	if( img->format != IMAGEIO_RAW || !img->mapping )
+	{
+		return false;
+	}
+
+	memcpy( &header, img->mapping, sizeof(raw_header_t) );
+
+	for( level = 0; (header.flags & RAW_FLAG_CHECKSUM) && level < header.levels; level++ )
+	{
+		imageio_raw_level( img, level, &view );
+
+		if( raw_level_checksum( view.pixels, view.height, view.stride, (size_t) view.width * view.channels ) != header.checksums[ level ] )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ *  Progressive PNG decoding. libpng's push reader parses whatever bytes it
+ *  has and calls back as the header, each row and the end come in.
+ */
+struct imageio_progressive {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	imageio_layout_t layout;
+	imageio_info_t info;
+	size_t row_size;
+	imageio_row_fxn row;
+	void* user;
+	uint8_t* image;             /* interlaced images only */
+	bool started;               /* the header is in */
+	bool done;
+	bool failed;
+};
+
+static void progressive_info( png_structp png_ptr, png_infop info_ptr )
+{
+	imageio_progressive_t* decoder = (imageio_progressive_t*) png_get_progressive_ptr( png_ptr );
+	size_t size;
+
+	if( png_get_interlace_type( png_ptr, info_ptr ) != PNG_INTERLACE_NONE )
+	{
+		png_set_interlace_handling( png_ptr );
+	}
+
+	if( !png_read_setup( png_ptr, info_ptr, decoder->layout, &decoder->info, &decoder->row_size ) )
+	{
+		png_error( png_ptr, "unsupported layout" );
+	}
+
+	if( png_get_interlace_type( png_ptr, info_ptr ) != PNG_INTERLACE_NONE )
+	{
+		/* calloc, since png_progressive_combine_row fills the passes in */
+		if( !image_bytes( decoder->row_size, decoder->info.height, &size ) ||
+		    !(decoder->image = (uint8_t*) imageio_calloc( 1, size )) )
+		{
+			png_error( png_ptr, "out of memory" );
+		}
+	}
+
+	decoder->started = true;
+}
+
+static void progressive_row( png_structp png_ptr, png_bytep new_row, png_uint_32 row_num, int pass )
+{
+	imageio_progressive_t* decoder = (imageio_progressive_t*) png_get_progressive_ptr( png_ptr );
+
+	(void) pass;
+
+	if( decoder->image )
+	{
+		png_progressive_combine_row( png_ptr, decoder->image + row_num * decoder->row_size, new_row );
+	}
+	else if( new_row )
+	{
+		decoder->row( decoder->user, row_num, new_row );
+	}
+}
+
+static void progressive_end( png_structp png_ptr, png_infop info_ptr )
+{
+	imageio_progressive_t* decoder = (imageio_progressive_t*) png_get_progressive_ptr( png_ptr );
+	uint32_t y;
+
+	(void) info_ptr;
+
+	if( decoder->image )
+	{
+		for( y = 0; y < decoder->info.height; y++ )
+		{
+			decoder->row( decoder->user, y, decoder->image + y * decoder->row_size );
+		}
+	}
+
+	decoder->done = true;
+}
+
+imageio_progressive_t* imageio_progressive_create( const imageio_load_options_t* options, imageio_row_fxn row, void* user )
+{
+	imageio_progressive_t* decoder;
+
+	if( !row )
+	{
+		return NULL;
+	}
+
+	decoder = (imageio_progressive_t*) imageio_calloc( 1, sizeof(imageio_progressive_t) );
+
+	if( !decoder )
+	{
+		return NULL;
+	}
+
+	decoder->layout      = options ? options->layout : IMAGEIO_LAYOUT_NATIVE;
+	decoder->info.format = IMAGEIO_PNG;
+	decoder->row         = row;
+	decoder->user        = user;
+	decoder->png_ptr     = png_create_read_struct_2( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_heap_malloc, png_heap_free );
+
+	if( !decoder->png_ptr || !(decoder->info_ptr = png_create_info_struct( decoder->png_ptr )) )
+	{
+		imageio_progressive_destroy( decoder );
+		return NULL;
+	}
+
+	png_set_user_limits( decoder->png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+	png_set_progressive_read_fn( decoder->png_ptr, decoder, progressive_info, progressive_row, progressive_end );
+	return decoder;
+}
+
+bool imageio_progressive_push( imageio_progressive_t* decoder, const void* data, size_t size )
+{
+	if( decoder->failed )
+	{
+		return false;
+	}
+
+	if( setjmp(png_jmpbuf(decoder->png_ptr)) )
+	{
+		decoder->failed = true;
+		return false;
+	}
+
+	png_process_data( decoder->png_ptr, decoder->info_ptr, (png_bytep) data, size );
+	return true;
+}
+
+const imageio_info_t* imageio_progressive_info( const imageio_progressive_t* decoder )
+{
+	return decoder->started ? &decoder->info : NULL;
+}
+
+bool imageio_progressive_done( const imageio_progressive_t* decoder )
+{
+	return decoder->done;
+}
+
+void imageio_progressive_destroy( imageio_progressive_t* decoder )
+{
+	if( decoder )
+	{
+		if( decoder->png_ptr )
+		{
+			png_destroy_read_struct( &decoder->png_ptr, decoder->info_ptr ? &decoder->info_ptr : NULL, NULL );
+		}
+
+		imageio_free( decoder->image );
+		imageio_free( decoder );
+	}
+}
+
+/*
+ *  Streaming writes. BMP and TGA rows are swapped to BGR in a padded
+ *  scanline so the caller's rows stay as they were; libpng copies each row
+ *  itself.
+ */
+struct imageio_writer {
+	imageio_io_t io;
+	FILE* file;
+	image_file_format_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	size_t row_size;            /* bytes per row handed in */
+	size_t padding;             /* BMP rows are padded to 4 bytes */
+	uint32_t row;               /* next row to write */
+	uint8_t* scratch;           /* BGR copy of a row and its padding */
+	bool failed;
+	png_structp png_ptr;
+	png_infop info_ptr;
+};
+
+static bool writer_png_open( imageio_writer_t* writer )
+{
+	int color_type = writer->channels == 4 ? PNG_COLOR_TYPE_RGB_ALPHA :
+	                 writer->channels == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY;
+
+	writer->png_ptr = png_create_write_struct_2( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_heap_malloc, png_heap_free );
+
+	if( !writer->png_ptr )
+	{
+		return false;
+	}
+
+	writer->info_ptr = png_create_info_struct( writer->png_ptr );
+
+	if( !writer->info_ptr || setjmp(png_jmpbuf(writer->png_ptr)) )
+	{
+		return false;
+	}
+
+	png_set_write_fn( writer->png_ptr, &writer->io, png_io_write, png_io_flush );
+	png_set_user_limits( writer->png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX );
+	png_set_IHDR( writer->png_ptr, writer->info_ptr, writer->width, writer->height,
+	              8, color_type, PNG_INTERLACE_NONE,
+	              PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+	png_write_info( writer->png_ptr, writer->info_ptr );
+
+	return true;
+}
+
+static imageio_writer_t* writer_open( imageio_writer_t* writer, image_file_format_t format, uint32_t width, uint32_t height, uint8_t bit_depth )
+{
+	bool result = false;
+
+	writer->format   = format;
+	writer->width    = width;
+	writer->height   = height;
+	writer->channels = bit_depth >> 3;
+	writer->row_size = (size_t) width * writer->channels;
+
+	if( bit_depth == 8 || bit_depth == 24 || bit_depth == 32 )
+	{
+		switch( format )
+		{
+			case IMAGEIO_BMP:
+				writer->padding = ((writer->row_size + 3) & ~(size_t) 3) - writer->row_size;
+				result = imageio_bitmap_save_header( &writer->io, width, height, bit_depth );
+				break;
+			case IMAGEIO_TGA:
+			{
+				targa_file_header_t header;
+				/* the TGA header only has room for 16-bit dimensions */
+				if( width <= UINT16_MAX && height <= UINT16_MAX )
+				{
+					header.bitCount = bit_depth;
+					header.width    = width;
+					header.height   = height;
+					result = imageio_targa_save_header( &writer->io, &header );
+				}
+				break;
+			}
+			case IMAGEIO_PNG:
+				result = writer_png_open( writer );
+				break;
+			default:
+				break;
+		}
+	}
+
+	if( result && format != IMAGEIO_PNG && (writer->channels >= 3 || writer->padding > 0) )
+	{
+		writer->scratch = (uint8_t*) imageio_calloc( 1, writer->row_size + writer->padding );
+		result = writer->scratch != NULL;
+	}
+
+	if( !result )
+	{
+		writer->failed = true;
+		imageio_writer_close( writer );
+		return NULL;
+	}
+
+	return writer;
+}
+
+imageio_writer_t* imageio_writer_open( const char* filename, image_file_format_t format, uint32_t width, uint32_t height, uint8_t bit_depth )
+{
+	imageio_writer_t* writer = (imageio_writer_t*) imageio_calloc( 1, sizeof(imageio_writer_t) );
+
+	if( !writer )
+	{
+		return NULL;
+	}
+
+	writer->file = fopen( filename, "wb" );
+
+	if( !writer->file )
+	{
+		imageio_free( writer );
+		return NULL;
+	}
+
+	file_io( &writer->io, writer->file );
+	return writer_open( writer, format, width, height, bit_depth );
+}
+
+imageio_writer_t* imageio_writer_open_io( imageio_io_t* io, image_file_format_t format, uint32_t width, uint32_t height, uint8_t bit_depth )
+{
+	imageio_writer_t* writer = (imageio_writer_t*) imageio_calloc( 1, sizeof(imageio_writer_t) );
+
+	if( !writer )
+	{
+		return NULL;
+	}
+
+	writer->io = *io;
+	return writer_open( writer, format, width, height, bit_depth );
+}
+
+static bool writer_png_write_rows( imageio_writer_t* writer, const uint8_t* src, size_t stride, uint32_t count )
+{
+	uint32_t i;
+
+	if( setjmp(png_jmpbuf(writer->png_ptr)) )
+	{
+		return false;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		png_write_row( writer->png_ptr, src + i * stride );
+	}
+
+	return true;
+}
+
+static bool writer_png_end( imageio_writer_t* writer )
+{
+	if( setjmp(png_jmpbuf(writer->png_ptr)) )
+	{
+		return false;
+	}
+
+	png_write_end( writer->png_ptr, NULL );
+	return true;
+}
+
+uint32_t imageio_writer_write_rows( imageio_writer_t* writer, const void* src, size_t stride, uint32_t count )
+{
+	const uint8_t* rows = (const uint8_t*) src;
+	uint32_t i;
+
+	if( writer->failed || !src )
+	{
+		return 0;
+	}
+
+	if( stride == 0 )
+	{
+		stride = writer->row_size;
+	}
+
+	if( count > writer->height - writer->row )
+	{
+		count = writer->height - writer->row;
+	}
+
+	if( writer->format == IMAGEIO_PNG )
+	{
+		/* a libpng error leaves no way to tell how far it got */
+		if( !writer_png_write_rows( writer, rows, stride, count ) )
+		{
+			writer->failed = true;
+			return 0;
+		}
+
+		writer->row += count;
+		return count;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		const uint8_t* row = rows + i * stride;
+
+		if( writer->scratch )
+		{
+			scanline_from_rgb( writer->scratch, row, writer->width, writer->channels );
+			row = writer->scratch;
+		}
+
+		if( !io_write( &writer->io, row, writer->row_size + writer->padding ) )
+		{
+			writer->failed = true;
+			break;
+		}
+
+		writer->row++;
+	}
+
+	return i;
+}
+
+bool imageio_writer_close( imageio_writer_t* writer )
+{
+	bool result;
+
+	if( !writer )
+	{
+		return false;
+	}
+
+	result = !writer->failed && writer->row == writer->height;
+
+	if( writer->png_ptr )
+	{
+		result = result && writer_png_end( writer );
+
+		png_destroy_write_struct( &writer->png_ptr, writer->info_ptr ? &writer->info_ptr : NULL );
+	}
+
+	if( writer->file && fclose( writer->file ) != 0 )
+	{
+		result = false;
+	}
+
+	imageio_free( writer->scratch );
+	imageio_free( writer );
+	return result;
+}
+
+/*
+ *  Reusable decoders and encoders. What libpng and zlib allocate for an
+ *  image (the png and info structs, the inflate or deflate state, row
+ *  buffers and the row pointers) comes from the object's arena, which is
+ *  reset after each image instead of being freed. An encoder also keeps
+ *  the buffer imageio_encoder_save_memory writes into.
+ */
+struct imageio_decoder {
+	png_arena_t arena;
+};
+
+struct imageio_encoder {
+	png_arena_t arena;
+	memory_stream_t stream;
+};
+
+imageio_decoder_t* imageio_decoder_create( void )
+{
+	return (imageio_decoder_t*) imageio_calloc( 1, sizeof(imageio_decoder_t) );
+}
+
+void imageio_decoder_destroy( imageio_decoder_t* decoder )
+{
+	if( decoder )
+	{
+		png_arena_release( &decoder->arena );
+		imageio_free( decoder );
+	}
+}
+
+bool imageio_decoder_load( imageio_decoder_t* decoder, image_t* img, const char* filename, image_file_format_t format, const imageio_load_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_decoder_load_io( decoder, img, &io, format, options );
+		fclose( file );
+	}
+	else
+	{
+		memset( img, 0, sizeof(image_t) );
+	}
+
+	return result;
+}
+
+bool imageio_decoder_load_memory( imageio_decoder_t* decoder, image_t* img, const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options )
+{
+	memory_stream_t stream;
+	imageio_io_t io;
+
+	memset( &stream, 0, sizeof(stream) );
+	stream.data = (const uint8_t*) data;
+	stream.size = size;
+	memory_io( &io, &stream );
+	io.write = NULL;
+
+	return imageio_decoder_load_io( decoder, img, &io, format, options );
+}
+
+bool imageio_decoder_load_io( imageio_decoder_t* decoder, image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options )
+{
+	decode_target_t target;
+	bool result;
+
+	memset( &target, 0, sizeof(target) );
+	if( options && options->row_alignment > 1 )
+	{
+		if( (options->row_alignment & (options->row_alignment - 1)) != 0 )
+		{
+			memset( img, 0, sizeof(image_t) );
+			return false;
+		}
+		target.alignment = options->row_alignment;
+	}
+
+	result = image_load( img, io, format, options, &target, &decoder->arena );
+	png_arena_reset( &decoder->arena );
+	return result;
+}
+
+imageio_encoder_t* imageio_encoder_create( void )
+{
+	return (imageio_encoder_t*) imageio_calloc( 1, sizeof(imageio_encoder_t) );
+}
+
+void imageio_encoder_destroy( imageio_encoder_t* encoder )
+{
+	if( encoder )
+	{
+		png_arena_release( &encoder->arena );
+		imageio_free( encoder->stream.buffer );
+		imageio_free( encoder );
+	}
+}
+
+bool imageio_encoder_save( imageio_encoder_t* encoder, const image_t* img, const char* filename, image_file_format_t format, const imageio_save_options_t* options )
+{
+	bool result = false;
+	imageio_io_t io;
+	FILE* file;
+
+	if( format != IMAGEIO_BMP && format != IMAGEIO_TGA && format != IMAGEIO_PNG && format != IMAGEIO_RAW )
+	{
+		return false;
+	}
+
+	file = fopen( filename, "wb" );
+
+	if( file )
+	{
+		file_io( &io, file );
+		result = imageio_encoder_save_io( encoder, img, &io, format, options );
+		result = fclose( file ) == 0 && result;
+	}
+
+	return result;
+}
+
+/* The bytes stay the encoder's; they are good until its next save. */
+bool imageio_encoder_save_memory( imageio_encoder_t* encoder, const image_t* img, const void** data, size_t* size, image_file_format_t format, const imageio_save_options_t* options )
+{
+	imageio_io_t io;
+	bool result;
+
+	encoder->stream.size     = 0;
+	encoder->stream.position = 0;
+	memory_io( &io, &encoder->stream );
+
+	result = imageio_encoder_save_io( encoder, img, &io, format, options );
+	*data  = result ? encoder->stream.buffer : NULL;
+	*size  = result ? encoder->stream.size : 0;
+	return result;
+}
+
+bool imageio_encoder_save_io( imageio_encoder_t* encoder, const image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_save_options_t* options )
+{
+	bool result = image_save( img, io, format, options, &encoder->arena );
+	png_arena_reset( &encoder->arena );
+	return result;
+}
+
+/*
+ *  Image stretching functions...
+ */
+void imageio_image_resize( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
+                           uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t bit_depth,
+                           resize_algorithm_t algorithm )
+{
+	imageio_resize_plan_t* plan;
+	assert( src_bitmap != NULL || dst_bitmap != NULL );
+	assert( src_width != 0 || src_height != 0 );
+	assert( (bit_depth >> 3) > 2 );
+
+	plan = imageio_resize_plan_create( src_width, src_height, dst_width, dst_height, bit_depth, algorithm );
+	assert( plan != NULL ); /* bad algorithm or unsupported bit_depth... */
+
+	if( plan )
+	{
+		imageio_resize_plan_execute( plan, src_bitmap, dst_bitmap );
+		imageio_resize_plan_destroy( plan );
+	}
+}
+
+bool imageio_image_resize_view( const imageio_view_t* src, const imageio_view_t* dst, resize_algorithm_t algorithm )
+{
+	imageio_resize_plan_t* plan;
+	bool result;
+
+	if( src->channels != dst->channels )
+	{
+		return false;
+	}
+
+	plan = imageio_resize_plan_create( src->width, src->height, dst->width, dst->height, src->channels << 3, algorithm );
+
+	if( !plan )
+	{
+		return false;
+	}
+
+	result = imageio_resize_plan_execute_stride( plan, src->pixels, src->stride, dst->pixels, dst->stride );
+	imageio_resize_plan_destroy( plan );
+	return result;
+}
+
+/*
+ *  Separable resampling. Each axis gets a table of contributions (the first
+ *  source pixel plus a fixed run of weights) that is computed once per resize.
+ *  Source rows are filtered horizontally into a small ring of rows and output
+ *  rows are then filtered vertically out of that ring. All of the pixel math
+ *  is done with integer weights in RESAMPLE_PRECISION fixed-point. The ring
+ *  holds 16-bit values with RESAMPLE_FRACTION_BITS below the integer part,
+ *  so the output is rounded once and the overshoot of the sharper kernels
+ *  isn't clipped between the passes.
+ */
+#define RESAMPLE_PRECISION        14
+#define RESAMPLE_ONE              (1 << RESAMPLE_PRECISION)
+#define RESAMPLE_FRACTION_BITS    6   /* leaves room for values from -512 to 511 */
+#define RESAMPLE_HORIZONTAL_SHIFT (RESAMPLE_PRECISION - RESAMPLE_FRACTION_BITS)
+#define RESAMPLE_VERTICAL_SHIFT   (RESAMPLE_PRECISION + RESAMPLE_FRACTION_BITS)
+#define RESAMPLE_BLOCK            1024
+
+typedef double (*resample_kernel_fxn)( double x );
+
+typedef struct resample_filter {
+	resample_kernel_fxn kernel;
+	double support;  /* radius of the kernel, in source pixels */
+} resample_filter_t;
+
+typedef struct resample_axis {
+	uint32_t taps;     /* weights per output pixel */
+	uint32_t* first;   /* first source pixel of each output pixel */
+	int16_t* weights;  /* taps weights for each output pixel */
+} resample_axis_t;
+
+typedef struct resample_scratch {
+	int16_t* ring;       /* vertical.taps horizontally filtered rows */
+	int32_t* ring_rows;  /* source row held by each ring slot */
+	const int16_t** rows; /* ring slot of each tap of the current output row */
+	int32_t* accum;      /* RESAMPLE_BLOCK vertical sums */
+} resample_scratch_t;
+
+typedef struct resample {
+	uint32_t src_width;
+	uint32_t src_height;
+	uint32_t dst_width;
+	uint32_t dst_height;
+	uint32_t byte_count;
+	resample_axis_t horizontal;
+	resample_axis_t vertical;
+	uint32_t scratch_count;
+	resample_scratch_t* scratch;  /* one per row band */
+} resample_t;
+
+static __inline double resample_cubic( double x, double B, double C )
+{
+	x = fabs( x );
+
+	if( x < 1.0 )
+	{
+		return ((12.0 - 9.0 * B - 6.0 * C) * x * x * x + (-18.0 + 12.0 * B + 6.0 * C) * x * x + (6.0 - 2.0 * B)) / 6.0;
+	}
+	else if( x < 2.0 )
+	{
+		return ((-B - 6.0 * C) * x * x * x + (6.0 * B + 30.0 * C) * x * x + (-12.0 * B - 48.0 * C) * x + (8.0 * B + 24.0 * C)) / 6.0;
+	}
+
+	return 0.0;
+}
+
+static __inline double resample_sinc( double x )
+{
+	if( x == 0.0 )
+	{
+		return 1.0;
+	}
+
+	x *= M_PI;
+	return sin( x ) / x;
+}
+
+static double resample_bspline( double x )     { return resample_cubic( x, 1.0, 0.0 ); }
+static double resample_mitchell( double x )    { return resample_cubic( x, 1.0 / 3.0, 1.0 / 3.0 ); }
+static double resample_catmull_rom( double x ) { return resample_cubic( x, 0.0, 0.5 ); }
+static double resample_lanczos3( double x )    { return fabs( x ) < 3.0 ? resample_sinc( x ) * resample_sinc( x / 3.0 ) : 0.0; }
+
+static bool resample_filter_for( resize_algorithm_t algorithm, resample_filter_t* filter )
+{
+	switch( algorithm )
+	{
+		case ALG_BICUBIC:
+			filter->kernel  = resample_bspline;
+			filter->support = 2.0;
+			return true;
+		case ALG_MITCHELL:
+			filter->kernel  = resample_mitchell;
+			filter->support = 2.0;
+			return true;
+		case ALG_CATMULL_ROM:
+			filter->kernel  = resample_catmull_rom;
+			filter->support = 2.0;
+			return true;
+		case ALG_LANCZOS3:
+			filter->kernel  = resample_lanczos3;
+			filter->support = 3.0;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void resample_axis_destroy( resample_axis_t* axis )
+{
+	imageio_free( axis->first );
+	imageio_free( axis->weights );
+	axis->first   = NULL;
+	axis->weights = NULL;
+	axis->taps    = 0;
+}
+
+static bool resample_axis_create( resample_axis_t* axis, uint32_t src_size, uint32_t dst_size, const resample_filter_t* filter )
+{
+	double scale        = (double) src_size / (double) dst_size;
+	double filter_scale = scale > 1.0 ? scale : 1.0;
+	double support      = filter->support * filter_scale;
+	uint32_t max_taps   = (uint32_t) ceil( support ) * 2 + 1;
+	double* contrib     = NULL;
+	uint32_t* counts    = NULL;
+	uint32_t i, k;
+
+	if( max_taps > src_size )
+	{
+		max_taps = src_size;
+	}
+
+	axis->taps    = 0;
+	axis->first   = (uint32_t*) imageio_malloc( sizeof(uint32_t) * dst_size );
+	axis->weights = NULL;
+	contrib       = (double*) imageio_malloc( sizeof(double) * dst_size * max_taps );
+	counts        = (uint32_t*) imageio_malloc( sizeof(uint32_t) * dst_size );
+
+	if( !axis->first || !contrib || !counts )
+	{
+		goto failure;
+	}
+
+	/* First pass: the real-valued weights and the widest window. */
+	for( i = 0; i < dst_size; i++ )
+	{
+		double center = (i + 0.5) * scale;
+		double* w     = &contrib[ i * max_taps ];
+		double total  = 0.0;
+		int32_t lo    = (int32_t) floor( center - support + 0.5 );
+		int32_t hi    = (int32_t) floor( center + support + 0.5 );
+
+		if( lo < 0 ) lo = 0;
+		if( hi > (int32_t) src_size ) hi = src_size;
+		if( hi - lo > (int32_t) max_taps ) hi = lo + max_taps;
+		if( hi <= lo ) hi = lo + 1; /* degenerate scale; sample the nearest pixel */
+
+		for( k = 0; k < (uint32_t) (hi - lo); k++ )
+		{
+			w[ k ] = filter->kernel( (lo + k + 0.5 - center) / filter_scale );
+			total += w[ k ];
+		}
+
+		for( k = 0; k < (uint32_t) (hi - lo); k++ )
+		{
+			w[ k ] = total != 0.0 ? w[ k ] / total : (k == 0 ? 1.0 : 0.0);
+		}
+
+		axis->first[ i ] = lo;
+		counts[ i ]      = hi - lo;
+
+		if( counts[ i ] > axis->taps )
+		{
+			axis->taps = counts[ i ];
+		}
+	}
+
+	axis->weights = (int16_t*) imageio_calloc( (size_t) dst_size * axis->taps, sizeof(int16_t) );
+
+	if( !axis->weights )
+	{
+		goto failure;
+	}
+
+	/* Second pass: quantize so that each run of weights sums to exactly
+	 * RESAMPLE_ONE and shift windows near the right edge so that every
+	 * output reads exactly taps pixels without leaving the source.
+	 */
+	for( i = 0; i < dst_size; i++ )
+	{
+		const double* w = &contrib[ i * max_taps ];
+		uint32_t shift  = 0;
+		int32_t sum     = 0;
+		uint32_t peak   = 0;
+		int16_t* q;
+
+		if( axis->first[ i ] + axis->taps > src_size )
+		{
+			shift = axis->first[ i ] + axis->taps - src_size;
+			axis->first[ i ] -= shift;
+		}
+
+		q = &axis->weights[ (size_t) i * axis->taps + shift ];
+
+		for( k = 0; k < counts[ i ]; k++ )
+		{
+			q[ k ] = (int16_t) floor( w[ k ] * RESAMPLE_ONE + 0.5 );
+			sum   += q[ k ];
+			if( w[ k ] > w[ peak ] ) peak = k;
+		}
+
+		q[ peak ] += RESAMPLE_ONE - sum;
+	}
+
+	imageio_free( contrib );
+	imageio_free( counts );
+	return true;
+
+failure:
+	imageio_free( contrib );
+	imageio_free( counts );
+	resample_axis_destroy( axis );
+	return false;
+}
+
+/* Rounds a horizontal sum to the ring's fixed-point, saturating like packs. */
+static __inline int16_t resample_narrow( int32_t value )
+{
+	value += 1 << (RESAMPLE_HORIZONTAL_SHIFT - 1);
+	/* floor division, as the vector arithmetic shift does */
+	value = value >= 0 ? value >> RESAMPLE_HORIZONTAL_SHIFT : ~(~value >> RESAMPLE_HORIZONTAL_SHIFT);
 
-	fwrite( p_file_header, sizeof(targa_file_header_t), 1, filePtr );
+	if( value < INT16_MIN )
+	{
+		return INT16_MIN;
+	}
+
+	return value > INT16_MAX ? INT16_MAX : (int16_t) value;
+}
 
-	convertRGBtoBGR( p_file_header->width, p_file_header->height, colorMode, bitmap );
+static __inline uint8_t resample_clamp( int32_t value )
+{
+	value += 1 << (RESAMPLE_VERTICAL_SHIFT - 1);
 
-	imageSize = p_file_header->width * p_file_header->height * colorMode;
-	fwrite( bitmap, imageSize, 1, filePtr );
+	if( value < 0 )
+	{
+		return 0;
+	}
 
-	fclose( filePtr );
-	return true;
+	value >>= RESAMPLE_VERTICAL_SHIFT;
+	return value > 255 ? 255 : (uint8_t) value;
 }
 
-bool imageio_pvr_load( const char* filename, pvr_header_t* p_header, uint8_t** bitmap )
+static void resample_destroy( resample_t* r )
 {
-	FILE* file;
+	uint32_t i;
+
+	resample_axis_destroy( &r->horizontal );
+	resample_axis_destroy( &r->vertical );
 
-	if( (file = fopen( filename, "rb" )) == NULL )
+	for( i = 0; i < r->scratch_count; i++ )
 	{
-		return false;
+		imageio_free( r->scratch[ i ].ring );
+		imageio_free( r->scratch[ i ].ring_rows );
+		imageio_free( (void*) r->scratch[ i ].rows );
+		imageio_free( r->scratch[ i ].accum );
 	}
 
-	/* Read in pvr header */
-	fread( p_header, sizeof(pvr_header_t), 1, file );
+	imageio_free( r->scratch );
+	r->scratch       = NULL;
+	r->scratch_count = 0;
+}
 
-	/* Jump to start of pixel data */
-	fseek( file, p_header->header_length, SEEK_SET );
+static bool resample_create( resample_t* r, uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height, uint32_t byte_count, resize_algorithm_t algorithm, uint32_t bands )
+{
+	resample_filter_t filter;
+	size_t row_size = (size_t) dst_width * byte_count;
+
+	memset( r, 0, sizeof(resample_t) );
 
-	size_t image_size = p_header->data_length;
+	if( src_width == 0 || src_height == 0 || dst_width == 0 || dst_height == 0 || byte_count == 0 || bands == 0 ||
+	    !resample_filter_for( algorithm, &filter ) )
+	{
+		return false;
+	}
 
-	uint8_t* pixel_data = malloc( image_size );
+	r->src_width  = src_width;
+	r->src_height = src_height;
+	r->dst_width  = dst_width;
+	r->dst_height = dst_height;
+	r->byte_count = byte_count;
 
-	if( pixel_data )
+	if( !resample_axis_create( &r->horizontal, src_width, dst_width, &filter ) ||
+	    !resample_axis_create( &r->vertical, src_height, dst_height, &filter ) )
 	{
-		fread( pixel_data, image_size, 1, file );
+		goto failure;
 	}
-	else
+
+	r->scratch = (resample_scratch_t*) imageio_calloc( bands, sizeof(resample_scratch_t) );
+
+	if( !r->scratch )
 	{
-		return false;
+		goto failure;
+	}
+
+	for( r->scratch_count = 0; r->scratch_count < bands; r->scratch_count++ )
+	{
+		resample_scratch_t* scratch = &r->scratch[ r->scratch_count ];
+
+		scratch->ring      = (int16_t*) imageio_malloc( sizeof(int16_t) * row_size * r->vertical.taps );
+		scratch->ring_rows = (int32_t*) imageio_malloc( sizeof(int32_t) * r->vertical.taps );
+		scratch->rows      = (const int16_t**) imageio_malloc( sizeof(int16_t*) * r->vertical.taps );
+		scratch->accum     = (int32_t*) imageio_malloc( sizeof(int32_t) * RESAMPLE_BLOCK );
+
+		if( !scratch->ring || !scratch->ring_rows || !scratch->rows || !scratch->accum )
+		{
+			r->scratch_count++; /* so that destroy frees this one too */
+			goto failure;
+		}
 	}
 
-	*bitmap = pixel_data;
-	fclose( file );
 	return true;
+
+failure:
+	resample_destroy( r );
+	return false;
 }
 
-bool imageio_png_load( const char* filename, image_t* image )
+static void resample_horizontal( const resample_t* r, const uint8_t* src_row, int16_t* dst_row )
 {
-	png_structp png_ptr;
-	png_infop info_ptr;
-	uint8_t header[8];
-	FILE *file;
+	const uint32_t taps       = r->horizontal.taps;
+	const uint32_t byte_count = r->byte_count;
+	uint32_t x, k, c;
 
-	file = fopen( filename, "rb" );
+	for( x = 0; x < r->dst_width; x++ )
+	{
+		const uint8_t* s = src_row + (size_t) r->horizontal.first[ x ] * byte_count;
+		const int16_t* w = &r->horizontal.weights[ (size_t) x * taps ];
+		int16_t* d       = dst_row + (size_t) x * byte_count;
 
-	/* test if a png */
-	if( !file )
+		switch( byte_count )
+		{
+			case 4:
+			{
+				int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+				for( k = 0; k < taps; k++, s += 4 )
+				{
+					s0 += s[ 0 ] * w[ k ];
+					s1 += s[ 1 ] * w[ k ];
+					s2 += s[ 2 ] * w[ k ];
+					s3 += s[ 3 ] * w[ k ];
+				}
+				d[ 0 ] = resample_narrow( s0 );
+				d[ 1 ] = resample_narrow( s1 );
+				d[ 2 ] = resample_narrow( s2 );
+				d[ 3 ] = resample_narrow( s3 );
+				break;
+			}
+			case 3:
+			{
+				int32_t s0 = 0, s1 = 0, s2 = 0;
+				for( k = 0; k < taps; k++, s += 3 )
+				{
+					s0 += s[ 0 ] * w[ k ];
+					s1 += s[ 1 ] * w[ k ];
+					s2 += s[ 2 ] * w[ k ];
+				}
+				d[ 0 ] = resample_narrow( s0 );
+				d[ 1 ] = resample_narrow( s1 );
+				d[ 2 ] = resample_narrow( s2 );
+				break;
+			}
+			default:
+				for( c = 0; c < byte_count; c++ )
+				{
+					int32_t sum = 0;
+					for( k = 0; k < taps; k++ )
+					{
+						sum += s[ k * byte_count + c ] * w[ k ];
+					}
+					d[ c ] = resample_narrow( sum );
+				}
+				break;
+		}
+	}
+}
+
+#if defined(IMAGEIO_X86)
+/* Two taps per madd: [p0 p1 p0 p1 ...] * [w0 w1 w0 w1 ...] */
+TARGET_SSE2
+static void resample_horizontal_sse2( const resample_t* r, const uint8_t* src_row, int16_t* dst_row )
+{
+	const uint32_t taps = r->horizontal.taps;
+	const __m128i zero  = _mm_setzero_si128( );
+	const __m128i half  = _mm_set1_epi32( 1 << (RESAMPLE_HORIZONTAL_SHIFT - 1) );
+	uint32_t x, k;
+
+	if( r->byte_count != 4 )
 	{
-		return false;
+		resample_horizontal( r, src_row, dst_row );
+		return;
 	}
 
-	fread( header, 1, sizeof(header), file );
-	if( png_sig_cmp( header, 0, sizeof(header) ) )
+	for( x = 0; x < r->dst_width; x++ )
 	{
-		/* not a png file */
-		return false;
+		const uint8_t* s = src_row + (size_t) r->horizontal.first[ x ] * 4;
+		const int16_t* w = &r->horizontal.weights[ (size_t) x * taps ];
+		__m128i sum      = zero;
+		int32_t pixel;
+
+		for( k = 0; k + 1 < taps; k += 2 )
+		{
+			__m128i p = _mm_loadl_epi64( (const __m128i*) (s + k * 4) );
+			int32_t weights;
+
+			memcpy( &weights, &w[ k ], sizeof(weights) );
+			p   = _mm_unpacklo_epi8( _mm_unpacklo_epi8( p, _mm_srli_si128( p, 4 ) ), zero );
+			sum = _mm_add_epi32( sum, _mm_madd_epi16( p, _mm_set1_epi32( weights ) ) );
+		}
+
+		if( k < taps )
+		{
+			__m128i p;
+
+			memcpy( &pixel, s + k * 4, sizeof(pixel) );
+			p   = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( pixel ), zero ), zero );
+			sum = _mm_add_epi32( sum, _mm_madd_epi16( p, _mm_set1_epi32( (uint16_t) w[ k ] ) ) );
+		}
+
+		sum = _mm_srai_epi32( _mm_add_epi32( sum, half ), RESAMPLE_HORIZONTAL_SHIFT );
+		_mm_storel_epi64( (__m128i*) (dst_row + (size_t) x * 4), _mm_packs_epi32( sum, sum ) );
 	}
+}
 
-	/* initialize stuff */
-	png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+/* Four taps per madd: each 128-bit lane holds two taps of every channel. */
+TARGET_AVX2
+static void resample_horizontal_avx2( const resample_t* r, const uint8_t* src_row, int16_t* dst_row )
+{
+	const uint32_t taps     = r->horizontal.taps;
+	const __m128i zero      = _mm_setzero_si128( );
+	const __m128i half      = _mm_set1_epi32( 1 << (RESAMPLE_HORIZONTAL_SHIFT - 1) );
+	const __m128i interleave = _mm_setr_epi8( 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15 );
+	const __m256i spread    = _mm256_setr_epi32( 0, 0, 0, 0, 1, 1, 1, 1 );
+	uint32_t x, k;
+
+	if( r->byte_count != 4 )
+	{
+		resample_horizontal( r, src_row, dst_row );
+		return;
+	}
 
-	if( !png_ptr )
+	for( x = 0; x < r->dst_width; x++ )
 	{
-		return false;
+		const uint8_t* s = src_row + (size_t) r->horizontal.first[ x ] * 4;
+		const int16_t* w = &r->horizontal.weights[ (size_t) x * taps ];
+		__m256i wide     = _mm256_setzero_si256( );
+		__m128i sum;
+		int32_t pixel;
+
+		for( k = 0; k + 4 <= taps; k += 4 )
+		{
+			__m128i p  = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (s + k * 4) ), interleave );
+			__m256i wk = _mm256_permutevar8x32_epi32( _mm256_castsi128_si256( _mm_loadl_epi64( (const __m128i*) &w[ k ] ) ), spread );
+			wide = _mm256_add_epi32( wide, _mm256_madd_epi16( _mm256_cvtepu8_epi16( p ), wk ) );
+		}
+
+		sum = _mm_add_epi32( _mm256_castsi256_si128( wide ), _mm256_extracti128_si256( wide, 1 ) );
+
+		for( ; k + 1 < taps; k += 2 )
+		{
+			__m128i p = _mm_loadl_epi64( (const __m128i*) (s + k * 4) );
+			int32_t weights;
+
+			memcpy( &weights, &w[ k ], sizeof(weights) );
+			p   = _mm_cvtepu8_epi16( _mm_shuffle_epi8( p, interleave ) );
+			sum = _mm_add_epi32( sum, _mm_madd_epi16( p, _mm_set1_epi32( weights ) ) );
+		}
+
+		if( k < taps )
+		{
+			memcpy( &pixel, s + k * 4, sizeof(pixel) );
+			sum = _mm_add_epi32( sum, _mm_madd_epi16( _mm_cvtepu8_epi32( _mm_cvtsi32_si128( pixel ) ), _mm_set1_epi32( (uint16_t) w[ k ] ) ) );
+		}
+
+		sum = _mm_srai_epi32( _mm_add_epi32( sum, half ), RESAMPLE_HORIZONTAL_SHIFT );
+		_mm_storel_epi64( (__m128i*) (dst_row + (size_t) x * 4), _mm_packs_epi32( sum, zero ) );
 	}
+}
+#endif
 
-	info_ptr = png_create_info_struct( png_ptr );
-	if( !info_ptr )
+static void resample_vertical_row( const int16_t* const* rows, const int16_t* w, uint32_t taps, int32_t* accum, uint8_t* dst_row, size_t row_size )
+{
+	size_t i, block;
+	uint32_t k;
+
+	/* Accumulate in blocks small enough to stay in L1. */
+	for( block = 0; block < row_size; block += RESAMPLE_BLOCK )
 	{
-        png_destroy_read_struct( &png_ptr, (png_infopp) NULL, (png_infopp) NULL );
-		fclose( file );
-		return false;
+		size_t count = row_size - block < RESAMPLE_BLOCK ? row_size - block : RESAMPLE_BLOCK;
+
+		for( i = 0; i < count; i++ )
+		{
+			accum[ i ] = 0;
+		}
+
+		for( k = 0; k + 1 < taps; k += 2 )
+		{
+			const int16_t* row0 = rows[ k ] + block;
+			const int16_t* row1 = rows[ k + 1 ] + block;
+			int32_t weight0     = w[ k ];
+			int32_t weight1     = w[ k + 1 ];
+
+			for( i = 0; i < count; i++ )
+			{
+				accum[ i ] += row0[ i ] * weight0 + row1[ i ] * weight1;
+			}
+		}
+
+		if( k < taps )
+		{
+			const int16_t* row = rows[ k ] + block;
+			int32_t weight     = w[ k ];
+
+			for( i = 0; i < count; i++ )
+			{
+				accum[ i ] += row[ i ] * weight;
+			}
+		}
+
+		for( i = 0; i < count; i++ )
+		{
+			dst_row[ block + i ] = resample_clamp( accum[ i ] );
+		}
 	}
+}
 
-	if( setjmp(png_jmpbuf(png_ptr)) )
+/* Finishes the bytes the vector loops leave over. */
+static void resample_vertical_tail( const int16_t* const* rows, const int16_t* w, uint32_t taps, uint8_t* dst_row, size_t i, size_t row_size )
+{
+	uint32_t k;
+
+	for( ; i < row_size; i++ )
 	{
-        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
-		fclose( file );
-		return false;
+		int32_t sum = 0;
+
+		for( k = 0; k < taps; k++ )
+		{
+			sum += rows[ k ][ i ] * w[ k ];
+		}
+
+		dst_row[ i ] = resample_clamp( sum );
 	}
+}
 
-	png_init_io( png_ptr, file );
-	png_set_sig_bytes( png_ptr, sizeof(header) );
+#if defined(IMAGEIO_X86)
+/* 16 bytes at a time with the sums kept in registers across all taps. */
+TARGET_SSE2
+static void resample_vertical_row_sse2( const int16_t* const* rows, const int16_t* w, uint32_t taps, int32_t* accum, uint8_t* dst_row, size_t row_size )
+{
+	const __m128i zero = _mm_setzero_si128( );
+	const __m128i half = _mm_set1_epi32( 1 << (RESAMPLE_VERTICAL_SHIFT - 1) );
+	size_t i = 0;
+	uint32_t k;
 
-	png_read_info( png_ptr, info_ptr );
+	(void) accum;
 
-	//png_uint_32 width, height;
-	//int bits_per_channel, color_type, interlace_type;
-	//png_get_IHDR( png_ptr, info_ptr, &width, &height, &bits_per_channel, &color_type, &interlace_type, NULL, NULL );
+	for( ; i + 16 <= row_size; i += 16 )
+	{
+		__m128i s0 = half, s1 = half, s2 = half, s3 = half;
 
-	//png_byte interlace_type   = png_get_interlace_type( png_ptr, info_ptr );
-	png_byte color_type       = png_get_color_type( png_ptr, info_ptr );
-	png_byte bits_per_channel = png_get_bit_depth( png_ptr, info_ptr );
+		for( k = 0; k < taps; k += 2 )
+		{
+			__m128i a0 = _mm_loadu_si128( (const __m128i*) (rows[ k ] + i) );
+			__m128i a1 = _mm_loadu_si128( (const __m128i*) (rows[ k ] + i + 8) );
+			__m128i b0 = k + 1 < taps ? _mm_loadu_si128( (const __m128i*) (rows[ k + 1 ] + i) ) : zero;
+			__m128i b1 = k + 1 < taps ? _mm_loadu_si128( (const __m128i*) (rows[ k + 1 ] + i + 8) ) : zero;
+			__m128i wk = _mm_set1_epi32( (int32_t) ((uint16_t) w[ k ] | (k + 1 < taps ? (uint32_t) (uint16_t) w[ k + 1 ] << 16 : 0)) );
+
+			s0 = _mm_add_epi32( s0, _mm_madd_epi16( _mm_unpacklo_epi16( a0, b0 ), wk ) );
+			s1 = _mm_add_epi32( s1, _mm_madd_epi16( _mm_unpackhi_epi16( a0, b0 ), wk ) );
+			s2 = _mm_add_epi32( s2, _mm_madd_epi16( _mm_unpacklo_epi16( a1, b1 ), wk ) );
+			s3 = _mm_add_epi32( s3, _mm_madd_epi16( _mm_unpackhi_epi16( a1, b1 ), wk ) );
+		}
 
-	image->width  = png_get_image_width( png_ptr, info_ptr );
-	image->height = png_get_image_height( png_ptr, info_ptr );
+		s0 = _mm_packs_epi32( _mm_srai_epi32( s0, RESAMPLE_VERTICAL_SHIFT ), _mm_srai_epi32( s1, RESAMPLE_VERTICAL_SHIFT ) );
+		s2 = _mm_packs_epi32( _mm_srai_epi32( s2, RESAMPLE_VERTICAL_SHIFT ), _mm_srai_epi32( s3, RESAMPLE_VERTICAL_SHIFT ) );
+		_mm_storeu_si128( (__m128i*) (dst_row + i), _mm_packus_epi16( s0, s2 ) );
+	}
 
-	switch( color_type )
+	resample_vertical_tail( rows, w, taps, dst_row, i, row_size );
+}
+
+TARGET_AVX2
+static void resample_vertical_row_avx2( const int16_t* const* rows, const int16_t* w, uint32_t taps, int32_t* accum, uint8_t* dst_row, size_t row_size )
+{
+	const __m256i zero = _mm256_setzero_si256( );
+	const __m256i half = _mm256_set1_epi32( 1 << (RESAMPLE_VERTICAL_SHIFT - 1) );
+	size_t i = 0;
+	uint32_t k;
+
+	(void) accum;
+
+	for( ; i + 32 <= row_size; i += 32 )
 	{
-		case PNG_COLOR_TYPE_PALETTE:
-      		png_set_palette_to_rgb( png_ptr );
+		__m256i s0 = half, s1 = half, s2 = half, s3 = half;
 
-			/* expanded to RGB */
-			image->bit_depth = 3 * bits_per_channel; //png_get_bit_depth( png_ptr, info_ptr );
-			image->channels  = 3;
-			break;
-		case PNG_COLOR_TYPE_RGB:
-			image->bit_depth = 3 * bits_per_channel; //png_get_bit_depth( png_ptr, info_ptr );
-			image->channels  = 3;
-			break;
-		case PNG_COLOR_TYPE_RGB_ALPHA:
-			image->bit_depth = 4 * bits_per_channel; //png_get_bit_depth( png_ptr, info_ptr );
-			image->channels  = 4;
-			break;
-		default:
-			/* paletted types and grayscale not supported */
-			png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
-			fclose( file );
-			return false;
+		for( k = 0; k < taps; k += 2 )
+		{
+			__m256i a0 = _mm256_loadu_si256( (const __m256i*) (rows[ k ] + i) );
+			__m256i a1 = _mm256_loadu_si256( (const __m256i*) (rows[ k ] + i + 16) );
+			__m256i b0 = k + 1 < taps ? _mm256_loadu_si256( (const __m256i*) (rows[ k + 1 ] + i) ) : zero;
+			__m256i b1 = k + 1 < taps ? _mm256_loadu_si256( (const __m256i*) (rows[ k + 1 ] + i + 16) ) : zero;
+			__m256i wk = _mm256_set1_epi32( (int32_t) ((uint16_t) w[ k ] | (k + 1 < taps ? (uint32_t) (uint16_t) w[ k + 1 ] << 16 : 0)) );
+
+			s0 = _mm256_add_epi32( s0, _mm256_madd_epi16( _mm256_unpacklo_epi16( a0, b0 ), wk ) );
+			s1 = _mm256_add_epi32( s1, _mm256_madd_epi16( _mm256_unpackhi_epi16( a0, b0 ), wk ) );
+			s2 = _mm256_add_epi32( s2, _mm256_madd_epi16( _mm256_unpacklo_epi16( a1, b1 ), wk ) );
+			s3 = _mm256_add_epi32( s3, _mm256_madd_epi16( _mm256_unpackhi_epi16( a1, b1 ), wk ) );
+		}
+
+		/* unpack and pack stay within 128-bit lanes, so both packs bring back
+		 * pixels 0-15 and 16-31 in order and only the last one needs fixing */
+		s0 = _mm256_packs_epi32( _mm256_srai_epi32( s0, RESAMPLE_VERTICAL_SHIFT ), _mm256_srai_epi32( s1, RESAMPLE_VERTICAL_SHIFT ) );
+		s2 = _mm256_packs_epi32( _mm256_srai_epi32( s2, RESAMPLE_VERTICAL_SHIFT ), _mm256_srai_epi32( s3, RESAMPLE_VERTICAL_SHIFT ) );
+		_mm256_storeu_si256( (__m256i*) (dst_row + i), _mm256_permute4x64_epi64( _mm256_packus_epi16( s0, s2 ), 0xD8 ) );
 	}
 
-	#if 0
-	int screen_gamma = PNG_DEFAULT_sRGB;  /* A good guess for a PC monitor */
-	int intent;
+	resample_vertical_tail( rows, w, taps, dst_row, i, row_size );
+}
+#endif
 
-	if( png_get_sRGB( png_ptr, info_ptr, &intent ) != 0 )
+static void resample_vertical( const resample_t* r, const cpu_kernels_t* kernels, resample_scratch_t* scratch, const uint8_t* src_bitmap, size_t src_pitch, uint32_t y, uint8_t* dst_row )
+{
+	const uint32_t taps    = r->vertical.taps;
+	const uint32_t first   = r->vertical.first[ y ];
+	const size_t row_size  = (size_t) r->dst_width * r->byte_count;
+	uint32_t k;
+
+	/* Windows only ever move forward, so each source row is
+	 * filtered horizontally at most once.
+	 */
+	for( k = 0; k < taps; k++ )
 	{
-		png_set_gamma( png_ptr, screen_gamma, PNG_DEFAULT_sRGB );
+		uint32_t src_y = first + k;
+		uint32_t slot  = src_y % taps;
+
+		if( scratch->ring_rows[ slot ] != (int32_t) src_y )
+		{
+			kernels->resample_horizontal( r, src_bitmap + src_y * src_pitch, scratch->ring + slot * row_size );
+			scratch->ring_rows[ slot ] = src_y;
+		}
+
+		scratch->rows[ k ] = scratch->ring + slot * row_size;
 	}
-	else
+
+	kernels->resample_vertical( scratch->rows, &r->vertical.weights[ (size_t) y * taps ], taps, scratch->accum, dst_row, row_size );
+}
+
+/* Produces output rows [first, last) using one band's scratch rows. */
+static void resample_execute( const resample_t* r, resample_scratch_t* scratch, const uint8_t* src_bitmap, size_t src_pitch, uint8_t* dst_bitmap, size_t dst_pitch, uint32_t first, uint32_t last )
+{
+	const cpu_kernels_t* kernels = cpu_kernels( );
+	uint32_t y;
+
+	for( y = 0; y < r->vertical.taps; y++ )
 	{
-		double image_gamma;
-		if( png_get_gAMA( png_ptr, info_ptr, &image_gamma ) != 0 )
+		scratch->ring_rows[ y ] = -1;
+	}
+
+	for( y = first; y < last; y++ )
+	{
+		resample_vertical( r, kernels, scratch, src_bitmap, src_pitch, y, dst_bitmap + y * dst_pitch );
+	}
+}
+
+/*
+ * Feeds source row src_y (rows come in order, each once) and writes every
+ * output row from next_y on whose window is now complete. Returns the
+ * next output row still waiting. Windows only move forward, so a row is
+ * never needed again once taps newer rows have been pushed over its slot.
+ */
+static uint32_t resample_push_row( const resample_t* r, resample_scratch_t* scratch, const uint8_t* src_row, uint32_t src_y, uint32_t next_y, uint8_t* dst_bitmap, size_t dst_pitch )
+{
+	const cpu_kernels_t* kernels = cpu_kernels( );
+	const uint32_t taps          = r->vertical.taps;
+	const size_t row_size        = (size_t) r->dst_width * r->byte_count;
+	uint32_t k;
+
+	kernels->resample_horizontal( r, src_row, scratch->ring + (src_y % taps) * row_size );
+
+	while( next_y < r->dst_height && r->vertical.first[ next_y ] + taps - 1 <= src_y )
+	{
+		for( k = 0; k < taps; k++ )
 		{
-			png_set_gamma( png_ptr, screen_gamma, image_gamma );
+			scratch->rows[ k ] = scratch->ring + ((r->vertical.first[ next_y ] + k) % taps) * row_size;
 		}
-		else
+
+		kernels->resample_vertical( scratch->rows, &r->vertical.weights[ (size_t) next_y * taps ], taps, scratch->accum, dst_bitmap + next_y * dst_pitch, row_size );
+		next_y++;
+	}
+
+	return next_y;
+}
+
+/*
+ *  Thumbnails. Rows from a reader are summed into boxes of factor x factor
+ *  source pixels. The box factor is the largest whole one that doesn't go
+ *  below the requested size, so whatever is left (less than 2x) is done by
+ *  a Catmull-Rom resample that takes each row of boxes as it is finished.
+ *  Only one source row, one row of boxes, the resampler's ring of rows and
+ *  the thumbnail itself are ever in memory.
+ */
+static void thumbnail_sum_row( uint64_t* sums, const uint8_t* row, uint32_t width, uint32_t channels, uint32_t sample_bytes, uint32_t factor )
+{
+	uint32_t x = 0;
+	uint32_t c;
+
+	while( x < width )
+	{
+		uint32_t last = width - x < factor ? width : x + factor;
+
+		for( ; x < last; x++ )
 		{
-			png_set_gamma( png_ptr, screen_gamma, 0.45455 );
+			const uint8_t* pixel = row + (size_t) x * channels * sample_bytes;
+
+			for( c = 0; c < channels; c++ )
+			{
+				/* libpng hands out 16-bit samples big-endian */
+				sums[ c ] += sample_bytes == 2 ? (uint32_t) (pixel[ 2 * c ] << 8 | pixel[ 2 * c + 1 ]) : pixel[ c ];
+			}
 		}
+
+		sums += channels;
 	}
-	#endif
-	#if 0
-	if( (color_type & PNG_COLOR_MASK_COLOR) != 0 )
+}
+
+static void thumbnail_emit_row( uint64_t* sums, uint8_t* dst, uint32_t width, uint32_t channels, uint32_t sample_bytes, uint32_t factor, uint32_t rows )
+{
+	uint32_t box_width = (width + factor - 1) / factor;
+	uint32_t bx;
+	uint32_t c;
+
+	for( bx = 0; bx < box_width; bx++ )
 	{
-		/* Flip the RGB pixels to BGR (or RGBA to BGRA) */
-		png_set_bgr(png_ptr);
+		uint32_t columns = bx + 1 < box_width ? factor : width - bx * factor;
+		uint64_t count   = (uint64_t) columns * rows;
+
+		for( c = 0; c < channels; c++ )
+		{
+			uint64_t mean = (sums[ c ] + count / 2) / count;
+			dst[ c ] = (uint8_t) (sample_bytes == 2 ? mean >> 8 : mean);
+			sums[ c ] = 0;
+		}
+
+		sums += channels;
+		dst  += channels;
 	}
-	#endif
+}
 
-	/*number_of_passes = png_set_interlace_handling( png_ptr );*/
-	png_read_update_info( png_ptr, info_ptr);
+bool imageio_load_thumbnail_io( image_t* img, imageio_io_t* io, image_file_format_t format, uint32_t max_width, uint32_t max_height )
+{
+	imageio_reader_t* reader = imageio_reader_open_io( io, format, NULL );
+	const imageio_info_t* info;
+	uint32_t channels, sample_bytes, factor, dst_width, dst_height, box_width, box_height, y, next_y = 0;
+	uint64_t* sums = NULL;
+	uint8_t* row = NULL;
+	uint8_t* boxes = NULL;
+	bool resampled;
+	resample_t resample;
+
+	memset( img, 0, sizeof(image_t) );
+	memset( &resample, 0, sizeof(resample) );
+
+	if( !reader || max_width == 0 || max_height == 0 )
+	{
+		goto failure;
+	}
 
-    png_size_t row_bytes = png_get_rowbytes( png_ptr, info_ptr );
+	info         = imageio_reader_info( reader );
+	channels     = info->channels;
+	sample_bytes = info->bit_depth / (channels * 8);
 
-	image->pixels = malloc( row_bytes * image->height * sizeof(png_byte) );
+	if( sample_bytes != 1 && sample_bytes != 2 )
+	{
+		goto failure;
+	}
 
-    if( !image->pixels )
-    {
-        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
-        fclose( file );
-        return false;
-    }
+	if( info->width <= max_width && info->height <= max_height )
+	{
+		dst_width  = info->width;
+		dst_height = info->height;
+	}
+	else if( (uint64_t) info->width * max_height >= (uint64_t) info->height * max_width )
+	{
+		dst_width  = max_width;
+		dst_height = (uint32_t) (((uint64_t) info->height * max_width + info->width / 2) / info->width);
+	}
+	else
+	{
+		dst_height = max_height;
+		dst_width  = (uint32_t) (((uint64_t) info->width * max_height + info->height / 2) / info->height);
+	}
 
-    /* row_pointers is for pointing to image->pixels for reading the png with libpng */
-    png_bytep* row_pointers = malloc( image->height * sizeof(png_bytep) );
+	if( dst_width == 0 ) dst_width = 1;
+	if( dst_height == 0 ) dst_height = 1;
+
+	factor     = info->width / dst_width < info->height / dst_height ? info->width / dst_width : info->height / dst_height;
+	box_width  = (info->width + factor - 1) / factor;
+	box_height = (info->height + factor - 1) / factor;
+	resampled  = box_width != dst_width || box_height != dst_height;
 
-    if( !row_pointers )
-    {
-        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
-        free( image->pixels );
-        fclose( file );
-        return false;
-    }
+	sums = (uint64_t*) imageio_calloc( (size_t) box_width * channels, sizeof(uint64_t) );
+	row  = (uint8_t*) imageio_malloc( (size_t) info->width * channels * sample_bytes );
 
-	/* set the individual row_pointers to point at the correct offsets of image->pixels */
-    int i;
-    for( i = 0; i < image->height; i++ )
-    {
-        row_pointers[ i ] = image->pixels + i * row_bytes;
-    }
+	if( !sums || !row || !imageio_image_create( img, dst_width, dst_height, channels << 3 ) )
+	{
+		goto failure;
+	}
 
-	if( setjmp(png_jmpbuf(png_ptr)) )
+	if( resampled &&
+	    (!(boxes = (uint8_t*) imageio_malloc( (size_t) box_width * channels )) ||
+	     !resample_create( &resample, box_width, box_height, dst_width, dst_height, channels, ALG_CATMULL_ROM, 1 )) )
 	{
-        png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
-		free( row_pointers );
-        free( image->pixels );
-        fclose( file );
-		return false;
+		goto failure;
 	}
 
-	png_read_image( png_ptr, row_pointers );
+	for( y = 0; y < info->height; y++ )
+	{
+		if( imageio_reader_read_rows( reader, row, 0, 1 ) != 1 )
+		{
+			goto failure;
+		}
 
-	free( row_pointers );
-	png_read_end( png_ptr, info_ptr );
-    png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
-	fclose( file );
+		thumbnail_sum_row( sums, row, info->width, channels, sample_bytes, factor );
+
+		if( (y + 1) % factor == 0 || y + 1 == info->height )
+		{
+			if( resampled )
+			{
+				thumbnail_emit_row( sums, boxes, info->width, channels, sample_bytes, factor, y % factor + 1 );
+				next_y = resample_push_row( &resample, &resample.scratch[ 0 ], boxes, y / factor, next_y, img->pixels, img->stride );
+			}
+			else
+			{
+				thumbnail_emit_row( sums, img->pixels + (size_t) (y / factor) * img->stride, info->width, channels, sample_bytes, factor, y % factor + 1 );
+			}
+		}
+	}
 
+	resample_destroy( &resample );
+	imageio_free( boxes );
+	imageio_free( row );
+	imageio_free( sums );
+	imageio_reader_close( reader );
 	return true;
+
+failure:
+	imageio_image_destroy( img );
+	memset( img, 0, sizeof(image_t) );
+	resample_destroy( &resample );
+	imageio_free( boxes );
+	imageio_free( row );
+	imageio_free( sums );
+	imageio_reader_close( reader );
+	return false;
 }
 
-bool imageio_png_save( const char* filename, const image_t* image )
+bool imageio_load_thumbnail( image_t* img, const char* filename, uint32_t max_width, uint32_t max_height )
 {
-	png_structp png_ptr;
-	png_infop info_ptr;
-	FILE *file;
+	bool result = false;
+	image_file_format_t format = IMAGEIO_PNG;
+	imageio_io_t io;
+	FILE* file = fopen( filename, "rb" );
 
-	if( !image )
+	if( !file )
 	{
+		memset( img, 0, sizeof(image_t) );
 		return false;
 	}
 
-	/* create file */
-	file = fopen( filename, "wb" );
-
-	if( !file )
+	if( format_from_file( file, filename, &format ) )
 	{
-		return false;
+		file_io( &io, file );
+		result = imageio_load_thumbnail_io( img, &io, format, max_width, max_height );
+	}
+	else
+	{
+		memset( img, 0, sizeof(image_t) );
 	}
 
-	/* initialize stuff */
-	png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+	fclose( file );
+	return result;
+}
 
-	if( !png_ptr )
+/*
+ *  Resize plans. Everything that only depends on the geometry (coordinate
+ *  tables, filter weights and scratch rows) is computed when the plan is
+ *  created so that executing it does not allocate.
+ */
+struct imageio_resize_plan {
+	resize_algorithm_t algorithm;
+	uint32_t src_width;
+	uint32_t src_height;
+	uint32_t dst_width;
+	uint32_t dst_height;
+	uint32_t byte_count;
+	uint32_t* columns;          /* source byte offset of each output column (sharper: left, center, right) */
+	uint32_t* rows;             /* source row of each output row (sharper: above, center, below) */
+	uint16_t* column_weights;   /* bilinear: weight of the right hand column */
+	uint16_t* row_weights;      /* bilinear: weight of the bottom row */
+	resample_t resample;
+};
+
+static void resize_plan_nearest_neighbor( const imageio_resize_plan_t* plan, const uint8_t* src_bitmap, size_t src_pitch, uint8_t* dst_bitmap, size_t dst_pitch, uint32_t first, uint32_t last )
+{
+	const uint32_t byte_count = plan->byte_count;
+	uint32_t x, y;
+
+	for( y = first; y < last; y++ )
 	{
-		return false;
+		const uint8_t* src_row = src_bitmap + plan->rows[ y ] * src_pitch;
+		uint8_t* dst_row       = dst_bitmap + y * dst_pitch;
+
+		switch( byte_count )
+		{
+			case 4:
+				for( x = 0; x < plan->dst_width; x++ )
+				{
+					memcpy( &dst_row[ x * 4 ], &src_row[ plan->columns[ x ] ], 4 );
+				}
+				break;
+			case 3:
+				for( x = 0; x < plan->dst_width; x++ )
+				{
+					memcpy( &dst_row[ x * 3 ], &src_row[ plan->columns[ x ] ], 3 );
+				}
+				break;
+			default:
+				for( x = 0; x < plan->dst_width; x++ )
+				{
+					memcpy( &dst_row[ x * byte_count ], &src_row[ plan->columns[ x ] ], byte_count );
+				}
+				break;
+		}
 	}
+}
 
-	info_ptr = png_create_info_struct( png_ptr );
+/*
+ * The sharper bilinear resize averages the source pixel under each output
+ * pixel with the average of its four diagonal neighbours:
+ *
+ *   d = (4 * center + above_left + above_right + below_left + below_right) >> 3
+ *
+ * Neighbours past an edge are clamped to the edge.
+ */
+static void resize_plan_sharper_coordinates( uint32_t src_size, uint32_t dst_size, uint32_t* coordinates, uint32_t scale )
+{
+	float stretch = (float) src_size / (float) dst_size;
+	uint32_t i;
 
-	if( !info_ptr)
+	for( i = 0; i < dst_size; i++ )
 	{
-        png_destroy_write_struct( &png_ptr, (png_infopp) NULL );
-		fclose( file );
+		uint32_t center = (uint32_t) (i * stretch);
+
+		if( center > src_size - 1 )
+		{
+			center = src_size - 1;
+		}
+
+		coordinates[ 3 * i + 0 ] = (center > 0 ? center - 1 : 0) * scale;
+		coordinates[ 3 * i + 1 ] = center * scale;
+		coordinates[ 3 * i + 2 ] = (center + 1 < src_size ? center + 1 : center) * scale;
 	}
+}
 
-	if( setjmp(png_jmpbuf(png_ptr)))
+static void resize_plan_sharper( const imageio_resize_plan_t* plan, const uint8_t* src_bitmap, size_t src_pitch, uint8_t* dst_bitmap, size_t dst_pitch, uint32_t first, uint32_t last )
+{
+	const uint32_t byte_count = plan->byte_count;
+	uint32_t x, y, c;
+
+	for( y = first; y < last; y++ )
 	{
-        png_destroy_write_struct( &png_ptr, &info_ptr );
-		fclose( file );
-		return false;
-	}
+		const uint8_t* above  = src_bitmap + plan->rows[ 3 * y + 0 ] * src_pitch;
+		const uint8_t* center = src_bitmap + plan->rows[ 3 * y + 1 ] * src_pitch;
+		const uint8_t* below  = src_bitmap + plan->rows[ 3 * y + 2 ] * src_pitch;
+		uint8_t* dst_row      = dst_bitmap + y * dst_pitch;
+
+		for( x = 0; x < plan->dst_width; x++ )
+		{
+			const uint32_t* columns = &plan->columns[ 3 * x ];
 
-	png_init_io( png_ptr, file );
+			for( c = 0; c < byte_count; c++ )
+			{
+				uint32_t sum = 4 * center[ columns[ 1 ] + c ] +
+				               above[ columns[ 0 ] + c ] + above[ columns[ 2 ] + c ] +
+				               below[ columns[ 0 ] + c ] + below[ columns[ 2 ] + c ];
 
-	int bit_depth       = 8;
-	int color_type      = PNG_COLOR_TYPE_RGB_ALPHA;
-	int bytes_per_pixel = image->bit_depth >> 3;
+				dst_row[ x * byte_count + c ] = (uint8_t) (sum >> 3);
+			}
+		}
+	}
+}
 
+/*
+ * Bilinear sampling at the true fractional source position. Coordinates are
+ * computed in 16.16 fixed-point when the plan is created and the weights
+ * are reduced to 8 bits, so every output channel is
+ *
+ *   v = (top * (256 - fy) + bottom * fy + 128) >> 8
+ *   d = (left_v * (256 - fx) + right_v * fx + 128) >> 8
+ *
+ * which fits in 16 bits and lets the SSE2 path produce the same bytes as
+ * the scalar path.
+ */
+static void resize_plan_bilinear_coordinates( uint32_t src_size, uint32_t dst_size, uint32_t* first, uint16_t* weights )
+{
+	uint32_t i;
 
-	switch( bytes_per_pixel )
+	for( i = 0; i < dst_size; i++ )
 	{
-		case 4:
+		/* center of output pixel i in source space, minus half a pixel; the
+		 * division is split so the 16.16 shift cannot overflow */
+		uint64_t n = (2 * (uint64_t) i + 1) * src_size;
+		uint64_t d = 2 * (uint64_t) dst_size;
+		int64_t s = (int64_t) (((n / d) << 16) + (((n % d) << 16) / d)) - (1 << 15);
+		uint32_t p;
+		uint16_t f;
 
-			color_type = PNG_COLOR_TYPE_RGB_ALPHA;
-			break;
-		case 3:
-		case 2:
-			color_type = PNG_COLOR_TYPE_RGB;
-			break;
-		case 1:
-			color_type = PNG_COLOR_TYPE_GRAY;
-			break;
-		default:
-			png_destroy_write_struct( &png_ptr, &info_ptr );
-			fclose( file );
-			return false;
-	}
+		if( s < 0 ) s = 0;
 
+		p = (uint32_t) (s >> 16);
+		f = (uint16_t) ((s >> 8) & 0xFF);
 
-	png_set_IHDR( png_ptr, info_ptr, image->width, image->height,
-	              bit_depth, color_type, PNG_INTERLACE_NONE,
-	              PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
+		if( src_size < 2 )
+		{
+			p = 0;
+			f = 0;
+		}
+		else if( p >= src_size - 1 )
+		{
+			/* keep both taps inside the source */
+			p = src_size - 2;
+			f = 256;
+		}
 
-	png_write_info( png_ptr, info_ptr );
+		first[ i ]   = p;
+		weights[ i ] = f;
+	}
+}
 
-    /* row_pointers is for pointing to image->pixels for reading the png with libpng */
-    png_bytep* row_pointers = malloc( image->height * sizeof(png_bytep) );
+static void resize_plan_bilinear_row( const imageio_resize_plan_t* plan, const uint8_t* top, const uint8_t* bottom, uint32_t fy, uint8_t* dst_row, uint32_t x )
+{
+	const uint32_t byte_count = plan->byte_count;
+	const uint32_t next       = plan->src_width > 1 ? byte_count : 0;
+	uint32_t c;
 
-    if( !row_pointers )
-    {
-		png_destroy_write_struct( &png_ptr, &info_ptr );
-        fclose( file );
-        return false;
-    }
+	for( ; x < plan->dst_width; x++ )
+	{
+		uint32_t offset = plan->columns[ x ];
+		uint32_t fx     = plan->column_weights[ x ];
+		uint8_t* d      = dst_row + x * byte_count;
 
-	/* set the individual row_pointers to point at the correct offsets of image->pixels */
-	int row_bytes = image->width * bytes_per_pixel;
-    int i;
-    for( i = 0; i < image->height; i++ )
-    {
-        //row_pointers[ image->height - 1 - i] = image->pixels + i * row_bytes;
-        row_pointers[ i ] = image->pixels + i * row_bytes;
-    }
+		for( c = 0; c < byte_count; c++ )
+		{
+			uint32_t left  = (top[ offset + c ] * (256 - fy) + bottom[ offset + c ] * fy + 128) >> 8;
+			uint32_t right = (top[ offset + next + c ] * (256 - fy) + bottom[ offset + next + c ] * fy + 128) >> 8;
+			d[ c ] = (uint8_t) ((left * (256 - fx) + right * fx + 128) >> 8);
+		}
+	}
+}
 
-	if( setjmp(png_jmpbuf(png_ptr)))
+#if defined(IMAGEIO_X86)
+TARGET_SSE2
+static __inline __m128i resize_bilinear_rgba_sse2( const uint8_t* top, const uint8_t* bottom, __m128i wy0, __m128i wy1, uint32_t fx )
+{
+	const __m128i zero = _mm_setzero_si128( );
+	const __m128i half = _mm_set1_epi16( 128 );
+	__m128i t  = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) top ), zero );
+	__m128i b  = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) bottom ), zero );
+	__m128i wx = _mm_unpacklo_epi64( _mm_set1_epi16( (short) (256 - fx) ), _mm_set1_epi16( (short) fx ) );
+	/* [left, right] pixels blended vertically */
+	__m128i v  = _mm_srli_epi16( _mm_add_epi16( _mm_add_epi16( _mm_mullo_epi16( t, wy0 ), _mm_mullo_epi16( b, wy1 ) ), half ), 8 );
+	/* weight left and right; the sum lands in the low four lanes */
+	__m128i h  = _mm_mullo_epi16( v, wx );
+	return _mm_add_epi16( _mm_add_epi16( h, _mm_srli_si128( h, 8 ) ), half );
+}
+
+TARGET_SSE2
+static uint32_t resize_plan_bilinear_row_rgba_sse2( const imageio_resize_plan_t* plan, const uint8_t* top, const uint8_t* bottom, uint32_t fy, uint8_t* dst_row )
+{
+	const __m128i wy0 = _mm_set1_epi16( (short) (256 - fy) );
+	const __m128i wy1 = _mm_set1_epi16( (short) fy );
+	uint32_t x = 0;
+
+	/* two output pixels per iteration */
+	for( ; x + 2 <= plan->dst_width; x += 2 )
 	{
-		png_destroy_write_struct( &png_ptr, &info_ptr );
-		free( row_pointers );
-		fclose( file );
-		return false;
+		__m128i a = resize_bilinear_rgba_sse2( top + plan->columns[ x ], bottom + plan->columns[ x ], wy0, wy1, plan->column_weights[ x ] );
+		__m128i b = resize_bilinear_rgba_sse2( top + plan->columns[ x + 1 ], bottom + plan->columns[ x + 1 ], wy0, wy1, plan->column_weights[ x + 1 ] );
+		__m128i p = _mm_srli_epi16( _mm_unpacklo_epi64( a, b ), 8 );
+		_mm_storel_epi64( (__m128i*) (dst_row + x * 4), _mm_packus_epi16( p, p ) );
 	}
 
-	png_write_image( png_ptr, row_pointers );
-	png_write_end( png_ptr, NULL );
-	png_destroy_write_struct( &png_ptr, &info_ptr );
-	free( row_pointers );
-	fclose( file );
+	return x;
+}
+#endif
 
-	return true;
+static void resize_plan_bilinear( const imageio_resize_plan_t* plan, const uint8_t* src_bitmap, size_t src_pitch, uint8_t* dst_bitmap, size_t dst_pitch, uint32_t first, uint32_t last )
+{
+	const cpu_kernels_t* kernels = cpu_kernels( );
+	uint32_t y;
+
+	for( y = first; y < last; y++ )
+	{
+		const uint8_t* top    = src_bitmap + plan->rows[ y ] * src_pitch;
+		const uint8_t* bottom = plan->src_height > 1 ? top + src_pitch : top;
+		uint32_t fy           = plan->row_weights[ y ];
+		uint8_t* dst_row      = dst_bitmap + y * dst_pitch;
+		uint32_t x            = 0;
+
+		if( kernels->bilinear_row_rgba && plan->byte_count == 4 && plan->src_width > 1 )
+		{
+			x = kernels->bilinear_row_rgba( plan, top, bottom, fy, dst_row );
+		}
+
+		resize_plan_bilinear_row( plan, top, bottom, fy, dst_row, x );
+	}
 }
 
-/*
- *  Image stretching functions...
- */
-void imageio_image_resize( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-                           uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t bit_depth,
-                           resize_algorithm_t algorithm )
+imageio_resize_plan_t* imageio_resize_plan_create( uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height,
+                                                   uint32_t bit_depth, resize_algorithm_t algorithm )
 {
 	uint32_t byte_count = bit_depth >> 3;
-	assert( src_bitmap != NULL || dst_bitmap != NULL );
-	assert( src_width != 0 || src_height != 0 );
-	assert( byte_count > 2 );
+	imageio_resize_plan_t* plan;
+
+	if( src_width == 0 || src_height == 0 || dst_width == 0 || dst_height == 0 || byte_count == 0 )
+	{
+		return NULL;
+	}
+
+	/* column offsets are 32-bit */
+	if( (uint64_t) src_width * byte_count > UINT32_MAX )
+	{
+		return NULL;
+	}
+
+	plan = (imageio_resize_plan_t*) imageio_calloc( 1, sizeof(imageio_resize_plan_t) );
+
+	if( !plan )
+	{
+		return NULL;
+	}
+
+	plan->algorithm  = algorithm;
+	plan->src_width  = src_width;
+	plan->src_height = src_height;
+	plan->dst_width  = dst_width;
+	plan->dst_height = dst_height;
+	plan->byte_count = byte_count;
 
 	switch( algorithm )
 	{
 		case ALG_NEARESTNEIGHBOR:
-			/* forces both bitmaps to have the same bit depth */
-			imageio_resize_nearest_neighbor( src_width, src_height, bit_depth, src_bitmap,
-				             dst_width, dst_height, bit_depth, dst_bitmap );
+		{
+			/* x_in = x_out * (w_in / w_out), in integers so that wide images
+			 * do not lose precision and step past the last column */
+			uint32_t i;
+
+			plan->columns = (uint32_t*) imageio_malloc( sizeof(uint32_t) * dst_width );
+			plan->rows    = (uint32_t*) imageio_malloc( sizeof(uint32_t) * dst_height );
+
+			if( !plan->columns || !plan->rows )
+			{
+				goto failure;
+			}
+
+			for( i = 0; i < dst_width; i++ )
+			{
+				plan->columns[ i ] = (uint32_t) ((uint64_t) i * src_width / dst_width) * byte_count;
+			}
+
+			for( i = 0; i < dst_height; i++ )
+			{
+				plan->rows[ i ] = (uint32_t) ((uint64_t) i * src_height / dst_height);
+			}
 			break;
+		}
 		case ALG_BILINEAR:
-			switch( byte_count )
+		{
+			uint32_t i;
+
+			plan->columns        = (uint32_t*) imageio_malloc( sizeof(uint32_t) * dst_width );
+			plan->rows           = (uint32_t*) imageio_malloc( sizeof(uint32_t) * dst_height );
+			plan->column_weights = (uint16_t*) imageio_malloc( sizeof(uint16_t) * dst_width );
+			plan->row_weights    = (uint16_t*) imageio_malloc( sizeof(uint16_t) * dst_height );
+
+			if( !plan->columns || !plan->rows || !plan->column_weights || !plan->row_weights )
+			{
+				goto failure;
+			}
+
+			resize_plan_bilinear_coordinates( src_width, dst_width, plan->columns, plan->column_weights );
+			resize_plan_bilinear_coordinates( src_height, dst_height, plan->rows, plan->row_weights );
+
+			for( i = 0; i < dst_width; i++ )
 			{
-				case 0:
-				case 1:
-				case 2:
-					assert( false ); /* unsupported bit_depth's */
-					break;
-				case 3:
-						imageio_resize_bilinear_rgb( src_width, src_height, src_bitmap, dst_width, dst_height, dst_bitmap, byte_count );
-						break;
-				case 4:
-						imageio_resize_bilinear_rgba( src_width, src_height, src_bitmap, dst_width, dst_height, dst_bitmap, byte_count );
-						break;
-				default: break;
+				plan->columns[ i ] *= byte_count;
 			}
 			break;
+		}
 		case ALG_BILINEAR_SHARPER:
-			switch( byte_count )
+			plan->columns = (uint32_t*) imageio_malloc( sizeof(uint32_t) * 3 * dst_width );
+			plan->rows    = (uint32_t*) imageio_malloc( sizeof(uint32_t) * 3 * dst_height );
+
+			if( !plan->columns || !plan->rows )
 			{
-				case 0:
-				case 1:
-				case 2:
-					assert( false ); /* unsupported bytes per pixels */
-					break;
-				case 3:
-						imageio_resize_bilinear_sharper_rgb( src_width, src_height, src_bitmap, dst_width, dst_height, dst_bitmap, byte_count );
-						break;
-				case 4:
-						imageio_resize_bilinear_sharper_rgba( src_width, src_height, src_bitmap, dst_width, dst_height, dst_bitmap, byte_count );
-						break;
-				default: break;
+				goto failure;
 			}
+
+			resize_plan_sharper_coordinates( src_width, dst_width, plan->columns, byte_count );
+			resize_plan_sharper_coordinates( src_height, dst_height, plan->rows, 1 );
 			break;
 		case ALG_BICUBIC:
-			switch( byte_count )
+		case ALG_LANCZOS3:
+		case ALG_MITCHELL:
+		case ALG_CATMULL_ROM:
+			if( !resample_create( &plan->resample, src_width, src_height, dst_width, dst_height, byte_count, algorithm, imageio_thread_count( ) ) )
 			{
-				case 0:
-				case 1:
-				case 2:
-					assert( false ); /* unsupported bit_depth's */
-					break;
-				case 3:
-						imageio_resize_bicubic_rgb( src_width, src_height, src_bitmap, dst_width, dst_height, dst_bitmap, byte_count );
-						break;
-				case 4:
-						imageio_resize_bicubic_rgba( src_width, src_height, src_bitmap, dst_width, dst_height, dst_bitmap, byte_count );
-						break;
-				default: break;
+				goto failure;
 			}
 			break;
 		default:
-			assert( false ); /* bad algorithm... */
+			goto failure; /* bad algorithm... */
 	}
+
+	return plan;
+
+failure:
+	imageio_resize_plan_destroy( plan );
+	return NULL;
 }
 
-/* uses nearest neighbor... */
-bool imageio_resize_nearest_neighbor( uint32_t src_width, uint32_t src_height, uint32_t srcBitsPerPixel, const uint8_t* src_bitmap,
-                                      uint32_t dst_width, uint32_t dst_height, uint32_t dstBitsPerPixel, uint8_t* dst_bitmap )
+void imageio_resize_plan_destroy( imageio_resize_plan_t* plan )
 {
-	uint32_t srcByteCount = srcBitsPerPixel >> 3;
-	uint32_t dstByteCount = dstBitsPerPixel >> 3;
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	/* uint32_t srcY, srcX;  don't remove */
-	uint32_t dstPos, srcPos;
-	register uint32_t srcYtimesWidth;
-	register uint32_t yTimesWidth;
-
-	assert( srcBitsPerPixel != 0 || dstBitsPerPixel != 0 );
-	assert( src_bitmap != NULL || dst_bitmap != NULL );
-	assert( src_width != 0 || src_height != 0 );
-
-	if( !src_bitmap || !dst_bitmap || srcBitsPerPixel == 0 || dstBitsPerPixel == 0 || src_width == 0 || src_height == 0 )
+	if( plan )
 	{
-		return false;
+		imageio_free( plan->columns );
+		imageio_free( plan->rows );
+		imageio_free( plan->column_weights );
+		imageio_free( plan->row_weights );
+		resample_destroy( &plan->resample );
+		imageio_free( plan );
 	}
+}
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;
-	verticalStretchFactor = (float) src_height / (float) dst_height;
-
-	/* don't remove...
-	 * x_in = x_out * (w_in / w_out), using nearest neighbor
-	 */
-	for( y = 0; y < dst_height; y++ )
-	{
-		srcYtimesWidth = ((uint32_t)(y * verticalStretchFactor)) * src_width * srcByteCount;
-		yTimesWidth = y * dst_width * dstByteCount;
+typedef struct resize_plan_job {
+	imageio_resize_plan_t* plan;
+	const uint8_t* src_bitmap;
+	size_t src_stride;
+	uint8_t* dst_bitmap;
+	size_t dst_stride;
+} resize_plan_job_t;
 
-		for( x = 0; x < dst_width; x++ )
-		{
-			dstPos = yTimesWidth + x * dstByteCount;
-			srcPos = srcYtimesWidth + ((uint32_t)(x * horizontalStretchFactor)) * srcByteCount;
+static void resize_plan_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	resize_plan_job_t* job = (resize_plan_job_t*) context;
+	imageio_resize_plan_t* plan = job->plan;
 
-			memcpy( &dst_bitmap[ dstPos ], &src_bitmap[ srcPos ], dstByteCount * sizeof(uint8_t) );
-		}
+	switch( plan->algorithm )
+	{
+		case ALG_NEARESTNEIGHBOR:
+			resize_plan_nearest_neighbor( plan, job->src_bitmap, job->src_stride, job->dst_bitmap, job->dst_stride, first, last );
+			break;
+		case ALG_BILINEAR:
+			resize_plan_bilinear( plan, job->src_bitmap, job->src_stride, job->dst_bitmap, job->dst_stride, first, last );
+			break;
+		case ALG_BILINEAR_SHARPER:
+			resize_plan_sharper( plan, job->src_bitmap, job->src_stride, job->dst_bitmap, job->dst_stride, first, last );
+			break;
+		default:
+			resample_execute( &plan->resample, &plan->resample.scratch[ band ], job->src_bitmap, job->src_stride, job->dst_bitmap, job->dst_stride, first, last );
+			break;
 	}
+}
 
-	return true;
+bool imageio_resize_plan_execute( imageio_resize_plan_t* plan, const uint8_t* src_bitmap, uint8_t* dst_bitmap )
+{
+	return imageio_resize_plan_execute_stride( plan, src_bitmap, 0, dst_bitmap, 0 );
 }
 
-/* bi-linear: nearest neighbor with bilinear interpolation */
-bool imageio_resize_bilinear_rgba( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-                                   uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap,
-                                   uint32_t byte_count )
+bool imageio_resize_plan_execute_stride( imageio_resize_plan_t* plan, const uint8_t* src_bitmap, size_t src_stride, uint8_t* dst_bitmap, size_t dst_stride )
 {
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	register uint32_t srcY = 0;
-	register uint32_t srcX = 0;
-	register uint32_t dstPos,
-		 neighborPos1,
-		 neighborPos2,
-		 neighborPos3,
-		 neighborPos4;
-	register uint8_t n1R, n1G, n1B, n1A,	/* color vectors */
-				  n2R, n2G, n2B, n2A,
-				  n3R, n3G, n3B, n3A,
-				  n4R, n4G, n4B, n4A;
-	uint32_t largestSrcIndex = src_width * src_height * byte_count;
+	resize_plan_job_t job;
+	uint32_t bands = 0; /* no limit */
 
-	assert( byte_count == 4 );
+	if( !plan || !src_bitmap || !dst_bitmap )
+	{
+		return false;
+	}
+
+	if( src_stride == 0 )
+	{
+		src_stride = (size_t) plan->src_width * plan->byte_count;
+	}
+	if( dst_stride == 0 )
+	{
+		dst_stride = (size_t) plan->dst_width * plan->byte_count;
+	}
 
-	if( !src_bitmap || !dst_bitmap || byte_count != 4 )
+	if( src_stride < (size_t) plan->src_width * plan->byte_count ||
+	    dst_stride < (size_t) plan->dst_width * plan->byte_count )
 	{
 		return false;
 	}
 
+	switch( plan->algorithm )
+	{
+		case ALG_NEARESTNEIGHBOR:
+		case ALG_BILINEAR:
+		case ALG_BILINEAR_SHARPER:
+			break;
+		default:
+			/* each band needs its own ring of scratch rows */
+			bands = plan->resample.scratch_count;
+			break;
+	}
+
+	job.plan       = plan;
+	job.src_bitmap = src_bitmap;
+	job.src_stride = src_stride;
+	job.dst_bitmap = dst_bitmap;
+	job.dst_stride = dst_stride;
+	parallel_rows( plan->dst_height, (size_t) plan->dst_width * plan->byte_count, bands, resize_plan_band, &job );
+	return true;
+}
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;  /* stretch vector */
-	verticalStretchFactor = (float) src_height / (float) dst_height;
-
-	for( y = 0; y < dst_height; y++ )
+static void blit_rows( uint8_t* dst, size_t dst_stride, uint32_t dst_bytes_per_pixel,
+                       const uint8_t* src, size_t src_stride, uint32_t src_bytes_per_pixel,
+                       uint32_t width, uint32_t height )
+{
+	for( size_t y = 0; y < height; y++ )
 	{
-		srcY = (uint32_t) (y * verticalStretchFactor);
-		if( srcY == 0 ) srcY = 1;
+		uint8_t* dst_row = dst + y * dst_stride;
+		const uint8_t* src_row = src + y * src_stride;
 
-		for( x = 0; x < dst_width; x++ )
+		if( dst_bytes_per_pixel == src_bytes_per_pixel )
 		{
-			srcX = (uint32_t) (x * horizontalStretchFactor);
-			dstPos = y * dst_width * byte_count + x * byte_count;
-
-			neighborPos1 = (srcY) * src_width * byte_count + (srcX) * byte_count;
-			neighborPos2 = (srcY) * src_width * byte_count + (srcX+1) * byte_count;
-			neighborPos3 = (srcY+1) * src_width * byte_count + (srcX) * byte_count;
-			neighborPos4 = (srcY+1) * src_width * byte_count + (srcX+1) * byte_count;
-			if( neighborPos1 >= largestSrcIndex ) neighborPos1 = largestSrcIndex - byte_count;
-			if( neighborPos2 >= largestSrcIndex ) neighborPos2 = largestSrcIndex - byte_count;
-			if( neighborPos3 >= largestSrcIndex ) neighborPos3 = largestSrcIndex - byte_count;
-			if( neighborPos4 >= largestSrcIndex ) neighborPos4 = largestSrcIndex - byte_count;
-
-			/* source pixel... */
-			n1R = src_bitmap[ neighborPos1 ];
-			n1G = src_bitmap[ neighborPos1 + 1 ];
-			n1B = src_bitmap[ neighborPos1 + 2 ];
-			n1A = src_bitmap[ neighborPos1 + 3 ];
-
-			/* source pixel's neighbor2... */
-			n2R = src_bitmap[ neighborPos2 ];
-			n2G = src_bitmap[ neighborPos2 + 1 ];
-			n2B = src_bitmap[ neighborPos2 + 2 ];
-			n2A = src_bitmap[ neighborPos2 + 3 ];
-
-			/* source pixel's neighbor3... */
-			n3R = src_bitmap[ neighborPos3 ];
-			n3G = src_bitmap[ neighborPos3 + 1 ];
-			n3B = src_bitmap[ neighborPos3 + 2 ];
-			n3A = src_bitmap[ neighborPos3 + 3 ];
-
-			/* source pixel's neighbor4... */
-			n4R = src_bitmap[ neighborPos4 ];
-			n4G = src_bitmap[ neighborPos4 + 1 ];
-			n4B = src_bitmap[ neighborPos4 + 2 ];
-			n4A = src_bitmap[ neighborPos4 + 3 ];
-
-			dst_bitmap[ dstPos ] = (uint8_t) bilerp( 0.5, 0.5, n4R, n3R, n2R, n1R );
-			dst_bitmap[ dstPos + 1 ] = (uint8_t) bilerp( 0.5, 0.5, n4G, n3G, n2G, n1G );
-			dst_bitmap[ dstPos + 2 ] = (uint8_t) bilerp( 0.5, 0.5, n4B, n3B, n2B, n1B );
-			dst_bitmap[ dstPos + 3 ] = (uint8_t) bilerp( 0.5, 0.5, n4A, n3A, n2A, n1A );
+			memcpy( dst_row, src_row, (size_t) width * src_bytes_per_pixel );
+			continue;
 		}
-	}
 
-	return true;
+		for( size_t x = 0; x < width; x++ )
+		{
+			memcpy( &dst_row[ x * dst_bytes_per_pixel ], &src_row[ x * src_bytes_per_pixel ], src_bytes_per_pixel );
+		}
+	}
 }
 
-bool imageio_resize_bilinear_sharper_rgba( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-									uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap,
-									uint32_t byte_count )
+bool imageio_blit( uint32_t pos_x, uint32_t pos_y,
+                   uint32_t dst_width, uint32_t dst_height, uint32_t dst_bytes_per_pixel, uint8_t* dst_pixels,
+                   uint32_t src_width, uint32_t src_height, uint32_t src_bytes_per_pixel, uint8_t* src_pixels )
 {
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	register uint32_t srcY = 0;
-	register uint32_t srcX = 0;
-	register uint32_t dstPos, srcPos;
-	register int32_t neighborPos1,
-		 neighborPos2,
-		 neighborPos3,
-		 neighborPos4;
-	register uint8_t R, G, B, A,
-			 n1R, n1G, n1B, n1A,	/* color vectors */
-			 n2R, n2G, n2B, n2A,
-			 n3R, n3G, n3B, n3A,
-			 n4R, n4G, n4B, n4A;
-	uint32_t largestSrcIndex = src_width * src_height * byte_count;
-
-	assert( byte_count == 4 );
+	size_t dst_stride = (size_t) dst_width * dst_bytes_per_pixel;
 
-	if( !src_bitmap || !dst_bitmap || byte_count != 4 )
+	if( dst_bytes_per_pixel < src_bytes_per_pixel )
 	{
 		return false;
 	}
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;  /* stretch vector */
-	verticalStretchFactor = (float) src_height / (float) dst_height;
-
-	for( y = 0; y < dst_height; y++ )
-	{
-		srcY = (uint32_t) (y * verticalStretchFactor);
-		if( srcY == 0 ) srcY = 1;
-
-		for( x = 0; x < dst_width; x++ )
-		{
-			srcX = (uint32_t) (x * horizontalStretchFactor);
-			dstPos = y * dst_width * byte_count + x * byte_count;
-
-			neighborPos1 = (srcY-1) * src_width * byte_count + (srcX-1) * byte_count;
-			neighborPos2 = (srcY-1) * src_width * byte_count + (srcX+1) * byte_count;
-			neighborPos3 = (srcY+1) * src_width * byte_count + (srcX-1) * byte_count;
-			neighborPos4 = (srcY+1) * src_width * byte_count + (srcX+1) * byte_count;
-			srcPos = (uint32_t) srcY * src_width * byte_count + srcX * byte_count;
-
-			if( neighborPos1 < 0 ) neighborPos1 = 0;
-			if( neighborPos2 < 0 ) neighborPos2 = 0;
-			if( neighborPos3 < 0 ) neighborPos3 = 0;
-			if( neighborPos4 < 0 ) neighborPos4 = 0;
-			if( neighborPos1 >= largestSrcIndex ) neighborPos1 = largestSrcIndex - byte_count;
-			if( neighborPos2 >= largestSrcIndex ) neighborPos2 = largestSrcIndex - byte_count;
-			if( neighborPos3 >= largestSrcIndex ) neighborPos3 = largestSrcIndex - byte_count;
-			if( neighborPos4 >= largestSrcIndex ) neighborPos4 = largestSrcIndex - byte_count;
-
-			/* source pixel... */
-			R = src_bitmap[ srcPos ];
-			G = src_bitmap[ srcPos + 1 ];
-			B = src_bitmap[ srcPos + 2 ];
-			A = src_bitmap[ srcPos + 3 ];
-
-			/* source pixel's neighbor1... */
-			n1R = src_bitmap[ neighborPos1 ];
-			n1G = src_bitmap[ neighborPos1 + 1 ];
-			n1B = src_bitmap[ neighborPos1 + 2 ];
-			n1A = src_bitmap[ neighborPos1 + 3 ];
-
-			/* source pixel's neighbor2... */
-			n2R = src_bitmap[ neighborPos2 ];
-			n2G = src_bitmap[ neighborPos2 + 1 ];
-			n2B = src_bitmap[ neighborPos2 + 2 ];
-			n2A = src_bitmap[ neighborPos2 + 3 ];
-
-			/* source pixel's neighbor3... */
-			n3R = src_bitmap[ neighborPos3 ];
-			n3G = src_bitmap[ neighborPos3 + 1 ];
-			n3B = src_bitmap[ neighborPos3 + 2 ];
-			n3A = src_bitmap[ neighborPos3 + 3 ];
-
-			/* source pixel's neighbor4... */
-			n4R = src_bitmap[ neighborPos4 ];
-			n4G = src_bitmap[ neighborPos4 + 1 ];
-			n4B = src_bitmap[ neighborPos4 + 2 ];
-			n4A = src_bitmap[ neighborPos4 + 3 ];
-
-			/* comes out a little more burry than I expected, so I lerp between R and the
-			 * output from the bilerp of the other 4 samples.
-			 */
-			dst_bitmap[ dstPos ] = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4R, n3R, n2R, n1R ), R );
-			dst_bitmap[ dstPos + 1 ] = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4G, n3G, n2G, n1G ), G );
-			dst_bitmap[ dstPos + 2 ] = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4B, n3B, n2B, n1B ), B );
-			dst_bitmap[ dstPos + 3 ] = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4A, n3A, n2A, n1A ), A );
-		}
-	}
+	blit_rows( dst_pixels + pos_y * dst_stride + (size_t) pos_x * dst_bytes_per_pixel, dst_stride, dst_bytes_per_pixel,
+	           src_pixels, (size_t) src_width * src_bytes_per_pixel, src_bytes_per_pixel,
+	           src_width, src_height );
 
 	return true;
 }
 
-bool imageio_resize_bilinear_rgb( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-				  uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap,
-				  uint32_t byte_count )
+bool imageio_image_blit( image_t* dst, uint32_t pos_x, uint32_t pos_y, const image_t* src )
 {
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	register uint32_t srcY = 0;
-	register uint32_t srcX = 0;
-	register uint32_t dstPos,
-                  neighborPos1,
-                  neighborPos2,
-                  neighborPos3,
-                  neighborPos4;
-	register uint8_t n1R, n1G, n1B, 	/* color vectors */
-                  n2R, n2G, n2B,
-                  n3R, n3G, n3B,
-                  n4R, n4G, n4B;
+	imageio_view_t dst_view;
+	imageio_view_t src_view;
+
+	return imageio_image_view( &dst_view, dst, 0, 0, dst->width, dst->height ) &&
+	       imageio_image_view( &src_view, src, 0, 0, src->width, src->height ) &&
+	       imageio_blit_view( &dst_view, pos_x, pos_y, &src_view );
+}
 
-	assert( byte_count == 3 );
+bool imageio_blit_view( const imageio_view_t* dst, uint32_t pos_x, uint32_t pos_y, const imageio_view_t* src )
+{
+	imageio_view_t target;
 
-	if( !src_bitmap || !dst_bitmap || byte_count != 3 )
+	if( dst->channels < src->channels ||
+	    !imageio_view_crop( &target, dst, pos_x, pos_y, src->width, src->height ) )
 	{
 		return false;
 	}
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;  /* stretch vector */
-	verticalStretchFactor = (float) src_height / (float) dst_height;
+	blit_rows( target.pixels, target.stride, target.channels,
+	           src->pixels, src->stride, src->channels,
+	           src->width, src->height );
 
+	return true;
+}
 
-	for( y = 0; y < dst_height; y++ )
+/*
+ * When both images have the same channel count, the channel-wise modes
+ * below treat a row as one run of bytes, which is what the SIMD kernels
+ * work on. Every byte is result = channelblend_mode( src, dst ).
+ */
+static bool blend_span_supported( blend_mode_t mode )
+{
+	switch( mode )
 	{
-		srcY = (uint32_t) (y * verticalStretchFactor);
-		assert( srcY < src_height );
-
-		for( x = 0; x < dst_width; x++ )
-		{
-			srcX = (uint32_t) (x * horizontalStretchFactor);
-			dstPos = y * dst_width * byte_count + x * byte_count;
-
-			neighborPos1 = (srcY) * src_width * byte_count + (srcX) * byte_count;
-			neighborPos2 = (srcY) * src_width * byte_count + (srcX+1) * byte_count;
-			neighborPos3 = (srcY+1) * src_width * byte_count + (srcX) * byte_count;
-			neighborPos4 = (srcY+1) * src_width * byte_count + (srcX+1) * byte_count;
-
-			/* source pixel... */
-			n1R = src_bitmap[ neighborPos1 ];
-			n1G = src_bitmap[ neighborPos1 + 1 ];
-			n1B = src_bitmap[ neighborPos1 + 2 ];
-
-			/* source pixel's neighbor2... */
-			n2R = src_bitmap[ neighborPos2 ];
-			n2G = src_bitmap[ neighborPos2 + 1 ];
-			n2B = src_bitmap[ neighborPos2 + 2 ];
-
-			/* source pixel's neighbor3... */
-			n3R = src_bitmap[ neighborPos3 ];
-			n3G = src_bitmap[ neighborPos3 + 1 ];
-			n3B = src_bitmap[ neighborPos3 + 2 ];
-
-			/* source pixel's neighbor4... */
-			n4R = src_bitmap[ neighborPos4 ];
-			n4G = src_bitmap[ neighborPos4 + 1 ];
-			n4B = src_bitmap[ neighborPos4 + 2 ];
-
-			dst_bitmap[ dstPos ]     = (uint8_t) bilerp( 0.5, 0.5, n4R, n3R, n2R, n1R );
-			dst_bitmap[ dstPos + 1 ] = (uint8_t) bilerp( 0.5, 0.5, n4G, n3G, n2G, n1G );
-			dst_bitmap[ dstPos + 2 ] = (uint8_t) bilerp( 0.5, 0.5, n4B, n3B, n2B, n1B );
-		}
+		case IMAGEIO_BLEND_NORMAL:
+		case IMAGEIO_BLEND_LIGHTEN:
+		case IMAGEIO_BLEND_DARKEN:
+		case IMAGEIO_BLEND_MULTIPLY:
+		case IMAGEIO_BLEND_AVERAGE:
+		case IMAGEIO_BLEND_ADD:
+		case IMAGEIO_BLEND_SUBTRACT:
+		case IMAGEIO_BLEND_DIFFERENCE:
+		case IMAGEIO_BLEND_NEGATION:
+		case IMAGEIO_BLEND_SCREEN:
+		case IMAGEIO_BLEND_LINEAR_DODGE:
+		case IMAGEIO_BLEND_LINEAR_BURN:
+		case IMAGEIO_BLEND_PHOENIX:
+			return true;
+		default:
+			return false;
 	}
-
-	return true;
 }
 
-
-bool imageio_resize_bilinear_sharper_rgb( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-								   uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap,
-								   uint32_t byte_count )
+static void blend_span( uint8_t* dst, const uint8_t* src, size_t count, blend_mode_t mode )
 {
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	register uint32_t srcY = 0;
-	register uint32_t srcX = 0;
-	register uint32_t dstPos, srcPos;
-	register int32_t neighborPos1,
-		 neighborPos2,
-		 neighborPos3,
-		 neighborPos4;
-	register uint8_t R, G, B,
-			 n1R, n1G, n1B, 	/* color vectors */
-			 n2R, n2G, n2B,
-			 n3R, n3G, n3B,
-			 n4R, n4G, n4B;
-	uint32_t largestSrcIndex = src_width * src_height * byte_count;
-
-	assert( byte_count == 3 );
+	size_t i;
 
-	if( !src_bitmap || !dst_bitmap || byte_count != 3 )
+	#define blend_span_loop( m ) for( i = 0; i < count; i++ ) dst[ i ] = channelblend_##m( src[ i ], dst[ i ] )
+	switch( mode )
 	{
-		return false;
+		case IMAGEIO_BLEND_LIGHTEN:      blend_span_loop( lighten ); break;
+		case IMAGEIO_BLEND_DARKEN:       blend_span_loop( darken ); break;
+		case IMAGEIO_BLEND_MULTIPLY:     blend_span_loop( multiply ); break;
+		case IMAGEIO_BLEND_AVERAGE:      blend_span_loop( average ); break;
+		case IMAGEIO_BLEND_ADD:          blend_span_loop( add ); break;
+		case IMAGEIO_BLEND_SUBTRACT:     blend_span_loop( subtract ); break;
+		case IMAGEIO_BLEND_DIFFERENCE:   blend_span_loop( difference ); break;
+		case IMAGEIO_BLEND_NEGATION:     blend_span_loop( negation ); break;
+		case IMAGEIO_BLEND_SCREEN:       blend_span_loop( screen ); break;
+		case IMAGEIO_BLEND_LINEAR_DODGE: blend_span_loop( lineardodge ); break;
+		case IMAGEIO_BLEND_LINEAR_BURN:  blend_span_loop( linearburn ); break;
+		case IMAGEIO_BLEND_PHOENIX:      blend_span_loop( phoenix ); break;
+		case IMAGEIO_BLEND_NORMAL:
+		default:
+			memmove( dst, src, count );
+			break;
 	}
+	#undef blend_span_loop
+}
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;  /* stretch vector */
-	verticalStretchFactor   = (float) src_height / (float) dst_height;
+#if defined(IMAGEIO_X86)
+/* a = src, b = dst, both 16 unsigned bytes; must match blending.h exactly. */
+TARGET_SSE2
+static __inline __m128i blend_sse2( __m128i a, __m128i b, blend_mode_t mode )
+{
+	const __m128i zero = _mm_setzero_si128( );
+	const __m128i ones = _mm_set1_epi8( (char) 0xFF );
 
-	for( y = 0; y < dst_height; y++ )
+	switch( mode )
 	{
-		srcY = (uint32_t) (y * verticalStretchFactor);
-		assert( srcY < src_height );
-
-		for( x = 0; x < dst_width; x++ )
+		case IMAGEIO_BLEND_LIGHTEN:
+			return _mm_max_epu8( a, b );
+		case IMAGEIO_BLEND_DARKEN:
+			return _mm_min_epu8( a, b );
+		case IMAGEIO_BLEND_AVERAGE: /* floor, not pavgb's round up */
+			return _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), _mm_set1_epi8( 1 ) ) );
+		case IMAGEIO_BLEND_ADD:
+		case IMAGEIO_BLEND_LINEAR_DODGE:
+			return _mm_adds_epu8( a, b );
+		case IMAGEIO_BLEND_SUBTRACT: /* max(0, a + b - 255) */
+		case IMAGEIO_BLEND_LINEAR_BURN:
+			return _mm_subs_epu8( a, _mm_xor_si128( b, ones ) );
+		case IMAGEIO_BLEND_DIFFERENCE:
+			return _mm_or_si128( _mm_subs_epu8( a, b ), _mm_subs_epu8( b, a ) );
+		case IMAGEIO_BLEND_PHOENIX: /* 255 - |a - b| */
+			return _mm_xor_si128( _mm_or_si128( _mm_subs_epu8( a, b ), _mm_subs_epu8( b, a ) ), ones );
+		case IMAGEIO_BLEND_MULTIPLY: /* a * b / 255 == mulhi(a * b, 0x8081) >> 7 for every byte pair */
 		{
-			srcX = (uint32_t) (x * horizontalStretchFactor);
-			dstPos = y * dst_width * byte_count + x * byte_count;
-
-			neighborPos1 = (srcY-1) * src_width * byte_count + (srcX-1) * byte_count;
-			neighborPos2 = (srcY-1) * src_width * byte_count + (srcX+1) * byte_count;
-			neighborPos3 = (srcY+1) * src_width * byte_count + (srcX-1) * byte_count;
-			neighborPos4 = (srcY+1) * src_width * byte_count + (srcX+1) * byte_count;
-			srcPos = (uint32_t) srcY * src_width * byte_count + srcX * byte_count;
-
-			if( neighborPos1 < 0 ) neighborPos1 = 0;
-			if( neighborPos2 < 0 ) neighborPos2 = 0;
-			if( neighborPos3 < 0 ) neighborPos3 = 0;
-			if( neighborPos4 < 0 ) neighborPos4 = 0;
-			if( neighborPos1 >= largestSrcIndex ) neighborPos1 = largestSrcIndex - byte_count;
-			if( neighborPos2 >= largestSrcIndex ) neighborPos2 = largestSrcIndex - byte_count;
-			if( neighborPos3 >= largestSrcIndex ) neighborPos3 = largestSrcIndex - byte_count;
-			if( neighborPos4 >= largestSrcIndex ) neighborPos4 = largestSrcIndex - byte_count;
-
-			/* source pixel... */
-			R = src_bitmap[ srcPos ];
-			G = src_bitmap[ srcPos + 1 ];
-			B = src_bitmap[ srcPos + 2 ];
-
-			/* source pixel's neighbor1... */
-			n1R = src_bitmap[ neighborPos1 ];
-			n1G = src_bitmap[ neighborPos1 + 1 ];
-			n1B = src_bitmap[ neighborPos1 + 2 ];
-
-			/* source pixel's neighbor2... */
-			n2R = src_bitmap[ neighborPos2 ];
-			n2G = src_bitmap[ neighborPos2 + 1 ];
-			n2B = src_bitmap[ neighborPos2 + 2 ];
-
-			/* source pixel's neighbor3... */
-			n3R = src_bitmap[ neighborPos3 ];
-			n3G = src_bitmap[ neighborPos3 + 1 ];
-			n3B = src_bitmap[ neighborPos3 + 2 ];
-
-			/* source pixel's neighbor4... */
-			n4R = src_bitmap[ neighborPos4 ];
-			n4G = src_bitmap[ neighborPos4 + 1 ];
-			n4B = src_bitmap[ neighborPos4 + 2 ];
-
-			/* comes out a little more burry than I expected, so I lerp between R and the
-			 * output from the bilerp of the other 4 samples.
-			 */
-			dst_bitmap[ dstPos ]     = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4R, n3R, n2R, n1R ), R );
-			dst_bitmap[ dstPos + 1 ] = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4G, n3G, n2G, n1G ), G );
-			dst_bitmap[ dstPos + 2 ] = (uint8_t) lerp( 0.5, bilerp( 0.5, 0.5, n4B, n3B, n2B, n1B ), B );
+			const __m128i m = _mm_set1_epi16( (short) 0x8081 );
+			__m128i lo = _mm_mullo_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+			__m128i hi = _mm_mullo_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+			lo = _mm_srli_epi16( _mm_mulhi_epu16( lo, m ), 7 );
+			hi = _mm_srli_epi16( _mm_mulhi_epu16( hi, m ), 7 );
+			return _mm_packus_epi16( lo, hi );
+		}
+		case IMAGEIO_BLEND_SCREEN: /* 255 - ((255 - a) * (255 - b) >> 8) */
+		{
+			__m128i ia = _mm_xor_si128( a, ones );
+			__m128i ib = _mm_xor_si128( b, ones );
+			__m128i lo = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( ia, zero ), _mm_unpacklo_epi8( ib, zero ) ), 8 );
+			__m128i hi = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( ia, zero ), _mm_unpackhi_epi8( ib, zero ) ), 8 );
+			return _mm_xor_si128( _mm_packus_epi16( lo, hi ), ones );
+		}
+		case IMAGEIO_BLEND_NEGATION: /* 255 - |255 - a - b| */
+		{
+			const __m128i max = _mm_set1_epi16( 255 );
+			__m128i lo = _mm_sub_epi16( max, _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) ) );
+			__m128i hi = _mm_sub_epi16( max, _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) ) );
+			lo = _mm_sub_epi16( max, _mm_max_epi16( lo, _mm_sub_epi16( _mm_setzero_si128( ), lo ) ) );
+			hi = _mm_sub_epi16( max, _mm_max_epi16( hi, _mm_sub_epi16( _mm_setzero_si128( ), hi ) ) );
+			return _mm_packus_epi16( lo, hi );
 		}
+		case IMAGEIO_BLEND_NORMAL:
+		default:
+			return a;
 	}
-
-	return true;
 }
 
-#define P(x)	( (x) > 0 ? (x) : 0 )
-#define R(x)	( (1.0/6) * (P((x)+2) * P((x)+2) * P((x)+2) - 4.0 * P((x)+1) * P((x)+1) * P((x)+1) + 6.0 * P((x)) * P((x)) * P(x) - 4.0 * P((x)-1) * P((x)-1) * P((x)-1)) )
-
-bool imageio_resize_bicubic_rgba( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-							 uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap,
-							 uint32_t byte_count )
+TARGET_SSE2
+static void blend_span_sse2( uint8_t* dst, const uint8_t* src, size_t count, blend_mode_t mode )
 {
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	register int m = 0, n = 0, i = 0, j = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	register float srcY = 0;
-	register float srcX = 0;
-	register float dy = 0;
-	register float dx = 0;
-	register size_t dstPos, srcPos;
-	uint32_t largestSrcIndex = src_width * src_height * byte_count;
-	register uint32_t sumR = 0;
-	register uint32_t sumG = 0;
-	register uint32_t sumB = 0;
-	register uint32_t sumA = 0;
-
-	assert( byte_count == 4 );
-
-	if( !src_bitmap || !dst_bitmap || byte_count != 4 )
-	{
-		return false;
-	}
+	size_t i = 0;
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;  /* stretch vector */
-	verticalStretchFactor = (float) src_height / (float) dst_height;
-
-	for( y = 0; y < dst_height; y++ )
+	if( mode != IMAGEIO_BLEND_NORMAL )
 	{
-		srcY = y * verticalStretchFactor;
-		j = (int) floor( srcY );
-		if( srcY == 0 ) srcY = 1;
-
-
-		for( x = 0; x < dst_width; x++ )
+		for( ; i + 16 <= count; i += 16 )
 		{
-			srcX = x * horizontalStretchFactor;
-			i = (int) floor( srcX );
-
-			dstPos = y * dst_width * byte_count + x * byte_count;
-			sumR = 0;
-			sumG = 0;
-			sumB = 0;
-			sumA = 0;
-			dy = srcY - j;
-			dx = srcX - i;
-
-			for( m = -1; m <= 2; m++ )
-				for( n = -1; n <= 2; n++ )
-				{
-					srcPos = pixel_index( i + m, j + n, byte_count, src_width );
-					if( srcPos > largestSrcIndex ) srcPos = largestSrcIndex - byte_count;
-
-					sumR +=	(uint32_t) src_bitmap[ srcPos ] * R( m - dx ) * R( dy - n );
-					sumG +=	(uint32_t) src_bitmap[ srcPos + 1 ] * R( m - dx ) * R( dy - n );
-					sumB +=	(uint32_t) src_bitmap[ srcPos + 2 ] * R( m - dx ) * R( dy - n );
-					sumA +=	(uint32_t) src_bitmap[ srcPos + 3 ] * R( m - dx ) * R( dy - n );
-				}
-
-			dst_bitmap[ dstPos ]     = (uint8_t) sumR;
-			dst_bitmap[ dstPos + 1 ] = (uint8_t) sumG;
-			dst_bitmap[ dstPos + 2 ] = (uint8_t) sumB;
-			dst_bitmap[ dstPos + 3 ] = (uint8_t) sumA;
+			__m128i a = _mm_loadu_si128( (const __m128i*) (src + i) );
+			__m128i b = _mm_loadu_si128( (const __m128i*) (dst + i) );
+			_mm_storeu_si128( (__m128i*) (dst + i), blend_sse2( a, b, mode ) );
 		}
 	}
 
-	return true;
+	blend_span( dst + i, src + i, count - i, mode );
 }
 
-bool imageio_resize_bicubic_rgb( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
-							uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap,
-							uint32_t byte_count )
+TARGET_AVX2
+static __inline __m256i blend_avx2( __m256i a, __m256i b, blend_mode_t mode )
 {
-	register uint32_t x = 0;
-	register uint32_t y = 0;
-	register int m = 0, n = 0, i = 0, j = 0;
-	float horizontalStretchFactor = 0;
-	float verticalStretchFactor = 0;
-	register float srcY = 0;
-	register float srcX = 0;
-	register float dy = 0;
-	register float dx = 0;
-	register size_t dstPos, srcPos;
-	uint32_t largestSrcIndex = src_width * src_height * byte_count;
-	register uint32_t sumR = 0;
-	register uint32_t sumG = 0;
-	register uint32_t sumB = 0;
-	assert( byte_count == 4 );
+	const __m256i zero = _mm256_setzero_si256( );
+	const __m256i ones = _mm256_set1_epi8( (char) 0xFF );
 
-	if( !src_bitmap || !dst_bitmap || byte_count != 4 )
+	/* the unpack/pack pairs below stay within 128-bit lanes, so bytes keep their order */
+	switch( mode )
 	{
-		return false;
+		case IMAGEIO_BLEND_LIGHTEN:
+			return _mm256_max_epu8( a, b );
+		case IMAGEIO_BLEND_DARKEN:
+			return _mm256_min_epu8( a, b );
+		case IMAGEIO_BLEND_AVERAGE:
+			return _mm256_sub_epi8( _mm256_avg_epu8( a, b ), _mm256_and_si256( _mm256_xor_si256( a, b ), _mm256_set1_epi8( 1 ) ) );
+		case IMAGEIO_BLEND_ADD:
+		case IMAGEIO_BLEND_LINEAR_DODGE:
+			return _mm256_adds_epu8( a, b );
+		case IMAGEIO_BLEND_SUBTRACT:
+		case IMAGEIO_BLEND_LINEAR_BURN:
+			return _mm256_subs_epu8( a, _mm256_xor_si256( b, ones ) );
+		case IMAGEIO_BLEND_DIFFERENCE:
+			return _mm256_or_si256( _mm256_subs_epu8( a, b ), _mm256_subs_epu8( b, a ) );
+		case IMAGEIO_BLEND_PHOENIX:
+			return _mm256_xor_si256( _mm256_or_si256( _mm256_subs_epu8( a, b ), _mm256_subs_epu8( b, a ) ), ones );
+		case IMAGEIO_BLEND_MULTIPLY:
+		{
+			const __m256i m = _mm256_set1_epi16( (short) 0x8081 );
+			__m256i lo = _mm256_mullo_epi16( _mm256_unpacklo_epi8( a, zero ), _mm256_unpacklo_epi8( b, zero ) );
+			__m256i hi = _mm256_mullo_epi16( _mm256_unpackhi_epi8( a, zero ), _mm256_unpackhi_epi8( b, zero ) );
+			lo = _mm256_srli_epi16( _mm256_mulhi_epu16( lo, m ), 7 );
+			hi = _mm256_srli_epi16( _mm256_mulhi_epu16( hi, m ), 7 );
+			return _mm256_packus_epi16( lo, hi );
+		}
+		case IMAGEIO_BLEND_SCREEN:
+		{
+			__m256i ia = _mm256_xor_si256( a, ones );
+			__m256i ib = _mm256_xor_si256( b, ones );
+			__m256i lo = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_unpacklo_epi8( ia, zero ), _mm256_unpacklo_epi8( ib, zero ) ), 8 );
+			__m256i hi = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_unpackhi_epi8( ia, zero ), _mm256_unpackhi_epi8( ib, zero ) ), 8 );
+			return _mm256_xor_si256( _mm256_packus_epi16( lo, hi ), ones );
+		}
+		case IMAGEIO_BLEND_NEGATION:
+		{
+			const __m256i max = _mm256_set1_epi16( 255 );
+			__m256i lo = _mm256_sub_epi16( max, _mm256_add_epi16( _mm256_unpacklo_epi8( a, zero ), _mm256_unpacklo_epi8( b, zero ) ) );
+			__m256i hi = _mm256_sub_epi16( max, _mm256_add_epi16( _mm256_unpackhi_epi8( a, zero ), _mm256_unpackhi_epi8( b, zero ) ) );
+			lo = _mm256_sub_epi16( max, _mm256_abs_epi16( lo ) );
+			hi = _mm256_sub_epi16( max, _mm256_abs_epi16( hi ) );
+			return _mm256_packus_epi16( lo, hi );
+		}
+		case IMAGEIO_BLEND_NORMAL:
+		default:
+			return a;
 	}
+}
 
-	horizontalStretchFactor = (float) src_width / (float) dst_width;  /* stretch vector */
-	verticalStretchFactor = (float) src_height / (float) dst_height;
+TARGET_AVX2
+static void blend_span_avx2( uint8_t* dst, const uint8_t* src, size_t count, blend_mode_t mode )
+{
+	size_t i = 0;
 
-	for( y = 0; y < dst_height; y++ )
+	if( mode != IMAGEIO_BLEND_NORMAL )
 	{
-		srcY = y * verticalStretchFactor;
-		j = (int) floor( srcY );
-		if( srcY == 0 ) srcY = 1;
-
-
-		for( x = 0; x < dst_width - 2; x++ )
+		for( ; i + 32 <= count; i += 32 )
 		{
-			srcX = x * horizontalStretchFactor;
-			i    = (int) floor( srcX );
-
-			dstPos = y * dst_width * byte_count + x * byte_count;
-			sumR   = 0;
-			sumG   = 0;
-			sumB   = 0;
-			dy     = srcY - j;
-			dx     = srcX - i;
-
-			for( m = -1; m <= 2; m++ )
-			{
-				for( n = -1; n <= 2; n++ )
-				{
-					srcPos = pixel_index( i + m, j + n, byte_count, src_width );
-					if( srcPos > largestSrcIndex ) srcPos = largestSrcIndex - byte_count;
-
-					sumR +=	(uint32_t) src_bitmap[ srcPos ] * R( m - dx ) * R( dy - n );
-					sumG +=	(uint32_t) src_bitmap[ srcPos + 1 ] * R( m - dx ) * R( dy - n );
-					sumB +=	(uint32_t) src_bitmap[ srcPos + 2 ] * R( m - dx ) * R( dy - n );
-				}
-			}
-
-			dst_bitmap[ dstPos ]     = (uint8_t) sumR;
-			dst_bitmap[ dstPos + 1 ] = (uint8_t) sumG;
-			dst_bitmap[ dstPos + 2 ] = (uint8_t) sumB;
+			__m256i a = _mm256_loadu_si256( (const __m256i*) (src + i) );
+			__m256i b = _mm256_loadu_si256( (const __m256i*) (dst + i) );
+			_mm256_storeu_si256( (__m256i*) (dst + i), blend_avx2( a, b, mode ) );
 		}
 	}
 
-	return true;
+	blend_span( dst + i, src + i, count - i, mode );
 }
+#endif
 
-bool imageio_blit( uint32_t pos_x, uint32_t pos_y,
-                   uint32_t dst_width, uint32_t dst_height, uint32_t dst_bytes_per_pixel, uint8_t* dst_pixels,
-                   uint32_t src_width, uint32_t src_height, uint32_t src_bytes_per_pixel, uint8_t* src_pixels )
+typedef struct blend_job {
+	uint8_t* dst;               /* first destination pixel that is blended */
+	size_t dst_stride;
+	uint32_t dst_channels;
+	const uint8_t* src;
+	size_t src_stride;
+	uint32_t src_channels;
+	uint32_t width;
+	blend_mode_t mode;
+	bool span;
+	void (*blender)( uint8_t* result, uint8_t* a, uint8_t* b, blend_mode_t mode );
+} blend_job_t;
+
+static void blend_band( void* context, uint32_t first, uint32_t last, uint32_t band )
 {
-	if( dst_bytes_per_pixel < src_bytes_per_pixel )
-	{
-		return false;
-	}
+	const blend_job_t* job = (const blend_job_t*) context;
 
-	size_t last_y = pos_y + src_height;
-	size_t last_x = pos_x + src_width;
+	(void) band;
 
-	for( size_t y = pos_y; y < last_y; y++ )
+	if( job->span )
 	{
-		for( size_t x = pos_x; x < last_x; x++ )
-		{
-			size_t dst_index = (y * dst_width + x) * dst_bytes_per_pixel;
-			size_t src_index = ((y - pos_y) * src_width + (x - pos_x)) * src_bytes_per_pixel;
+		const cpu_kernels_t* kernels = cpu_kernels( );
 
-			memcpy( &dst_pixels[ dst_index ], &src_pixels[ src_index ], src_bytes_per_pixel );
+		for( size_t y = first; y < last; y++ )
+		{
+			kernels->blend_span( job->dst + y * job->dst_stride, job->src + y * job->src_stride, (size_t) job->width * job->src_channels, job->mode );
 		}
+		return;
 	}
 
-	return true;
+	for( size_t y = first; y < last; y++ )
+	{
+		uint8_t* dst_row = job->dst + y * job->dst_stride;
+		const uint8_t* src_row = job->src + y * job->src_stride;
+
+		for( size_t x = 0; x < job->width; x++ )
+		{
+			uint8_t* dst_pixel = &dst_row[ x * job->dst_channels ];
+			job->blender( dst_pixel, (uint8_t*) &src_row[ x * job->src_channels ], dst_pixel, job->mode );
+		}
+	}
 }
 
 bool imageio_blend( image_t* dst, uint32_t pos_x, uint32_t pos_y, const image_t* src, blend_mode_t mode )
 {
-	if( dst->channels < src->channels )
+	imageio_view_t dst_view;
+	imageio_view_t src_view;
+
+	return imageio_image_view( &dst_view, dst, 0, 0, dst->width, dst->height ) &&
+	       imageio_image_view( &src_view, src, 0, 0, src->width, src->height ) &&
+	       imageio_blend_view( &dst_view, pos_x, pos_y, &src_view, mode );
+}
+
+bool imageio_blend_view( const imageio_view_t* dst, uint32_t pos_x, uint32_t pos_y, const imageio_view_t* src, blend_mode_t mode )
+{
+	blend_job_t job;
+	imageio_view_t target;
+
+	if( dst->channels < src->channels ||
+	    !imageio_view_crop( &target, dst, pos_x, pos_y, src->width, src->height ) )
 	{
 		return false;
 	}
 
-	void (*blender)( uint8_t* result, uint8_t* a, uint8_t* b, blend_mode_t mode );
-
 	if( src->channels == 4 )
 	{
-		blender = imageio_blend_rgba;
+		job.blender = imageio_blend_rgba;
 	}
 	else
 	{
-		blender = imageio_blend_rgb;
+		job.blender = imageio_blend_rgb;
 	}
 
-	size_t last_y = pos_y + src->height;
-	size_t last_x = pos_x + src->width;
-
-	for( size_t y = pos_y; y < last_y; y++ )
-	{
-		for( size_t x = pos_x; x < last_x; x++ )
-		{
-			size_t dst_index = (y * dst->width + x) * dst->channels;
-			size_t src_index = ((y - pos_y) * src->width + (x - pos_x)) * src->channels;
-			blender( &dst->pixels[dst_index], &src->pixels[src_index], &dst->pixels[dst_index], mode );
-		}
-	}
+	job.dst          = target.pixels;
+	job.dst_stride   = target.stride;
+	job.dst_channels = target.channels;
+	job.src          = src->pixels;
+	job.src_stride   = src->stride;
+	job.src_channels = src->channels;
+	job.width        = src->width;
+	job.mode         = mode;
+	job.span         = dst->channels == src->channels && (src->channels == 3 || src->channels == 4) && blend_span_supported( mode );
+	parallel_rows( src->height, (size_t) src->width * dst->channels, 0, blend_band, &job );
 
 	return true;
 }
@@ -1707,19 +6848,28 @@ void imageio_blend_rgba( uint8_t* result, uint8_t* top, uint8_t* bottom, blend_m
 	}
 }
 
+/* Arguments shared by the per-pixel kernels below when they run in bands. */
+typedef struct filter_job {
+	uint32_t width;
+	uint32_t byte_count;
+	const uint8_t* src_bitmap;
+	uint8_t* dst_bitmap;
+	uint32_t color;
+	int32_t k;
+	uint8_t transform[ 256 ];
+} filter_job_t;
+
 /*
  *	Swap Red and blue colors in RGB abd RGBA functions
  */
-void imageio_swap_red_and_blue( uint32_t width, uint32_t height, uint32_t byte_count, uint8_t* bitmap ) /* RGB to BGR */
+static void swap_red_and_blue_span( uint8_t* bitmap, size_t count, uint32_t byte_count )
 {
-	register uint32_t imageIdx;
-	register uint32_t imageSize = width * height * byte_count;
-	assert( byte_count != 0 );
-	assert( bitmap != NULL );
+	register size_t imageIdx = 0;
+	register size_t imageEnd = count * byte_count;
 
 	if( byte_count > 2 ) /* 32 bpp or 24 bpp */
 	{
-		for( imageIdx = 0; imageIdx < imageSize; imageIdx += byte_count )
+		for( ; imageIdx < imageEnd; imageIdx += byte_count )
 		{
 			/* fast swap using XOR... */
 			bitmap[ imageIdx ]     = bitmap[ imageIdx ] ^ bitmap[ imageIdx + 2 ];
@@ -1730,13 +6880,108 @@ void imageio_swap_red_and_blue( uint32_t width, uint32_t height, uint32_t byte_c
 	else { /* 16 bpp */
 		/* Swap ARRRRRGGGGGBBBBB to GGGBBBBBARRRRRGG, whereeach R,G,B, A is a bit, or... */
 		/* Swap GGGBBBBBARRRRRGG to ARRRRRGGGGGBBBBB, whereeach R,G,B, A is a bit */
-		for( imageIdx = 0; imageIdx < imageSize; imageIdx += byte_count )
+		for( ; imageIdx < imageEnd; imageIdx += byte_count )
 		{
 			bitmap[ imageIdx ]     = bitmap[ imageIdx + 1 ];
 			bitmap[ imageIdx + 1 ] = bitmap[ imageIdx ];
 		}
 	}
+}
+
+#if defined(IMAGEIO_X86)
+TARGET_SSE2
+static void swap_red_and_blue_span_sse2( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	size_t i = 0;
+
+	if( byte_count == 4 )
+	{
+		const __m128i keep = _mm_set1_epi32( (int32_t) 0xFF00FF00 );
+		const __m128i low  = _mm_set1_epi32( 0xFF );
+
+		for( ; i + 4 <= count; i += 4 )
+		{
+			__m128i p = _mm_loadu_si128( (const __m128i*) (bitmap + i * 4) );
+			__m128i r = _mm_slli_epi32( _mm_and_si128( p, low ), 16 );
+			__m128i b = _mm_and_si128( _mm_srli_epi32( p, 16 ), low );
+			_mm_storeu_si128( (__m128i*) (bitmap + i * 4), _mm_or_si128( _mm_and_si128( p, keep ), _mm_or_si128( r, b ) ) );
+		}
+	}
+
+	swap_red_and_blue_span( bitmap + i * byte_count, count - i, byte_count );
+}
+
+TARGET_SSSE3
+static void swap_red_and_blue_span_ssse3( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	size_t i = 0;
+
+	if( byte_count == 4 )
+	{
+		const __m128i mask = _mm_setr_epi8( 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 );
+
+		for( ; i + 4 <= count; i += 4 )
+		{
+			__m128i p = _mm_loadu_si128( (const __m128i*) (bitmap + i * 4) );
+			_mm_storeu_si128( (__m128i*) (bitmap + i * 4), _mm_shuffle_epi8( p, mask ) );
+		}
+	}
+	else if( byte_count == 3 )
+	{
+		/* five pixels per 16 byte load; the last byte is written back as is */
+		const __m128i mask = _mm_setr_epi8( 2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15 );
+
+		for( ; (i + 5) * 3 + 1 <= count * 3; i += 5 )
+		{
+			__m128i p = _mm_loadu_si128( (const __m128i*) (bitmap + i * 3) );
+			_mm_storeu_si128( (__m128i*) (bitmap + i * 3), _mm_shuffle_epi8( p, mask ) );
+		}
+	}
+
+	swap_red_and_blue_span( bitmap + i * byte_count, count - i, byte_count );
+}
+
+TARGET_AVX2
+static void swap_red_and_blue_span_avx2( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	size_t i = 0;
+
+	if( byte_count == 4 )
+	{
+		const __m256i mask = _mm256_setr_epi8( 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		                                       2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 );
+
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m256i p = _mm256_loadu_si256( (const __m256i*) (bitmap + i * 4) );
+			_mm256_storeu_si256( (__m256i*) (bitmap + i * 4), _mm256_shuffle_epi8( p, mask ) );
+		}
+	}
+
+	swap_red_and_blue_span_ssse3( bitmap + i * byte_count, count - i, byte_count );
+}
+#endif
+
+static void swap_red_and_blue_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	const filter_job_t* job = (const filter_job_t*) context;
+	const size_t row_size = (size_t) job->width * job->byte_count;
+
+	(void) band;
+
+	cpu_kernels( )->swap_red_and_blue( job->dst_bitmap + first * row_size, (size_t) (last - first) * job->width, job->byte_count );
+}
+
+void imageio_swap_red_and_blue( uint32_t width, uint32_t height, uint32_t byte_count, uint8_t* bitmap ) /* RGB to BGR */
+{
+	filter_job_t job;
+	assert( byte_count != 0 );
+	assert( bitmap != NULL );
 
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.dst_bitmap = bitmap;
+	parallel_rows( height, (size_t) width * byte_count, 0, swap_red_and_blue_band, &job );
 }
 
 /*
@@ -1746,7 +6991,7 @@ void imageio_flip_horizontally( uint32_t width, uint32_t height, uint32_t byte_c
 {
 	register uint32_t x = 0;
 	register uint32_t y = 0;
-	uint8_t* src_bitmap = (uint8_t*) malloc( sizeof(uint8_t) * width * height * byte_count );
+	uint8_t* src_bitmap = (uint8_t*) imageio_malloc( sizeof(uint8_t) * width * height * byte_count );
 
 	memcpy( src_bitmap, bitmap, sizeof(uint8_t) * width * height * byte_count );
 
@@ -1754,12 +6999,12 @@ void imageio_flip_horizontally( uint32_t width, uint32_t height, uint32_t byte_c
 		for( x = 0; x < width; x++ )
 			memcpy( &bitmap[ pixel_index(width - x - 1, y, byte_count, width) ], &src_bitmap[ pixel_index(x, y, byte_count, width) ], sizeof(uint8_t) * byte_count );
 
-	free( src_bitmap );
+	imageio_free( src_bitmap );
 }
 
 void imageio_flip_vertically( uint32_t width, uint32_t height, uint32_t byte_count, uint8_t* bitmap )
 {
-	uint8_t* src_bitmap = (uint8_t*) malloc( sizeof(uint8_t) * width * height * byte_count );
+	uint8_t* src_bitmap = (uint8_t*) imageio_malloc( sizeof(uint8_t) * width * height * byte_count );
 
 	memcpy( src_bitmap, bitmap, sizeof(uint8_t) * width * height * byte_count );
 
@@ -1775,48 +7020,48 @@ void imageio_flip_vertically( uint32_t width, uint32_t height, uint32_t byte_cou
 			memcpy( &bitmap[ pixel_index(x, height - y - 1, byte_count, width) ], &src_bitmap[ pixel_index(x, y, byte_count, width) ], sizeof(uint8_t) * byte_count * width );
 	#endif
 
-	free( src_bitmap );
+	imageio_free( src_bitmap );
 }
 
 void imageio_flip_horizontally_nocopy( uint32_t width, uint32_t height, const uint8_t* src_bitmap, uint8_t* dst_bitmap, uint32_t byte_count )
 {
 	register uint32_t j, i;
-	register uint32_t j_times_width = 0;
-	register uint8_t* temp = (uint8_t*) malloc( width * byte_count * sizeof(uint8_t) ); /* temp scan line, just in case src = dst */
+	register size_t j_times_width = 0;
+	register uint8_t* temp = (uint8_t*) imageio_malloc( (size_t) width * byte_count * sizeof(uint8_t) ); /* temp scan line, just in case src = dst */
 
 	for( j = 0; j < height; j++ )
 	{
-		j_times_width = j* width * byte_count; /* avoids doing this twice */
+		j_times_width = pixel_index( 0, j, byte_count, width ); /* avoids doing this twice */
 
-		memcpy( &temp[ 0 ], &src_bitmap[ j_times_width ], width * byte_count * sizeof(uint8_t) );
+		memcpy( &temp[ 0 ], &src_bitmap[ j_times_width ], (size_t) width * byte_count * sizeof(uint8_t) );
 
 		for( i = 0; i < width; i++ )
-			memcpy( &dst_bitmap[ j_times_width + (width - 1 - i) * byte_count ], &temp[ i * byte_count ], byte_count * sizeof(uint8_t) );
+			memcpy( &dst_bitmap[ j_times_width + (size_t) (width - 1 - i) * byte_count ], &temp[ (size_t) i * byte_count ], byte_count * sizeof(uint8_t) );
 	}
 
-	free( temp );
+	imageio_free( temp );
 }
 
 void imageio_flip_vertically_nocopy( uint32_t width, uint32_t height, const uint8_t* src_bitmap, uint8_t* dst_bitmap, uint32_t byte_count )
 {
 	register uint32_t j, i;
-	register uint32_t i_times_bytecount = 0;
-	register uint32_t width_times_bytecount = 0;
-	register uint8_t* temp = (uint8_t*) malloc( height * byte_count * sizeof(uint8_t) ); /* temp column line, just in case src = dst */
+	register size_t i_times_bytecount = 0;
+	register size_t width_times_bytecount = 0;
+	register uint8_t* temp = (uint8_t*) imageio_malloc( (size_t) height * byte_count * sizeof(uint8_t) ); /* temp column line, just in case src = dst */
 
 	for( i = 0; i < width; i++ )
 	{
-		i_times_bytecount = i * byte_count;
-		width_times_bytecount = width * byte_count;
+		i_times_bytecount = (size_t) i * byte_count;
+		width_times_bytecount = (size_t) width * byte_count;
 
 		for( j = 0; j < height; j++ )
-			memcpy( &temp[ j * byte_count ], &src_bitmap[ j * width_times_bytecount + i_times_bytecount ], byte_count * sizeof(uint8_t) );
+			memcpy( &temp[ (size_t) j * byte_count ], &src_bitmap[ j * width_times_bytecount + i_times_bytecount ], byte_count * sizeof(uint8_t) );
 
 		for( j = 0; j < height; j++ )
-			memcpy( &dst_bitmap[ (height - 1 - j) * width_times_bytecount + i_times_bytecount ], &temp[ j * byte_count ], byte_count * sizeof(uint8_t) );
+			memcpy( &dst_bitmap[ (height - 1 - j) * width_times_bytecount + i_times_bytecount ], &temp[ (size_t) j * byte_count ], byte_count * sizeof(uint8_t) );
 	}
 
-	free( temp );
+	imageio_free( temp );
 }
 
 
@@ -1824,27 +7069,27 @@ void imageio_flip_vertically_nocopy( uint32_t width, uint32_t height, const uint
 /*
  * Edge Detection: k is the maximum color distance that signifies an edge
  */
-bool imageio_detect_edges( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, int32_t k )
+static void detect_edges_band( void* context, uint32_t first, uint32_t last, uint32_t band )
 {
-	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
+	const filter_job_t* job = (const filter_job_t*) context;
+	const uint32_t width = job->width;
+	const uint32_t byte_count = job->byte_count;
+	const uint8_t* src_bitmap = job->src_bitmap;
+	uint8_t* dst_bitmap = job->dst_bitmap;
+	const int32_t k = job->k;
 	register uint32_t y;
 	register uint32_t x;
-	assert( bit_depth != 0 );
-	assert( src_bitmap != NULL || dst_bitmap != NULL );
 
-	if( !src_bitmap || !dst_bitmap || bit_depth == 0 )
-	{
-		return false;
-	}
+	(void) band;
 
-	for( y = 0; y < height - 1; y++ )
+	for( y = first; y < last; y++ )
 	{
 		for( x = 0; x < width - 1; x++ )
 		{
 			/* r = right, b = bottom */
-			uint32_t pos = width * y * byte_count + x * byte_count;
-			uint32_t rpos = width * y * byte_count + (x + 1) * byte_count;
-			uint32_t bpos = width * (y + 1) * byte_count + x * byte_count;
+			size_t pos = (size_t) width * y * byte_count + x * byte_count;
+			size_t rpos = (size_t) width * y * byte_count + (x + 1) * byte_count;
+			size_t bpos = (size_t) width * (y + 1) * byte_count + x * byte_count;
 
 			/* this pixel */
 			uint8_t R = src_bitmap[ pos ];
@@ -1882,6 +7127,42 @@ bool imageio_detect_edges( uint32_t width, uint32_t height, uint32_t bit_depth,
 			}
 		}
 	}
+}
+
+bool imageio_detect_edges( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, int32_t k )
+{
+	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
+	filter_job_t job;
+	assert( bit_depth != 0 );
+	assert( src_bitmap != NULL || dst_bitmap != NULL );
+
+	if( !src_bitmap || !dst_bitmap || bit_depth == 0 )
+	{
+		return false;
+	}
+
+	if( height < 2 || width < 2 )
+	{
+		return true;
+	}
+
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.src_bitmap = src_bitmap;
+	job.dst_bitmap = dst_bitmap;
+	job.k          = k;
+
+	if( src_bitmap == dst_bitmap )
+	{
+		/* In place, each row reads the row below before it is
+		 * overwritten, which only holds when the rows go in order.
+		 */
+		detect_edges_band( &job, 0, height - 1, 0 );
+	}
+	else
+	{
+		parallel_rows( height - 1, (size_t) width * byte_count, 0, detect_edges_band, &job );
+	}
 
 	return true;
 }
@@ -1889,24 +7170,25 @@ bool imageio_detect_edges( uint32_t width, uint32_t height, uint32_t bit_depth,
 /*
  * Color Extraction: Marks white all the pixels that are no greater than k distance to the color.
  */
-bool imageio_extract_color( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, uint32_t color, uint32_t k )
+static void extract_color_band( void* context, uint32_t first, uint32_t last, uint32_t band )
 {
-	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
+	const filter_job_t* job = (const filter_job_t*) context;
+	const uint32_t width = job->width;
+	const uint32_t byte_count = job->byte_count;
+	const uint8_t* src_bitmap = job->src_bitmap;
+	uint8_t* dst_bitmap = job->dst_bitmap;
+	const uint32_t color = job->color;
+	const uint32_t k = (uint32_t) job->k;
 	register uint32_t y;
 	register uint32_t x;
-	assert( bit_depth != 0 );
-	assert( src_bitmap != NULL || dst_bitmap != NULL );
 
-	if( !src_bitmap || !dst_bitmap || bit_depth == 0 )
-	{
-		return false;
-	}
+	(void) band;
 
-	for( y = 0; y < height; y++ )
+	for( y = first; y < last; y++ )
 	{
 		for( x = 0; x < width; x++ )
 		{
-			uint32_t pos = width * y * byte_count + x * byte_count;
+			size_t pos = (size_t) width * y * byte_count + x * byte_count;
 			/* this pixel */
 			uint8_t r_diff = src_bitmap[ pos + 0 ] - r32(color);
 			uint8_t g_diff = src_bitmap[ pos + 1 ] - g32(color);
@@ -1925,18 +7207,12 @@ bool imageio_extract_color( uint32_t width, uint32_t height, uint32_t bit_depth,
 			}
 		}
 	}
-
-	return true;
 }
 
-/*
- * Grayscale conversion
- */
-bool imageio_convert_to_grayscale( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap )
+bool imageio_extract_color( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, uint32_t color, uint32_t k )
 {
 	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
-	register uint32_t y;
-	register uint32_t x;
+	filter_job_t job;
 	assert( bit_depth != 0 );
 	assert( src_bitmap != NULL || dst_bitmap != NULL );
 
@@ -1945,11 +7221,37 @@ bool imageio_convert_to_grayscale( uint32_t width, uint32_t height, uint32_t bit
 		return false;
 	}
 
-	for( y = 0; y < height; y++ )
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.src_bitmap = src_bitmap;
+	job.dst_bitmap = dst_bitmap;
+	job.color      = color;
+	job.k          = (int32_t) k;
+	parallel_rows( height, (size_t) width * byte_count, 0, extract_color_band, &job );
+
+	return true;
+}
+
+/*
+ * Grayscale conversion
+ */
+static void convert_to_grayscale_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	const filter_job_t* job = (const filter_job_t*) context;
+	const uint32_t width = job->width;
+	const uint32_t byte_count = job->byte_count;
+	const uint8_t* src_bitmap = job->src_bitmap;
+	uint8_t* dst_bitmap = job->dst_bitmap;
+	register uint32_t y;
+	register uint32_t x;
+
+	(void) band;
+
+	for( y = first; y < last; y++ )
 	{
 		for( x = 0; x < width; x++ )
 		{
-			uint32_t pos = width * y * byte_count + x * byte_count;
+			size_t pos = (size_t) width * y * byte_count + x * byte_count;
 			/* this pixel */
 			uint8_t R = src_bitmap[ pos ];
 			uint8_t G = src_bitmap[ pos + 1 ];
@@ -1962,6 +7264,25 @@ bool imageio_convert_to_grayscale( uint32_t width, uint32_t height, uint32_t bit
 			dst_bitmap[ pos + 2 ] = colorAverage;
 		}
 	}
+}
+
+bool imageio_convert_to_grayscale( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap )
+{
+	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
+	filter_job_t job;
+	assert( bit_depth != 0 );
+	assert( src_bitmap != NULL || dst_bitmap != NULL );
+
+	if( !src_bitmap || !dst_bitmap || bit_depth == 0 )
+	{
+		return false;
+	}
+
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.src_bitmap = src_bitmap;
+	job.dst_bitmap = dst_bitmap;
+	parallel_rows( height, (size_t) width * byte_count, 0, convert_to_grayscale_band, &job );
 
 	return true;
 }
@@ -1969,11 +7290,44 @@ bool imageio_convert_to_grayscale( uint32_t width, uint32_t height, uint32_t bit
 /*
  * Colorscale conversion
  */
-bool imageio_convert_to_colorscale( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, uint32_t color )
+static void convert_to_colorscale_band( void* context, uint32_t first, uint32_t last, uint32_t band )
 {
-	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
+	const filter_job_t* job = (const filter_job_t*) context;
+	const uint32_t width = job->width;
+	const uint32_t byte_count = job->byte_count;
+	const uint8_t* src_bitmap = job->src_bitmap;
+	uint8_t* dst_bitmap = job->dst_bitmap;
+	uint8_t r = r32(job->color);
+	uint8_t g = g32(job->color);
+	uint8_t b = b32(job->color);
 	register uint32_t y;
 	register uint32_t x;
+
+	(void) band;
+
+	for( y = first; y < last; y++ )
+	{
+		for( x = 0; x < width; x++ )
+		{
+			size_t pos = (size_t) width * y * byte_count + x * byte_count;
+			/* this pixel */
+			uint8_t R = src_bitmap[ pos ];
+			uint8_t G = src_bitmap[ pos + 1 ];
+			uint8_t B = src_bitmap[ pos + 2 ];
+
+			float colorScaled = (float) ( (R*r + G*g + B*b) / ( sqrt((float) R*R + G*G + B*B) * sqrt((float) r*r + g*g + b*b) ));
+
+			dst_bitmap[ pos ] = (uint8_t) colorScaled * R;
+			dst_bitmap[ pos + 1 ] = (uint8_t) colorScaled * G;
+			dst_bitmap[ pos + 2 ] = (uint8_t) colorScaled * B;
+		}
+	}
+}
+
+bool imageio_convert_to_colorscale( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, uint32_t color )
+{
+	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
+	filter_job_t job;
 	uint8_t r = r32(color);
 	uint8_t g = g32(color);
 	uint8_t b = b32(color);
@@ -1991,25 +7345,45 @@ bool imageio_convert_to_colorscale( uint32_t width, uint32_t height, uint32_t bi
 		return false;
 	}
 
-	for( y = 0; y < height; y++ )
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.src_bitmap = src_bitmap;
+	job.dst_bitmap = dst_bitmap;
+	job.color      = color;
+	parallel_rows( height, (size_t) width * byte_count, 0, convert_to_colorscale_band, &job );
+
+	return true;
+}
+
+/* Maps the first three channels of each pixel through job->transform. */
+static void transform_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	const filter_job_t* job = (const filter_job_t*) context;
+	const uint32_t width = job->width;
+	const uint32_t byte_count = job->byte_count;
+	const uint8_t* src_bitmap = job->src_bitmap;
+	uint8_t* dst_bitmap = job->dst_bitmap;
+	const uint8_t* transform = job->transform;
+	register uint32_t y;
+	register uint32_t x;
+
+	(void) band;
+
+	for( y = first; y < last; y++ )
 	{
 		for( x = 0; x < width; x++ )
 		{
-			uint32_t pos = width * y * byte_count + x * byte_count;
+			size_t pos = (size_t) width * y * byte_count + x * byte_count;
 			/* this pixel */
 			uint8_t R = src_bitmap[ pos ];
 			uint8_t G = src_bitmap[ pos + 1 ];
 			uint8_t B = src_bitmap[ pos + 2 ];
 
-			float colorScaled = (float) ( (R*r + G*g + B*b) / ( sqrt((float) R*R + G*G + B*B) * sqrt((float) r*r + g*g + b*b) ));
-
-			dst_bitmap[ pos ] = (uint8_t) colorScaled * R;
-			dst_bitmap[ pos + 1 ] = (uint8_t) colorScaled * G;
-			dst_bitmap[ pos + 2 ] = (uint8_t) colorScaled * B;
+			dst_bitmap[ pos ] = transform[ R ];
+			dst_bitmap[ pos + 1 ] = transform[ G ];
+			dst_bitmap[ pos + 2 ] = transform[ B ];
 		}
 	}
-
-	return true;
 }
 
 /*
@@ -2018,10 +7392,8 @@ bool imageio_convert_to_colorscale( uint32_t width, uint32_t height, uint32_t bi
 void imageio_modify_contrast( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, int contrast )
 {
 	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
-	register uint32_t y;
-	register uint32_t x;
 	register uint32_t colorIndex;
-	uint32_t transform[ 256 ];
+	filter_job_t job;
 	assert( src_bitmap != NULL || dst_bitmap != NULL );
 	assert( bit_depth != 0 );
 
@@ -2029,36 +7401,25 @@ void imageio_modify_contrast( uint32_t width, uint32_t height, uint32_t bit_dept
 	{
 		float slope = (float) tan((float)contrast);
 		if( colorIndex < (uint32_t) (128.0f + 128.0f*slope) && colorIndex > (uint32_t) (128.0f-128.0f*slope) )
-			transform[ colorIndex ] = (uint32_t) ((colorIndex - 128) / slope + 128);
+			job.transform[ colorIndex ] = (uint8_t) ((uint32_t) ((colorIndex - 128) / slope + 128));
 		else if( colorIndex >= (uint32_t) (128.0f + 128.0f*slope) )
-			transform[ colorIndex ] = 255;
+			job.transform[ colorIndex ] = 255;
 		else /* colorIndex <= 128 -128*slope */
-			transform[ colorIndex ] = 0;
+			job.transform[ colorIndex ] = 0;
 	}
 
-
-	for( y = 0; y < height; y++ )
-		for( x = 0; x < width; x++ )
-		{
-			uint32_t pos = width * y * byte_count + x * byte_count;
-			/* this pixel */
-			uint8_t R = src_bitmap[ pos ];
-			uint8_t G = src_bitmap[ pos + 1 ];
-			uint8_t B = src_bitmap[ pos + 2 ];
-
-			dst_bitmap[ pos ] = transform[ R ];
-			dst_bitmap[ pos + 1 ] = transform[ G ];
-			dst_bitmap[ pos + 2 ] = transform[ B ];
-		}
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.src_bitmap = src_bitmap;
+	job.dst_bitmap = dst_bitmap;
+	parallel_rows( height, (size_t) width * byte_count, 0, transform_band, &job );
 }
 
 void imageio_modify_brightness( uint32_t width, uint32_t height, uint32_t bit_depth, const uint8_t* src_bitmap, uint8_t* dst_bitmap, int brightness )
 {
 	uint32_t byte_count = bit_depth >> 3; /* 4 ==> RGBA32, 3==>RGB32 , 2 ==> RGB16 */
-	register uint32_t y;
-	register uint32_t x;
 	register unsigned short colorIndex;
-	uint8_t transform[ 256 ] = {0};
+	filter_job_t job;
 	assert( src_bitmap != NULL || dst_bitmap != NULL );
 	assert( bit_depth != 0 );
 
@@ -2067,54 +7428,194 @@ void imageio_modify_brightness( uint32_t width, uint32_t height, uint32_t bit_de
 		short t = colorIndex + brightness;
 		if( t > 255 ) t = 255;
 		if( t < 0 )	t = 0;
-		transform[ colorIndex ] = (uint8_t) t;
+		job.transform[ colorIndex ] = (uint8_t) t;
 	}
 
+	job.width      = width;
+	job.byte_count = byte_count;
+	job.src_bitmap = src_bitmap;
+	job.dst_bitmap = dst_bitmap;
+	parallel_rows( height, (size_t) width * byte_count, 0, transform_band, &job );
+}
 
-	for( y = 0; y < height; y++ )
+
+
+/*
+ * Y = 0.299R + 0.587G + 0.114B
+ * U'= (B-Y)*0.565
+ * V'= (R-Y)*0.713
+ */
+static void rgb_to_yuv444_span( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	register size_t imageIdx = 0;
+	register size_t imageEnd = count * byte_count;
+
+	for( ; imageIdx < imageEnd; imageIdx += byte_count )
 	{
-		for( x = 0; x < width; x++ )
+		uint8_t R = bitmap[ imageIdx + 0 ];
+		uint8_t G = bitmap[ imageIdx + 1 ];
+		uint8_t B = bitmap[ imageIdx + 2 ];
+
+		float Y = (0.299f * R + 0.587f * G + 0.114f * B); /* Y */
+		bitmap[ imageIdx + 0 ] = (uint8_t) Y; /* Y */
+		bitmap[ imageIdx + 1 ] = (uint8_t) ((B - Y) * 0.565f); /* U' */
+		bitmap[ imageIdx + 2 ] = (uint8_t) ((R - Y) * 0.713f); /* V' */
+	}
+}
+
+/*
+ * R = Y + 1.403V'
+ * G = Y - 0.344U' - 0.714V'
+ * B = Y + 1.770U'
+ */
+static void yuv444_to_rgb_span( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	register size_t imageIdx = 0;
+	register size_t imageEnd = count * byte_count;
+
+	for( ; imageIdx < imageEnd; imageIdx += byte_count )
+	{
+		uint8_t Y = bitmap[ imageIdx + 0 ];
+		uint8_t U = bitmap[ imageIdx + 1 ];
+		uint8_t V = bitmap[ imageIdx + 2 ];
+
+		bitmap[ imageIdx + 0 ] = (uint8_t) (Y + 1.403f * V); /* R */
+		bitmap[ imageIdx + 1 ] = (uint8_t) (Y - 0.344f * U - 0.714f * V); /* G */
+		bitmap[ imageIdx + 2 ] = (uint8_t) (Y + 1.770f * U); /* B */
+	}
+}
+
+#if defined(IMAGEIO_X86)
+/*
+ * Four RGBA pixels per iteration. The float math runs in the same order as
+ * the scalar code and the results are truncated to int32 and then to the
+ * low byte, just like the scalar casts, so both give the same bytes.
+ */
+TARGET_SSE2
+static void rgb_to_yuv444_span_sse2( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	const __m128i low = _mm_set1_epi32( 0xFF );
+	size_t i = 0;
+
+	if( byte_count == 4 )
+	{
+		for( ; i + 4 <= count; i += 4 )
 		{
-			uint32_t pos = width * y * byte_count + x * byte_count;
-			/* this pixel */
-			uint8_t R = src_bitmap[ pos ];
-			uint8_t G = src_bitmap[ pos + 1 ];
-			uint8_t B = src_bitmap[ pos + 2 ];
+			__m128i p = _mm_loadu_si128( (const __m128i*) (bitmap + i * 4) );
+			__m128 R  = _mm_cvtepi32_ps( _mm_and_si128( p, low ) );
+			__m128 G  = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 8 ), low ) );
+			__m128 B  = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 16 ), low ) );
+			__m128 Y  = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( 0.299f ), R ), _mm_mul_ps( _mm_set1_ps( 0.587f ), G ) ), _mm_mul_ps( _mm_set1_ps( 0.114f ), B ) );
+			__m128i y = _mm_and_si128( _mm_cvttps_epi32( Y ), low );
+			__m128i u = _mm_and_si128( _mm_cvttps_epi32( _mm_mul_ps( _mm_sub_ps( B, Y ), _mm_set1_ps( 0.565f ) ) ), low );
+			__m128i v = _mm_and_si128( _mm_cvttps_epi32( _mm_mul_ps( _mm_sub_ps( R, Y ), _mm_set1_ps( 0.713f ) ) ), low );
+			p = _mm_or_si128( _mm_andnot_si128( _mm_set1_epi32( 0xFFFFFF ), p ), _mm_or_si128( y, _mm_or_si128( _mm_slli_epi32( u, 8 ), _mm_slli_epi32( v, 16 ) ) ) );
+			_mm_storeu_si128( (__m128i*) (bitmap + i * 4), p );
+		}
+	}
 
-			dst_bitmap[ pos ] = transform[ R ];
-			dst_bitmap[ pos + 1 ] = transform[ G ];
-			dst_bitmap[ pos + 2 ] = transform[ B ];
+	rgb_to_yuv444_span( bitmap + i * byte_count, count - i, byte_count );
+}
+
+TARGET_SSE2
+static void yuv444_to_rgb_span_sse2( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	const __m128i low = _mm_set1_epi32( 0xFF );
+	size_t i = 0;
+
+	if( byte_count == 4 )
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			__m128i p = _mm_loadu_si128( (const __m128i*) (bitmap + i * 4) );
+			__m128 Y  = _mm_cvtepi32_ps( _mm_and_si128( p, low ) );
+			__m128 U  = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 8 ), low ) );
+			__m128 V  = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 16 ), low ) );
+			__m128i r = _mm_and_si128( _mm_cvttps_epi32( _mm_add_ps( Y, _mm_mul_ps( _mm_set1_ps( 1.403f ), V ) ) ), low );
+			__m128i g = _mm_and_si128( _mm_cvttps_epi32( _mm_sub_ps( _mm_sub_ps( Y, _mm_mul_ps( _mm_set1_ps( 0.344f ), U ) ), _mm_mul_ps( _mm_set1_ps( 0.714f ), V ) ) ), low );
+			__m128i b = _mm_and_si128( _mm_cvttps_epi32( _mm_add_ps( Y, _mm_mul_ps( _mm_set1_ps( 1.770f ), U ) ) ), low );
+			p = _mm_or_si128( _mm_andnot_si128( _mm_set1_epi32( 0xFFFFFF ), p ), _mm_or_si128( r, _mm_or_si128( _mm_slli_epi32( g, 8 ), _mm_slli_epi32( b, 16 ) ) ) );
+			_mm_storeu_si128( (__m128i*) (bitmap + i * 4), p );
+		}
+	}
+
+	yuv444_to_rgb_span( bitmap + i * byte_count, count - i, byte_count );
+}
+
+TARGET_AVX2
+static void rgb_to_yuv444_span_avx2( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	const __m256i low = _mm256_set1_epi32( 0xFF );
+	size_t i = 0;
+
+	if( byte_count == 4 )
+	{
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m256i p = _mm256_loadu_si256( (const __m256i*) (bitmap + i * 4) );
+			__m256 R  = _mm256_cvtepi32_ps( _mm256_and_si256( p, low ) );
+			__m256 G  = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 8 ), low ) );
+			__m256 B  = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 16 ), low ) );
+			__m256 Y  = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( 0.299f ), R ), _mm256_mul_ps( _mm256_set1_ps( 0.587f ), G ) ), _mm256_mul_ps( _mm256_set1_ps( 0.114f ), B ) );
+			__m256i y = _mm256_and_si256( _mm256_cvttps_epi32( Y ), low );
+			__m256i u = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( B, Y ), _mm256_set1_ps( 0.565f ) ) ), low );
+			__m256i v = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( R, Y ), _mm256_set1_ps( 0.713f ) ) ), low );
+			p = _mm256_or_si256( _mm256_andnot_si256( _mm256_set1_epi32( 0xFFFFFF ), p ), _mm256_or_si256( y, _mm256_or_si256( _mm256_slli_epi32( u, 8 ), _mm256_slli_epi32( v, 16 ) ) ) );
+			_mm256_storeu_si256( (__m256i*) (bitmap + i * 4), p );
 		}
 	}
+
+	rgb_to_yuv444_span_sse2( bitmap + i * byte_count, count - i, byte_count );
 }
 
+TARGET_AVX2
+static void yuv444_to_rgb_span_avx2( uint8_t* bitmap, size_t count, uint32_t byte_count )
+{
+	const __m256i low = _mm256_set1_epi32( 0xFF );
+	size_t i = 0;
 
+	if( byte_count == 4 )
+	{
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m256i p = _mm256_loadu_si256( (const __m256i*) (bitmap + i * 4) );
+			__m256 Y  = _mm256_cvtepi32_ps( _mm256_and_si256( p, low ) );
+			__m256 U  = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 8 ), low ) );
+			__m256 V  = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 16 ), low ) );
+			__m256i r = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_add_ps( Y, _mm256_mul_ps( _mm256_set1_ps( 1.403f ), V ) ) ), low );
+			__m256i g = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_sub_ps( _mm256_sub_ps( Y, _mm256_mul_ps( _mm256_set1_ps( 0.344f ), U ) ), _mm256_mul_ps( _mm256_set1_ps( 0.714f ), V ) ) ), low );
+			__m256i b = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_add_ps( Y, _mm256_mul_ps( _mm256_set1_ps( 1.770f ), U ) ) ), low );
+			p = _mm256_or_si256( _mm256_andnot_si256( _mm256_set1_epi32( 0xFFFFFF ), p ), _mm256_or_si256( r, _mm256_or_si256( _mm256_slli_epi32( g, 8 ), _mm256_slli_epi32( b, 16 ) ) ) );
+			_mm256_storeu_si256( (__m256i*) (bitmap + i * 4), p );
+		}
+	}
+
+	yuv444_to_rgb_span_sse2( bitmap + i * byte_count, count - i, byte_count );
+}
+#endif
+
+static void rgb_to_yuv444_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	const filter_job_t* job = (const filter_job_t*) context;
+	const size_t row_size = (size_t) job->width * job->byte_count;
+
+	(void) band;
+
+	cpu_kernels( )->rgb_to_yuv444( job->dst_bitmap + first * row_size, (size_t) (last - first) * job->width, job->byte_count );
+}
 
-/*
- * Y = 0.299R + 0.587G + 0.114B
- * U'= (B-Y)*0.565
- * V'= (R-Y)*0.713
- */
 void imageio_rgb_to_yuv444( uint32_t width, uint32_t height, uint32_t byte_count, uint8_t* bitmap )
 {
-	register uint32_t imageIdx;
-	register uint32_t imageSize = width * height * byte_count;
+	filter_job_t job;
 	assert( byte_count != 0 );
 	assert( bitmap != NULL );
 
 	if( byte_count > 2 ) /* 32 bpp or 24 bpp */
 	{
-		for( imageIdx = 0; imageIdx < imageSize; imageIdx += byte_count )
-		{
-			uint8_t R = bitmap[ imageIdx + 0 ];
-			uint8_t G = bitmap[ imageIdx + 1 ];
-			uint8_t B = bitmap[ imageIdx + 2 ];
-
-			float Y = (0.299f * R + 0.587f * G + 0.114f * B); /* Y */
-			bitmap[ imageIdx + 0 ] = (uint8_t) Y; /* Y */
-			bitmap[ imageIdx + 1 ] = (uint8_t) ((B - Y) * 0.565f); /* U' */
-			bitmap[ imageIdx + 2 ] = (uint8_t) ((R - Y) * 0.713f); /* V' */
-		}
+		job.width      = width;
+		job.byte_count = byte_count;
+		job.dst_bitmap = bitmap;
+		parallel_rows( height, (size_t) width * byte_count, 0, rgb_to_yuv444_band, &job );
 	}
 	else
 	{
@@ -2123,30 +7624,28 @@ void imageio_rgb_to_yuv444( uint32_t width, uint32_t height, uint32_t byte_count
 	}
 }
 
-/*
- * R = Y + 1.403V'
- * G = Y - 0.344U' - 0.714V'
- * B = Y + 1.770U'
- */
+static void yuv444_to_rgb_band( void* context, uint32_t first, uint32_t last, uint32_t band )
+{
+	const filter_job_t* job = (const filter_job_t*) context;
+	const size_t row_size = (size_t) job->width * job->byte_count;
+
+	(void) band;
+
+	cpu_kernels( )->yuv444_to_rgb( job->dst_bitmap + first * row_size, (size_t) (last - first) * job->width, job->byte_count );
+}
+
 void imageio_yuv444_to_rgb( uint32_t width, uint32_t height, uint32_t byte_count, uint8_t* bitmap )
 {
-	register uint32_t imageIdx;
-	register uint32_t imageSize = width * height * byte_count;
+	filter_job_t job;
 	assert( byte_count != 0 );
 	assert( bitmap != NULL );
 
 	if( byte_count > 2 ) /* 32 bpp or 24 bpp */
 	{
-		for( imageIdx = 0; imageIdx < imageSize; imageIdx += byte_count )
-		{
-			uint8_t Y = bitmap[ imageIdx + 0 ];
-			uint8_t U = bitmap[ imageIdx + 1 ];
-			uint8_t V = bitmap[ imageIdx + 2 ];
-
-			bitmap[ imageIdx + 0 ] = (uint8_t) (Y + 1.403f * V); /* R */
-			bitmap[ imageIdx + 1 ] = (uint8_t) (Y - 0.344f * U - 0.714f * V); /* G */
-			bitmap[ imageIdx + 2 ] = (uint8_t) (Y + 1.770f * U); /* B */
-		}
+		job.width      = width;
+		job.byte_count = byte_count;
+		job.dst_bitmap = bitmap;
+		parallel_rows( height, (size_t) width * byte_count, 0, yuv444_to_rgb_band, &job );
 	}
 	else
 	{
@@ -2155,6 +7654,155 @@ void imageio_yuv444_to_rgb( uint32_t width, uint32_t height, uint32_t byte_count
 	}
 }
 
+/*
+ *  Kernel tables for each CPU level. SSSE3 only adds the byte shuffles;
+ *  everything else it shares with SSE2.
+ */
+static const cpu_kernels_t cpu_kernels_scalar = {
+	swap_red_and_blue_span,
+	blend_span,
+	resample_horizontal,
+	resample_vertical_row,
+	NULL,
+	rgb_to_yuv444_span,
+	yuv444_to_rgb_span
+};
+
+#if defined(IMAGEIO_X86)
+static const cpu_kernels_t cpu_kernels_sse2 = {
+	swap_red_and_blue_span_sse2,
+	blend_span_sse2,
+	resample_horizontal_sse2,
+	resample_vertical_row_sse2,
+	resize_plan_bilinear_row_rgba_sse2,
+	rgb_to_yuv444_span_sse2,
+	yuv444_to_rgb_span_sse2
+};
+
+static const cpu_kernels_t cpu_kernels_ssse3 = {
+	swap_red_and_blue_span_ssse3,
+	blend_span_sse2,
+	resample_horizontal_sse2,
+	resample_vertical_row_sse2,
+	resize_plan_bilinear_row_rgba_sse2,
+	rgb_to_yuv444_span_sse2,
+	yuv444_to_rgb_span_sse2
+};
+
+static const cpu_kernels_t cpu_kernels_avx2 = {
+	swap_red_and_blue_span_avx2,
+	blend_span_avx2,
+	resample_horizontal_avx2,
+	resample_vertical_row_avx2,
+	resize_plan_bilinear_row_rgba_sse2,
+	rgb_to_yuv444_span_avx2,
+	yuv444_to_rgb_span_avx2
+};
+#endif
+
+static imageio_cpu_t cpu_level = IMAGEIO_CPU_SCALAR;
+static const cpu_kernels_t* cpu_table = &cpu_kernels_scalar;
+#ifndef _WIN32
+static pthread_once_t cpu_once = PTHREAD_ONCE_INIT;
+#else
+static bool cpu_initialized = false;
+#endif
+
+/* The best level this CPU (and its OS) can run. */
+static imageio_cpu_t cpu_detect( void )
+{
+	#if defined(IMAGEIO_X86)
+	__builtin_cpu_init( );
+
+	if( __builtin_cpu_supports( "avx2" ) )  return IMAGEIO_CPU_AVX2;
+	if( __builtin_cpu_supports( "ssse3" ) ) return IMAGEIO_CPU_SSSE3;
+	if( __builtin_cpu_supports( "sse2" ) )  return IMAGEIO_CPU_SSE2;
+	#endif
+	return IMAGEIO_CPU_SCALAR;
+}
+
+static void cpu_select( imageio_cpu_t level )
+{
+	switch( level )
+	{
+		#if defined(IMAGEIO_X86)
+		case IMAGEIO_CPU_AVX2:  cpu_table = &cpu_kernels_avx2; break;
+		case IMAGEIO_CPU_SSSE3: cpu_table = &cpu_kernels_ssse3; break;
+		case IMAGEIO_CPU_SSE2:  cpu_table = &cpu_kernels_sse2; break;
+		#endif
+		default:
+			level     = IMAGEIO_CPU_SCALAR;
+			cpu_table = &cpu_kernels_scalar;
+			break;
+	}
+
+	cpu_level = level;
+}
+
+/* IMAGEIO_CPU=scalar|sse2|ssse3|avx2 caps the level used. */
+static void cpu_initialize( void )
+{
+	imageio_cpu_t level = cpu_detect( );
+	const char* name    = getenv( "IMAGEIO_CPU" );
+
+	if( name )
+	{
+		imageio_cpu_t requested = level;
+
+		if( strcasecmp( name, "scalar" ) == 0 )     requested = IMAGEIO_CPU_SCALAR;
+		else if( strcasecmp( name, "sse2" ) == 0 )  requested = IMAGEIO_CPU_SSE2;
+		else if( strcasecmp( name, "ssse3" ) == 0 ) requested = IMAGEIO_CPU_SSSE3;
+		else if( strcasecmp( name, "avx2" ) == 0 )  requested = IMAGEIO_CPU_AVX2;
+
+		if( requested < level )
+		{
+			level = requested;
+		}
+	}
+
+	cpu_select( level );
+}
+
+static const cpu_kernels_t* cpu_kernels( void )
+{
+	#ifndef _WIN32
+	pthread_once( &cpu_once, cpu_initialize );
+	#else
+	if( !cpu_initialized )
+	{
+		cpu_initialize( );
+		cpu_initialized = true;
+	}
+	#endif
+	return cpu_table;
+}
+
+bool imageio_set_cpu( imageio_cpu_t level )
+{
+	imageio_cpu_t supported;
+
+	cpu_kernels( ); /* so that IMAGEIO_CPU doesn't override this later */
+	supported = cpu_detect( );
+
+	if( level == IMAGEIO_CPU_DETECT )
+	{
+		level = supported;
+	}
+	else if( level > supported )
+	{
+		return false;
+	}
+
+	cpu_select( level );
+	return true;
+}
+
+imageio_cpu_t imageio_cpu( void )
+{
+	cpu_kernels( );
+	return cpu_level;
+}
+
 bool imageio_is_opaque( const image_t* img, bool* p_partially_opaque )
 {
 	bool completely_opaque     = true;
@@ -2166,7 +7814,7 @@ bool imageio_is_opaque( const image_t* img, bool* p_partially_opaque )
 		{
 			for( size_t x = 0; x < img->width; x++ )
 			{
-				size_t index = (y * img->width + x) * img->channels;
+				size_t index = y * imageio_image_stride( img ) + x * img->channels;
 				bool is_pixel_opaque = img->pixels[ index + 3 ] > 0;
 
 				if( !contains_opaque_pixel && is_pixel_opaque )
@@ -2210,7 +7858,7 @@ const char* imageio_image_string( const image_t* img )
 uint32_t imageio_get_pixel( image_t* img, int x, int y )
 {
 	assert( img->channels == 3 || img->channels == 4 );
-	size_t index = (img->width * y + x) * img->channels;
+	size_t index = (size_t) y * imageio_image_stride( img ) + (size_t) x * img->channels;
 	uint32_t* color = (uint32_t*) &img->pixels[ index ];
 	return *color;
 }
@@ -2218,7 +7866,7 @@ uint32_t imageio_get_pixel( image_t* img, int x, int y )
 void imageio_set_pixel( image_t* img, int x, int y, uint32_t color )
 {
 	assert( img->channels == 3 || img->channels == 4 );
-	size_t index = (img->width * y + x) * img->channels;
+	size_t index = (size_t) y * imageio_image_stride( img ) + (size_t) x * img->channels;
 
 	//printf( "imageio_set_pixel() #%06X \n", color );
 
@@ -2242,7 +7890,7 @@ void imageio_set_pixel( image_t* img, int x, int y, uint32_t color )
 void imageio_set_pixel_aa( image_t* img, int x, int y, uint32_t color, float intensity )
 {
 	assert( img->channels == 3 || img->channels == 4 );
-	size_t index = (img->width * y + x) * img->channels;
+	size_t index = (size_t) y * imageio_image_stride( img ) + (size_t) x * img->channels;
 
 	//printf( "imageio_set_pixel() #%06X   %0.3f\n", color, intensity );
 
@@ -67,11 +67,21 @@ typedef int            int32_t;
 #endif
 
 
+/* Bumped whenever image_t changes shape. Version 0.7 widened the image
+ * dimensions from 16 to 32 bits.
+ */
+#define IMAGEIO_VERSION_MAJOR  0
+#define IMAGEIO_VERSION_MINOR  7
+#define IMAGEIO_VERSION        ((IMAGEIO_VERSION_MAJOR << 16) | IMAGEIO_VERSION_MINOR)
+
+#define IMAGEIO_ROW_ALIGNMENT  64
+
 imageio_api typedef enum imageio_file_format {
 	IMAGEIO_BMP,
 	IMAGEIO_TGA,
 	IMAGEIO_PNG,
-	IMAGEIO_PVR /* Compressed Texture Format */
+	IMAGEIO_PVR, /* Compressed Texture Format */
+	IMAGEIO_RAW  /* Uncompressed, mappable; see imageio_image_save_raw */
 } image_file_format_t;
 
 /* deprecated flags */
@@ -90,35 +100,382 @@ imageio_api typedef enum imageio_resize_algorithm {
 	ALG_BILINEAR,
 	ALG_BILINEAR_SHARPER,
 	ALG_BICUBIC,
+	ALG_LANCZOS3,
+	ALG_MITCHELL,
+	ALG_CATMULL_ROM,
 } resize_algorithm_t;
 
+/* A resize plan caches everything that depends only on the resize geometry
+ * so that repeated resizes of the same size do not allocate; see
+ * imageio_resize_plan_create.
+ */
+typedef struct imageio_resize_plan imageio_resize_plan_t;
+
+/* Callbacks for reading and writing images somewhere other than a file.
+ * read and write return the number of bytes moved; seek works like fseek
+ * and returns 0 on success. Loading only needs read (seek, if given, is
+ * used to skip ahead) and saving only needs write.
+ */
+imageio_api typedef struct imageio_io {
+	void* user;
+	size_t (*read)  ( void* user, void* buffer, size_t size );
+	size_t (*write) ( void* user, const void* buffer, size_t size );
+	int    (*seek)  ( void* user, long offset, int whence );
+} imageio_io_t;
+
+/* Row y of an image starts at pixels + y * stride. A stride of 0 means
+ * the rows are tightly packed (width * bit_depth / 8 bytes apart), so an
+ * image built by hand should start zeroed. imageio_image_destroy frees
+ * pixels the library allocated itself and hands any others to free(), so
+ * they may come from malloc.
+ */
 imageio_api typedef struct imageio_image {
-	uint16_t width;
-	uint16_t height;
+	uint32_t width;
+	uint32_t height;
 	uint8_t  bit_depth;
 	uint8_t  channels;
 	uint8_t* pixels;
+	size_t   stride;
 } image_t;
 
+/* The pixel layout an image is decoded into. NATIVE keeps what the file
+ * has (RGB or RGBA for BMP, TGA and PNG; PVR data is passed through);
+ * the others are always 8 bits per channel and are produced while
+ * decoding, without extra passes over the image. BGR8 and BGRA8 are how
+ * BMP and TGA store their pixels.
+ */
+imageio_api typedef enum imageio_layout {
+	IMAGEIO_LAYOUT_NATIVE,
+	IMAGEIO_LAYOUT_RGBA8,
+	IMAGEIO_LAYOUT_BGRA8,
+	IMAGEIO_LAYOUT_RGB8,
+	IMAGEIO_LAYOUT_GRAY8,
+	IMAGEIO_LAYOUT_BGR8,
+} imageio_layout_t;
+
+imageio_api typedef struct imageio_load_options {
+	imageio_layout_t layout;
+	uint32_t         row_alignment; /* power of 2 to pad rows to; 0 packs them tightly */
+} imageio_load_options_t;
+
+/* How imageio_png_save trades encode speed for size; other formats ignore
+ * these. The preset fills in every setting and any field that isn't 0
+ * overrides it. A zeroed struct (or NULL) keeps libpng's defaults.
+ * FASTEST is for scratch files that are read back soon, SMALLEST for files
+ * that are written once and downloaded often.
+ */
+imageio_api typedef enum imageio_png_preset {
+	IMAGEIO_PNG_DEFAULT,  /* level 6, adaptive filters */
+	IMAGEIO_PNG_FASTEST,  /* level 1 run-length matching, SUB filter */
+	IMAGEIO_PNG_BALANCED, /* level 4, adaptive filters */
+	IMAGEIO_PNG_SMALLEST, /* level 9, adaptive filters */
+} imageio_png_preset_t;
+
+imageio_api typedef enum imageio_png_strategy {
+	IMAGEIO_PNG_STRATEGY_PRESET,
+	IMAGEIO_PNG_STRATEGY_DEFAULT,
+	IMAGEIO_PNG_STRATEGY_FILTERED,
+	IMAGEIO_PNG_STRATEGY_HUFFMAN_ONLY,
+	IMAGEIO_PNG_STRATEGY_RLE,
+} imageio_png_strategy_t;
+
+imageio_api typedef enum imageio_png_filter {
+	IMAGEIO_PNG_FILTER_PRESET,
+	IMAGEIO_PNG_FILTER_ADAPTIVE, /* libpng picks one for each row */
+	IMAGEIO_PNG_FILTER_NONE,
+	IMAGEIO_PNG_FILTER_SUB,
+	IMAGEIO_PNG_FILTER_UP,
+	IMAGEIO_PNG_FILTER_AVG,
+	IMAGEIO_PNG_FILTER_PAETH,
+} imageio_png_filter_t;
+
+#define IMAGEIO_PNG_STORED  (-1) /* png_level for no compression at all */
 
+imageio_api typedef struct imageio_save_options {
+	imageio_png_preset_t   png_preset;
+	int                    png_level;       /* zlib level, 1 (fastest) to 9 (smallest) */
+	imageio_png_strategy_t png_strategy;
+	imageio_png_filter_t   png_filter;
+	uint32_t               png_buffer_size; /* bytes of compressed data per IDAT chunk */
+} imageio_save_options_t;
+
+/* A rectangle of pixels inside an image (or any buffer of 8-bit channels).
+ * A view doesn't own its pixels, so cropping one costs nothing; the kernels
+ * that take views read and write the parent's rows in place.
+ */
+imageio_api typedef struct imageio_view {
+	uint8_t* pixels;   /* top left pixel of the view */
+	uint32_t width;
+	uint32_t height;
+	size_t   stride;   /* bytes from one row to the next */
+	uint8_t  channels; /* bytes per pixel */
+} imageio_view_t;
+
+/* What loading an image would produce, as read from its header. */
+imageio_api typedef struct imageio_info {
+	uint32_t width;
+	uint32_t height;
+	uint8_t  bit_depth;
+	uint8_t  channels;
+	image_file_format_t format;
+} imageio_info_t;
+
+
+/* Loads a file of any supported format. The format is recognized from the
+ * file's first bytes, or from its extension when they don't match any, and
+ * is stored in fmt if it isn't NULL.
+ */
 imageio_api bool imageio_load          ( image_t* img, const char* filename, image_file_format_t* fmt );
+/* Loads a file (recognized like imageio_load) scaled down to fit within
+ * max_width x max_height with its aspect ratio kept. Rows are streamed and
+ * averaged into the smaller image as they are read, so the full size image
+ * is never in memory; images that already fit come out as they are.
+ * 16-bit PNGs come out with 8 bits per channel. Like imageio_reader_t,
+ * interlaced PNGs, PVR textures and RAW files aren't supported.
+ */
+imageio_api bool imageio_load_thumbnail    ( image_t* img, const char* filename, uint32_t max_width, uint32_t max_height );
+imageio_api bool imageio_load_thumbnail_io ( image_t* img, imageio_io_t* io, image_file_format_t format, uint32_t max_width, uint32_t max_height );
 imageio_api bool imageio_image_load    ( image_t* img, const char* filename, image_file_format_t format );
+imageio_api bool imageio_image_load_ex ( image_t* img, const char* filename, image_file_format_t format, const imageio_load_options_t* options );
 imageio_api bool imageio_image_save    ( const image_t* img, const char* filename, image_file_format_t format );
-imageio_api bool imageio_image_create  ( image_t* img, uint16_t width, uint16_t height, uint8_t bit_depth );
+imageio_api bool imageio_image_load_memory ( image_t* img, const void* data, size_t size, image_file_format_t format );
+imageio_api bool imageio_image_load_memory_ex ( image_t* img, const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api bool imageio_image_save_memory ( const image_t* img, void** data, size_t* size, image_file_format_t format ); /* free *data with imageio_free() */
+imageio_api bool imageio_image_load_io     ( image_t* img, imageio_io_t* io, image_file_format_t format );
+imageio_api bool imageio_image_load_io_ex  ( image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api bool imageio_image_save_io     ( const image_t* img, imageio_io_t* io, image_file_format_t format );
+imageio_api bool imageio_image_save_ex        ( const image_t* img, const char* filename, image_file_format_t format, const imageio_save_options_t* options );
+imageio_api bool imageio_image_save_memory_ex ( const image_t* img, void** data, size_t* size, image_file_format_t format, const imageio_save_options_t* options );
+imageio_api bool imageio_image_save_io_ex     ( const image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_save_options_t* options );
+/* Decode into the caller's buffer instead of allocating one. Row y starts
+ * stride bytes after row y - 1 (0 packs the rows tightly). Nothing is
+ * decoded if dst_size can't hold the image; don't call imageio_image_destroy
+ * on the result.
+ */
+imageio_api bool imageio_image_load_into        ( image_t* img, void* dst, size_t dst_size, size_t stride, const char* filename, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api bool imageio_image_load_memory_into ( image_t* img, void* dst, size_t dst_size, size_t stride, const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api bool imageio_image_load_io_into     ( image_t* img, void* dst, size_t dst_size, size_t stride, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options );
+/* Decodes only the width x height rectangle at (x, y), with rows counted
+ * the way imageio_image_load stores them. BMP and TGA seek past the pixels
+ * outside it; PNG stops after the last row needed and crops each row. The
+ * rectangle must lie inside the image. Interlaced PNGs, PVR textures and
+ * RAW files aren't supported.
+ */
+imageio_api bool imageio_image_load_region    ( image_t* img, const char* filename, image_file_format_t format, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const imageio_load_options_t* options );
+imageio_api bool imageio_image_load_region_io ( image_t* img, imageio_io_t* io, image_file_format_t format, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const imageio_load_options_t* options );
+/* An uncompressed BMP, TGA, PVR or RAW file mapped read-only into memory,
+ * so "loading" copies nothing and the pages are shared by every process
+ * that maps the file. The view's pixels point into the mapping: rows are in
+ * the order imageio_image_load stores them, stride includes the BMP row
+ * padding, and the channels stay in the file's order (layout is BGR8,
+ * BGRA8 or GRAY8; a RAW file has the layout it was saved with). A PVR
+ * payload isn't rows of pixels; data and size cover it and the view's
+ * stride is 0. The view is level 0 of a RAW file's mip levels, and data
+ * and size cover all of them. Nothing may be written through the view.
+ */
+imageio_api typedef struct imageio_mapped_image {
+	imageio_view_t      view;
+	imageio_layout_t    layout;
+	uint8_t             bit_depth;
+	image_file_format_t format;
+	const uint8_t*      data;          /* the pixel payload */
+	size_t              size;
+	void*               mapping;       /* the whole file */
+	size_t              mapping_size;
+	uint32_t            levels;        /* mip levels of a RAW file, else 1 */
+} imageio_mapped_image_t;
+
+imageio_api bool imageio_image_map   ( imageio_mapped_image_t* img, const char* filename, image_file_format_t format );
+imageio_api void imageio_image_unmap ( imageio_mapped_image_t* img );
+/* IMAGEIO_RAW keeps the pixels as image_t holds them, after a 128 byte
+ * header and with every row padded to 64 bytes, so the rows of a mapped
+ * file are aligned like imageio_image_create_aligned's. Saving can append
+ * mip levels (each half the size of the one before, box filtered; 8-bit
+ * channels only, at most 16 levels) and a crc32 of each level, which
+ * imageio_image_load checks and imageio_raw_verify checks on a mapping.
+ * layout only labels the channel order and has to have as many channels
+ * as the image (NATIVE picks RGB8, RGBA8 or GRAY8); loading hands the
+ * pixels out as saved, so it only takes that layout or NATIVE. Images
+ * whose channels aren't bit_depth / 8 are refused either way.
+ * imageio_image_save stores the image alone, with checksums. Header
+ * fields are in the byte order of the machine that saved the file.
+ */
+imageio_api typedef struct imageio_raw_options {
+	imageio_layout_t layout;
+	uint32_t         levels;   /* 0 or 1 stores just the image; more than the image has is cut short */
+	bool             checksum;
+} imageio_raw_options_t;
+
+imageio_api bool imageio_image_save_raw    ( const image_t* img, const char* filename, const imageio_raw_options_t* options );
+imageio_api bool imageio_image_save_raw_io ( const image_t* img, imageio_io_t* io, const imageio_raw_options_t* options );
+imageio_api bool imageio_raw_level         ( const imageio_mapped_image_t* img, uint32_t level, imageio_view_t* view );
+imageio_api bool imageio_raw_verify        ( const imageio_mapped_image_t* img );
+/* Reads just the header (the BMP info header, TGA header, PVR header or the
+ * PNG chunks before the pixel data) without decoding or allocating pixels.
+ */
+imageio_api bool imageio_probe             ( imageio_info_t* info, const char* filename, image_file_format_t format );
+imageio_api bool imageio_probe_memory      ( imageio_info_t* info, const void* data, size_t size, image_file_format_t format );
+imageio_api bool imageio_probe_io          ( imageio_info_t* info, imageio_io_t* io, image_file_format_t format );
+/* Reads an image a few rows at a time, so memory grows with the width of
+ * the image instead of its size. Rows come out in the order and layout
+ * imageio_image_load_ex would store them; info describes those rows.
+ * read_rows copies up to count rows into dst, stride bytes apart (0 packs
+ * them), and returns how many it read. Reading stops early at the last row
+ * or on a damaged file (see imageio_reader_failed). Interlaced PNGs, PVR
+ * textures and RAW files can't be read this way.
+ */
+typedef struct imageio_reader imageio_reader_t;
+
+imageio_api imageio_reader_t*     imageio_reader_open        ( const char* filename, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api imageio_reader_t*     imageio_reader_open_memory ( const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api imageio_reader_t*     imageio_reader_open_io     ( imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api const imageio_info_t* imageio_reader_info        ( const imageio_reader_t* reader );
+imageio_api uint32_t              imageio_reader_read_rows   ( imageio_reader_t* reader, void* dst, size_t stride, uint32_t count );
+imageio_api bool                  imageio_reader_failed      ( const imageio_reader_t* reader );
+imageio_api void                  imageio_reader_close       ( imageio_reader_t* reader );
+/* Decodes a PNG from bytes as they arrive, e.g. off a socket. push hands
+ * over the next chunk, of any size; row is called for each row as soon as
+ * it is complete, top to bottom, in the layout asked for. info is NULL
+ * until the header has arrived. Interlaced images are held whole and their
+ * rows delivered once the last pass is in. push returns false once the
+ * data turned out to be damaged; done tells when the image is complete.
+ */
+typedef void (*imageio_row_fxn)( void* user, uint32_t y, const uint8_t* row );
+typedef struct imageio_progressive imageio_progressive_t;
+
+imageio_api imageio_progressive_t* imageio_progressive_create  ( const imageio_load_options_t* options, imageio_row_fxn row, void* user );
+imageio_api bool                   imageio_progressive_push    ( imageio_progressive_t* decoder, const void* data, size_t size );
+imageio_api const imageio_info_t*  imageio_progressive_info    ( const imageio_progressive_t* decoder );
+imageio_api bool                   imageio_progressive_done    ( const imageio_progressive_t* decoder );
+imageio_api void                   imageio_progressive_destroy ( imageio_progressive_t* decoder );
+/* The save side of imageio_reader_t. The size and bit depth (8, 24 or 32)
+ * are fixed at open, and rows are written as they are handed in (row 0
+ * first, in the layout imageio_image_save takes), so only the rows being
+ * written have to be in memory. The source rows are not modified. close
+ * finishes the file and returns false if a write failed or fewer than
+ * height rows were written.
+ */
+typedef struct imageio_writer imageio_writer_t;
+
+imageio_api imageio_writer_t* imageio_writer_open       ( const char* filename, image_file_format_t format, uint32_t width, uint32_t height, uint8_t bit_depth );
+imageio_api imageio_writer_t* imageio_writer_open_io    ( imageio_io_t* io, image_file_format_t format, uint32_t width, uint32_t height, uint8_t bit_depth );
+imageio_api uint32_t          imageio_writer_write_rows ( imageio_writer_t* writer, const void* src, size_t stride, uint32_t count );
+imageio_api bool              imageio_writer_close      ( imageio_writer_t* writer );
+
+/* Loading or saving many small images one after another spends much of
+ * its time setting up libpng and zlib. A decoder or encoder keeps that
+ * memory (the png structs, the inflate or deflate state and the row
+ * pointers) from one image to the next, so once it has grown to fit it
+ * allocates nothing but the decoded pixels. Each one holds no other state
+ * and is meant to be kept per thread; it must not be used by two threads
+ * at once. BMP, TGA and RAW files go through the usual loaders. The data
+ * from imageio_encoder_save_memory belongs to the encoder and stays valid
+ * until its next save.
+ */
+typedef struct imageio_decoder imageio_decoder_t;
+typedef struct imageio_encoder imageio_encoder_t;
+
+imageio_api imageio_decoder_t* imageio_decoder_create      ( void );
+imageio_api bool               imageio_decoder_load        ( imageio_decoder_t* decoder, image_t* img, const char* filename, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api bool               imageio_decoder_load_memory ( imageio_decoder_t* decoder, image_t* img, const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api bool               imageio_decoder_load_io     ( imageio_decoder_t* decoder, image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_load_options_t* options );
+imageio_api void               imageio_decoder_destroy     ( imageio_decoder_t* decoder );
+imageio_api imageio_encoder_t* imageio_encoder_create      ( void );
+imageio_api bool               imageio_encoder_save        ( imageio_encoder_t* encoder, const image_t* img, const char* filename, image_file_format_t format, const imageio_save_options_t* options );
+imageio_api bool               imageio_encoder_save_memory ( imageio_encoder_t* encoder, const image_t* img, const void** data, size_t* size, image_file_format_t format, const imageio_save_options_t* options );
+imageio_api bool               imageio_encoder_save_io     ( imageio_encoder_t* encoder, const image_t* img, imageio_io_t* io, image_file_format_t format, const imageio_save_options_t* options );
+imageio_api void               imageio_encoder_destroy     ( imageio_encoder_t* encoder );
+imageio_api bool imageio_image_create  ( image_t* img, uint32_t width, uint32_t height, uint8_t bit_depth );
+/* Like imageio_image_create, but the pixels and every row start on an
+ * alignment byte boundary (a power of 2; 0 means IMAGEIO_ROW_ALIGNMENT).
+ */
+imageio_api bool imageio_image_create_aligned ( image_t* img, uint32_t width, uint32_t height, uint8_t bit_depth, uint32_t alignment );
 imageio_api void imageio_image_destroy ( image_t* img );
 imageio_api void imageio_image_resize  ( uint32_t src_width, uint32_t src_height, const uint8_t* src_bitmap,
                                          uint32_t dst_width, uint32_t dst_height, uint8_t* dst_bitmap, uint32_t bit_depth,
                                          resize_algorithm_t algorithm );
+/* A plan resizes src_width x src_height images of bit_depth bits per pixel
+ * to dst_width x dst_height with the given algorithm. Creating it computes
+ * the coordinate tables, filter weights and scratch rows; executing it
+ * allocates nothing and can be repeated any number of times. execute takes
+ * tightly packed rows, execute_stride takes rows stride bytes apart (0 for
+ * packed). Both return false if the plan or a bitmap is NULL or a stride is
+ * shorter than a row.
+ *
+ * The separable filters (bicubic, Lanczos3, Mitchell and Catmull-Rom) keep
+ * one ring of scratch rows per row band in the plan, and the number of bands
+ * is fixed by imageio_thread_count() when the plan is created. The scratch
+ * is shared by every execute, so a plan must not be executed by two threads
+ * at once; give each thread its own plan.
+ */
+imageio_api imageio_resize_plan_t* imageio_resize_plan_create  ( uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height,
+                                                               uint32_t bit_depth, resize_algorithm_t algorithm );
+imageio_api bool                   imageio_resize_plan_execute ( imageio_resize_plan_t* plan, const uint8_t* src_bitmap, uint8_t* dst_bitmap );
+imageio_api bool                   imageio_resize_plan_execute_stride ( imageio_resize_plan_t* plan, const uint8_t* src_bitmap, size_t src_stride, uint8_t* dst_bitmap, size_t dst_stride );
+imageio_api void                   imageio_resize_plan_destroy ( imageio_resize_plan_t* plan );
+/* Kernels split their work into row bands that run on up to count threads,
+ * including the calling thread. Passing 0 uses one thread per online CPU.
+ * The default is 1 (everything runs on the calling thread). Output does
+ * not depend on the thread count. Don't call this while other imageio
+ * calls are in flight. Windows builds have no pool: the count is ignored
+ * and everything runs on the calling thread.
+ */
+imageio_api void     imageio_set_thread_count ( uint32_t count );
+imageio_api uint32_t imageio_thread_count     ( void );
+
+typedef void* (*imageio_alloc_fxn)   ( size_t size, void* user );
+typedef void* (*imageio_realloc_fxn) ( void* ptr, size_t size, void* user );
+typedef void  (*imageio_free_fxn)    ( void* ptr, void* user );
+
+/* Routes every allocation the library makes through the given functions,
+ * which behave like malloc, realloc and free and get user as their last
+ * argument. That covers pixel buffers, row pointers and temporaries as
+ * well as libpng's structs and zlib's state. Passing three NULLs restores
+ * the C library's allocator; passing only some of them fails. Memory has
+ * to be freed by the allocator that handed it out, so switch only while
+ * nothing the library allocated is alive and no other imageio calls are
+ * in flight. Buffers returned by imageio_image_save_memory(_ex) are
+ * released with imageio_free.
+ */
+imageio_api bool imageio_set_allocator ( imageio_alloc_fxn alloc, imageio_realloc_fxn realloc, imageio_free_fxn free, void* user );
+imageio_api void imageio_free          ( void* ptr );
+
+imageio_api typedef enum imageio_cpu {
+	IMAGEIO_CPU_DETECT,
+	IMAGEIO_CPU_SCALAR,
+	IMAGEIO_CPU_SSE2,
+	IMAGEIO_CPU_SSSE3,
+	IMAGEIO_CPU_AVX2,
+} imageio_cpu_t;
+
+/* The resize, blend, channel swap and YUV kernels are picked at run time
+ * from what the CPU supports. Setting IMAGEIO_CPU to scalar, sse2, ssse3
+ * or avx2 in the environment caps the level on first use; imageio_set_cpu()
+ * switches it later and fails if the CPU can't run the level asked for.
+ * IMAGEIO_CPU_DETECT goes back to the best level. All levels produce the
+ * same bytes. Don't call this while other imageio calls are in flight.
+ */
+imageio_api bool          imageio_set_cpu ( imageio_cpu_t level );
+imageio_api imageio_cpu_t imageio_cpu     ( void );
+
 imageio_api bool imageio_blit          ( uint32_t pos_x, uint32_t pos_y,
                                          uint32_t dst_width, uint32_t dst_height, uint32_t dst_bytes_per_pixel, uint8_t* dst_pixels,
                                          uint32_t src_width, uint32_t src_height, uint32_t src_bytes_per_pixel, uint8_t* src_pixels );
 
 
+static inline size_t imageio_image_stride( const image_t* img )
+{
+	return img->stride ? img->stride : (size_t) img->width * (img->bit_depth >> 3);
+}
+
 static inline size_t imageio_image_size( const image_t* img )
 {
-	return img->width * img->height * (img->bit_depth >> 3);
+	return imageio_image_stride( img ) * img->height;
 }
 
+imageio_api bool imageio_image_blit ( image_t* dst, uint32_t pos_x, uint32_t pos_y, const image_t* src );
+
+
 imageio_api typedef enum imageio_blend_mode {
 	IMAGEIO_BLEND_NORMAL,
 	IMAGEIO_BLEND_LIGHTEN,
@@ -150,6 +507,17 @@ imageio_api typedef enum imageio_blend_mode {
 
 imageio_api bool imageio_blend( image_t* dst, uint32_t pos_x, uint32_t pos_y, const image_t* src, blend_mode_t mode );
 
+/* Views fail (return false) when the rectangle isn't inside the parent. */
+imageio_api bool imageio_image_view          ( imageio_view_t* view, const image_t* img, uint32_t x, uint32_t y, uint32_t width, uint32_t height );
+imageio_api bool imageio_view_crop           ( imageio_view_t* view, const imageio_view_t* parent, uint32_t x, uint32_t y, uint32_t width, uint32_t height );
+imageio_api bool imageio_blit_view           ( const imageio_view_t* dst, uint32_t pos_x, uint32_t pos_y, const imageio_view_t* src );
+imageio_api bool imageio_blend_view          ( const imageio_view_t* dst, uint32_t pos_x, uint32_t pos_y, const imageio_view_t* src, blend_mode_t mode );
+imageio_api bool imageio_image_resize_view   ( const imageio_view_t* src, const imageio_view_t* dst, resize_algorithm_t algorithm );
+/* Saves only read the parent's rows; BMP and TGA are swapped to BGR a row at a time. */
+imageio_api bool imageio_image_save_view     ( const imageio_view_t* view, const char* filename, image_file_format_t format );
+imageio_api bool imageio_image_save_view_memory ( const imageio_view_t* view, void** data, size_t* size, image_file_format_t format );
+imageio_api bool imageio_image_save_view_io  ( const imageio_view_t* view, imageio_io_t* io, image_file_format_t format );
+
 imageio_api void imageio_blend_rgb( uint8_t* result, uint8_t* top, uint8_t* bottom, blend_mode_t mode );
 imageio_api void imageio_blend_rgba( uint8_t* result, uint8_t* top, uint8_t* bottom, blend_mode_t mode );
 
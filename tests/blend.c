@@ -39,8 +39,8 @@ int main( int argc, char* argv[] )
 
 
 		image_t dst = (image_t) {
-			.width     = (uint16_t) fmax( a.width, b.width ),
-			.height    = (uint16_t) fmax( a.width, b.width ),
+			.width     = (uint32_t) fmax( a.width, b.width ),
+			.height    = (uint32_t) fmax( a.width, b.width ),
 			.bit_depth = (uint8_t) fmax( a.bit_depth, b.bit_depth ),
 			.channels  = 4
 		};
@@ -0,0 +1,138 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _CHECK_H_
+#define _CHECK_H_
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "../src/imageio.h"
+
+/*
+ *  Check tests. Each check prints a line and counts against the exit
+ *  status; the patterned images and their saved files are shared so
+ *  every test starts from the same pixels.
+ */
+#define CHECK_FORMAT(format)  (1u << (format))
+#define CHECK_FORMATS         (CHECK_FORMAT(IMAGEIO_BMP) | CHECK_FORMAT(IMAGEIO_TGA) | CHECK_FORMAT(IMAGEIO_PNG))
+
+typedef struct check_case {
+	const image_t*      image;      /* a pattern image */
+	image_file_format_t format;
+	const void*         data;       /* the image as imageio_image_save_memory saved it */
+	size_t              size;
+	char                name[ 16 ]; /* "png 32-bit" */
+} check_case_t;
+
+static int check_failures = 0;
+
+static inline void check( bool ok, const char* format, ... )
+{
+	char what[ 128 ];
+	va_list args;
+
+	va_start( args, format );
+	vsnprintf( what, sizeof(what), format, args );
+	va_end( args );
+
+	printf( "%-56s %s\n", what, ok ? "ok" : "FAILED" );
+	check_failures += ok ? 0 : 1;
+}
+
+static inline int check_result( void )
+{
+	return check_failures == 0 ? 0 : 1;
+}
+
+static inline void check_pattern( uint8_t* bytes, size_t size )
+{
+	size_t i;
+
+	for( i = 0; i < size; i++ )
+	{
+		bytes[ i ] = (uint8_t) (i * 13 + (i >> 7));
+	}
+}
+
+static inline bool check_pattern_image( image_t* img, uint32_t width, uint32_t height, uint32_t bit_depth )
+{
+	if( !imageio_image_create( img, width, height, (uint8_t) bit_depth ) )
+	{
+		return false;
+	}
+
+	check_pattern( img->pixels, imageio_image_stride( img ) * height );
+	return true;
+}
+
+/* Calls fxn with a width x height pattern image, at 24 and 32 bits, saved
+ * in each of the formats (a mask of CHECK_FORMAT bits).
+ */
+static inline void check_each_format( uint32_t width, uint32_t height, unsigned int formats, void (*fxn)( const check_case_t* c ) )
+{
+	static const struct {
+		image_file_format_t format;
+		const char* name;
+	} names[] = {
+		{ IMAGEIO_BMP, "bmp" },
+		{ IMAGEIO_TGA, "tga" },
+		{ IMAGEIO_PNG, "png" },
+	};
+	uint32_t bit_depth;
+	size_t f;
+
+	for( bit_depth = 24; bit_depth <= 32; bit_depth += 8 )
+	{
+		image_t img;
+
+		if( !check_pattern_image( &img, width, height, bit_depth ) )
+		{
+			check( false, "%2u-bit pattern image", bit_depth );
+			continue;
+		}
+
+		for( f = 0; f < sizeof(names) / sizeof(names[ 0 ]); f++ )
+		{
+			check_case_t c = { &img, names[ f ].format, NULL, 0, "" };
+			void* data     = NULL;
+
+			if( (formats & CHECK_FORMAT(names[ f ].format)) == 0 )
+			{
+				continue;
+			}
+
+			snprintf( c.name, sizeof(c.name), "%s %2u-bit", names[ f ].name, bit_depth );
+
+			if( !imageio_image_save_memory( &img, &data, &c.size, c.format ) )
+			{
+				check( false, "%s  save", c.name );
+				continue;
+			}
+
+			c.data = data;
+			fxn( &c );
+			imageio_free( data );
+		}
+
+		imageio_image_destroy( &img );
+	}
+}
+
+#endif /* _CHECK_H_ */
@@ -0,0 +1,211 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/imageio.h"
+
+/*
+ * Runs every kernel that has vector versions at each CPU level the machine
+ * supports, on one thread and on four, and checks that the bytes are the
+ * same as the scalar kernels produce on one thread.
+ */
+typedef struct output {
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+} output_t;
+
+static void append( output_t* out, const void* data, size_t size )
+{
+	if( out->size + size > out->capacity )
+	{
+		out->capacity = 2 * (out->size + size);
+		out->data     = (uint8_t*) realloc( out->data, out->capacity );
+	}
+
+	memcpy( out->data + out->size, data, size );
+	out->size += size;
+}
+
+static void fill( uint8_t* pixels, size_t size, uint32_t seed )
+{
+	size_t i;
+
+	for( i = 0; i < size; i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		/* mostly smooth with some hard edges, so the filters overshoot */
+		pixels[ i ] = (i / 3) % 97 < 10 ? (uint8_t) (seed >> 24) : (uint8_t) (i * 7 / 5);
+	}
+}
+
+static void run_resizes( output_t* out )
+{
+	static const uint32_t sizes[][ 4 ] = {
+		{ 203, 117, 320, 240 },
+		{ 640, 480, 161, 97 },
+		{ 57, 300, 330, 29 },
+	};
+	uint32_t byte_count, size, algorithm;
+
+	for( byte_count = 3; byte_count <= 4; byte_count++ )
+	{
+		for( size = 0; size < sizeof(sizes) / sizeof(sizes[ 0 ]); size++ )
+		{
+			uint32_t src_width  = sizes[ size ][ 0 ];
+			uint32_t src_height = sizes[ size ][ 1 ];
+			uint32_t dst_width  = sizes[ size ][ 2 ];
+			uint32_t dst_height = sizes[ size ][ 3 ];
+			size_t src_stride   = (size_t) src_width * byte_count + 13;
+			size_t dst_stride   = (size_t) dst_width * byte_count + 7;
+			uint8_t* src        = (uint8_t*) malloc( src_stride * src_height );
+			uint8_t* dst        = (uint8_t*) malloc( dst_stride * dst_height );
+
+			fill( src, src_stride * src_height, size );
+
+			for( algorithm = ALG_NEARESTNEIGHBOR; algorithm <= ALG_CATMULL_ROM; algorithm++ )
+			{
+				imageio_resize_plan_t* plan = imageio_resize_plan_create( src_width, src_height, dst_width, dst_height, byte_count * 8, (resize_algorithm_t) algorithm );
+
+				memset( dst, 0, dst_stride * dst_height );
+
+				if( plan )
+				{
+					imageio_resize_plan_execute_stride( plan, src, src_stride, dst, dst_stride );
+					imageio_resize_plan_destroy( plan );
+				}
+
+				append( out, dst, dst_stride * dst_height );
+			}
+
+			free( src );
+			free( dst );
+		}
+	}
+}
+
+static void run_blends( output_t* out )
+{
+	uint32_t channels, mode;
+
+	for( channels = 3; channels <= 4; channels++ )
+	{
+		for( mode = IMAGEIO_BLEND_NORMAL; mode <= IMAGEIO_BLEND_ALPHA; mode++ )
+		{
+			image_t dst, src;
+
+			imageio_image_create( &dst, 301, 257, 32 );
+			imageio_image_create( &src, 283, 250, channels * 8 );
+			fill( dst.pixels, imageio_image_stride( &dst ) * dst.height, mode );
+			fill( src.pixels, imageio_image_stride( &src ) * src.height, mode + 100 );
+
+			if( imageio_blend( &dst, 11, 5, &src, (blend_mode_t) mode ) )
+			{
+				append( out, dst.pixels, imageio_image_stride( &dst ) * dst.height );
+			}
+
+			imageio_image_destroy( &dst );
+			imageio_image_destroy( &src );
+		}
+	}
+}
+
+static void run_conversions( output_t* out )
+{
+	uint32_t byte_count;
+
+	for( byte_count = 3; byte_count <= 4; byte_count++ )
+	{
+		const uint32_t width  = 333;
+		const uint32_t height = 251;
+		const size_t size     = (size_t) width * height * byte_count;
+		uint8_t* bitmap       = (uint8_t*) malloc( size );
+
+		fill( bitmap, size, byte_count );
+		imageio_swap_red_and_blue( width, height, byte_count, bitmap );
+		append( out, bitmap, size );
+		imageio_rgb_to_yuv444( width, height, byte_count, bitmap );
+		append( out, bitmap, size );
+		imageio_yuv444_to_rgb( width, height, byte_count, bitmap );
+		append( out, bitmap, size );
+		free( bitmap );
+	}
+}
+
+static output_t run_all( void )
+{
+	output_t out = { NULL, 0, 0 };
+
+	run_resizes( &out );
+	run_blends( &out );
+	run_conversions( &out );
+	return out;
+}
+
+int main( void )
+{
+	static const struct {
+		imageio_cpu_t level;
+		const char* name;
+	} levels[] = {
+		{ IMAGEIO_CPU_SCALAR, "scalar" },
+		{ IMAGEIO_CPU_SSE2,   "sse2" },
+		{ IMAGEIO_CPU_SSSE3,  "ssse3" },
+		{ IMAGEIO_CPU_AVX2,   "avx2" },
+	};
+	static const uint32_t threads[] = { 1, 4 };
+	output_t reference;
+	int failures = 0;
+	size_t l, t;
+
+	imageio_set_cpu( IMAGEIO_CPU_SCALAR );
+	imageio_set_thread_count( 1 );
+	reference = run_all( );
+
+	for( l = 0; l < sizeof(levels) / sizeof(levels[ 0 ]); l++ )
+	{
+		if( !imageio_set_cpu( levels[ l ].level ) )
+		{
+			printf( "%-6s  not supported, skipped\n", levels[ l ].name );
+			continue;
+		}
+
+		for( t = 0; t < sizeof(threads) / sizeof(threads[ 0 ]); t++ )
+		{
+			output_t out;
+			bool same;
+
+			imageio_set_thread_count( threads[ t ] );
+			out  = run_all( );
+			same = out.size == reference.size && memcmp( out.data, reference.data, out.size ) == 0;
+			printf( "%-6s  %u thread(s)  %s\n", levels[ l ].name, threads[ t ], same ? "ok" : "DIFFERS" );
+			failures += same ? 0 : 1;
+			free( out.data );
+		}
+	}
+
+	imageio_set_thread_count( 1 );
+	imageio_set_cpu( IMAGEIO_CPU_DETECT );
+	free( reference.data );
+	return failures == 0 ? 0 : 1;
+}
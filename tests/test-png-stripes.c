@@ -0,0 +1,117 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+
+/*
+ * Saves PNG images big enough to be deflated in stripes (over 2 MB of
+ * pixels) with several settings, on 1, 2, 4 and 8 threads and through an
+ * encoder, and checks that the bytes don't depend on how they were saved
+ * and that every file loads back pixel for pixel.
+ */
+static const struct {
+	const char* name;
+	imageio_save_options_t options;
+} settings[] = {
+	{ "default",      { IMAGEIO_PNG_DEFAULT,  0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PRESET, 0 } },
+	{ "fastest",      { IMAGEIO_PNG_FASTEST,  0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PRESET, 0 } },
+	{ "smallest",     { IMAGEIO_PNG_SMALLEST, 0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PRESET, 0 } },
+	{ "no filter",    { IMAGEIO_PNG_DEFAULT,  0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_NONE, 0 } },
+	{ "paeth",        { IMAGEIO_PNG_DEFAULT,  0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PAETH, 0 } },
+	{ "rle",          { IMAGEIO_PNG_DEFAULT,  0, IMAGEIO_PNG_STRATEGY_RLE, IMAGEIO_PNG_FILTER_PRESET, 0 } },
+	{ "stored",       { IMAGEIO_PNG_DEFAULT,  IMAGEIO_PNG_STORED, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PRESET, 0 } },
+	{ "small chunks", { IMAGEIO_PNG_DEFAULT,  0, IMAGEIO_PNG_STRATEGY_PRESET, IMAGEIO_PNG_FILTER_PRESET, 4096 } },
+};
+
+static bool loads_back( const void* data, size_t size, const image_t* img )
+{
+	image_t back;
+	bool ok;
+
+	if( !imageio_image_load_memory( &back, data, size, IMAGEIO_PNG ) )
+	{
+		return false;
+	}
+
+	ok = back.width == img->width && back.height == img->height && back.bit_depth == img->bit_depth &&
+	     memcmp( back.pixels, img->pixels, imageio_image_size( img ) ) == 0;
+
+	imageio_image_destroy( &back );
+	return ok;
+}
+
+static void stripes_case( const check_case_t* c )
+{
+	static const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+	imageio_encoder_t* encoder = imageio_encoder_create( );
+	size_t s, t;
+
+	check( imageio_image_size( c->image ) > 2 * 1024 * 1024, "%s  over two stripes of pixels", c->name );
+
+	for( s = 0; s < sizeof(settings) / sizeof(settings[ 0 ]); s++ )
+	{
+		const imageio_save_options_t* options = &settings[ s ].options;
+		void* first       = NULL;
+		size_t first_size = 0;
+		const void* encoded;
+		size_t encoded_size;
+		bool same = true;
+
+		imageio_set_thread_count( 1 );
+
+		if( !imageio_image_save_memory_ex( c->image, &first, &first_size, IMAGEIO_PNG, options ) )
+		{
+			check( false, "%s %-12s  save", c->name, settings[ s ].name );
+			continue;
+		}
+
+		check( loads_back( first, first_size, c->image ), "%s %-12s  loads back as the image", c->name, settings[ s ].name );
+
+		for( t = 1; t < sizeof(thread_counts) / sizeof(thread_counts[ 0 ]); t++ )
+		{
+			void* data  = NULL;
+			size_t size = 0;
+
+			imageio_set_thread_count( thread_counts[ t ] );
+			same = same && imageio_image_save_memory_ex( c->image, &data, &size, IMAGEIO_PNG, options ) &&
+			       size == first_size && memcmp( data, first, size ) == 0;
+			imageio_free( data );
+		}
+
+		check( same, "%s %-12s  same bytes on 1 to 8 threads", c->name, settings[ s ].name );
+		check( encoder && imageio_encoder_save_memory( encoder, c->image, &encoded, &encoded_size, IMAGEIO_PNG, options ) &&
+		       encoded_size == first_size && memcmp( encoded, first, first_size ) == 0,
+		       "%s %-12s  same bytes from an encoder", c->name, settings[ s ].name );
+		imageio_free( first );
+	}
+
+	imageio_set_thread_count( 1 );
+	imageio_encoder_destroy( encoder );
+}
+
+int main( void )
+{
+	check_each_format( 1100, 1000, CHECK_FORMAT(IMAGEIO_PNG), stripes_case );
+	return check_result();
+}
@@ -27,7 +27,7 @@
 
 void png_save32( void )
 {
-	image_t image;
+	image_t image = { 0 };
 	image.width      = 512;
 	image.height     = 512;
 	image.bit_depth  = 32;
@@ -60,7 +60,7 @@ void png_save32( void )
 
 void png_save8( void )
 {
-	image_t image;
+	image_t image = { 0 };
 	image.width     = 512;
 	image.height    = 512;
 	image.bit_depth = 8;
@@ -0,0 +1,129 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+
+/*
+ * Pushes PNG files into the progressive decoder in chunks of several
+ * sizes and checks that every row arrives once, in order, and matches
+ * what imageio_image_load_memory_ex stores. Damaged data has to make
+ * push fail.
+ */
+typedef struct collected {
+	uint8_t* rows;
+	size_t row_size;
+	uint32_t next_y;
+	bool in_order;
+} collected_t;
+
+static void collect_row( void* user, uint32_t y, const uint8_t* row )
+{
+	collected_t* collected = (collected_t*) user;
+
+	collected->in_order = collected->in_order && y == collected->next_y;
+	collected->next_y   = y + 1;
+	memcpy( collected->rows + (size_t) y * collected->row_size, row, collected->row_size );
+}
+
+/* Returns whether every push succeeded; the rows end up in collected. */
+static bool push_all( const uint8_t* data, size_t size, size_t chunk, const imageio_load_options_t* options, collected_t* collected, bool* done )
+{
+	imageio_progressive_t* decoder = imageio_progressive_create( options, collect_row, collected );
+	bool ok = decoder != NULL;
+	size_t offset;
+
+	for( offset = 0; ok && offset < size; offset += chunk )
+	{
+		ok = imageio_progressive_push( decoder, data + offset, size - offset < chunk ? size - offset : chunk );
+	}
+
+	*done = decoder && imageio_progressive_done( decoder );
+	imageio_progressive_destroy( decoder );
+	return ok;
+}
+
+static void push_case( const check_case_t* c )
+{
+	static const imageio_layout_t layouts[] = {
+		IMAGEIO_LAYOUT_NATIVE,
+		IMAGEIO_LAYOUT_RGBA8,
+		IMAGEIO_LAYOUT_BGR8,
+	};
+	static const size_t chunks[] = { 1, 7, 100, 4096 };
+	const uint8_t* data = (const uint8_t*) c->data;
+	size_t l, k;
+
+	for( l = 0; l < sizeof(layouts) / sizeof(layouts[ 0 ]); l++ )
+	{
+		imageio_load_options_t options = { layouts[ l ], 0 };
+		image_t expected;
+
+		if( !imageio_image_load_memory_ex( &expected, data, c->size, c->format, &options ) )
+		{
+			check( false, "%s layout %u  whole load", c->name, (uint32_t) layouts[ l ] );
+			continue;
+		}
+
+		for( k = 0; k < sizeof(chunks) / sizeof(chunks[ 0 ]); k++ )
+		{
+			const size_t row_size = (size_t) expected.width * (expected.bit_depth >> 3);
+			collected_t collected = { (uint8_t*) calloc( expected.height, row_size ), row_size, 0, true };
+			bool done, ok, same = true;
+			uint32_t y;
+
+			ok = push_all( data, c->size, chunks[ k ], &options, &collected, &done );
+
+			for( y = 0; y < expected.height; y++ )
+			{
+				same = same && memcmp( collected.rows + y * row_size, expected.pixels + y * imageio_image_stride( &expected ), row_size ) == 0;
+			}
+
+			check( ok && done && collected.in_order && collected.next_y == expected.height && same,
+			       "%s layout %u chunk %-6zu rows match a whole load", c->name, (uint32_t) layouts[ l ], chunks[ k ] );
+			free( collected.rows );
+		}
+
+		imageio_image_destroy( &expected );
+	}
+
+	/* bytes damaged in the middle of the pixel data */
+	{
+		const size_t row_size = (size_t) c->image->width * (c->image->bit_depth >> 3);
+		collected_t collected = { (uint8_t*) calloc( c->image->height, row_size ), row_size, 0, true };
+		uint8_t* damaged      = (uint8_t*) malloc( c->size );
+		bool done;
+
+		memcpy( damaged, data, c->size );
+		damaged[ c->size / 2 ] ^= 0x55;
+		check( !push_all( damaged, c->size, 64, NULL, &collected, &done ) && !done, "%s  damaged data fails", c->name );
+		free( damaged );
+		free( collected.rows );
+	}
+}
+
+int main( void )
+{
+	check_each_format( 67, 45, CHECK_FORMAT(IMAGEIO_PNG), push_case );
+	return check_result();
+}
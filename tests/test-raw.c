@@ -0,0 +1,180 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+
+/*
+ * Saves RAW images, loads and maps them back, and checks that headers
+ * which don't add up are refused by both loading and probing.
+ */
+#define FILENAME  "test-raw.raw"
+
+/* Where the header fields are; they are in this machine's byte order. */
+#define OFFSET_VERSION      4
+#define OFFSET_HEADER_SIZE  6
+#define OFFSET_WIDTH        8
+#define OFFSET_BIT_DEPTH    16
+#define OFFSET_CHANNELS     17
+#define OFFSET_LAYOUT       18
+#define OFFSET_LEVELS       19
+#define OFFSET_DATA_SIZE    24
+#define OFFSET_PIXELS       128
+
+static bool same_rows( const uint8_t* a, size_t a_stride, const uint8_t* b, size_t b_stride, size_t row_size, uint32_t height )
+{
+	uint32_t y;
+
+	for( y = 0; y < height; y++ )
+	{
+		if( memcmp( a + y * a_stride, b + y * b_stride, row_size ) != 0 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool not_loaded( const uint8_t* data, size_t size )
+{
+	image_t img;
+
+	if( imageio_image_load_memory( &img, data, size, IMAGEIO_RAW ) )
+	{
+		imageio_image_destroy( &img );
+		return false;
+	}
+
+	return true;
+}
+
+/* Probing reads only the header, so it has to catch these too. */
+static bool refused( const uint8_t* data, size_t size )
+{
+	imageio_info_t info;
+
+	return not_loaded( data, size ) && !imageio_probe_memory( &info, data, size, IMAGEIO_RAW );
+}
+
+static void check_malformed( const uint8_t* data, size_t size )
+{
+	uint8_t* copy = (uint8_t*) malloc( size );
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+
+	#define MUTATE( what, change ) \
+		memcpy( copy, data, size ); \
+		change; \
+		check( refused( copy, size ), what )
+
+	MUTATE( "bad magic refused", copy[ 0 ] = 'X' );
+	MUTATE( "unknown version refused", u16 = 2; memcpy( copy + OFFSET_VERSION, &u16, 2 ) );
+	MUTATE( "unaligned header size refused", u16 = 100; memcpy( copy + OFFSET_HEADER_SIZE, &u16, 2 ) );
+	MUTATE( "zero width refused", u32 = 0; memcpy( copy + OFFSET_WIDTH, &u32, 4 ) );
+	MUTATE( "bit depth not in bytes refused", copy[ OFFSET_BIT_DEPTH ] = 28 );
+	MUTATE( "channels not bit depth / 8 refused", copy[ OFFSET_CHANNELS ] = 3 );
+	MUTATE( "zero channels refused", copy[ OFFSET_CHANNELS ] = 0 );
+	MUTATE( "unknown layout refused", copy[ OFFSET_LAYOUT ] = 99 );
+	MUTATE( "layout with other channels refused", copy[ OFFSET_LAYOUT ] = IMAGEIO_LAYOUT_GRAY8 );
+	MUTATE( "zero levels refused", copy[ OFFSET_LEVELS ] = 0 );
+	MUTATE( "too many levels refused", copy[ OFFSET_LEVELS ] = 17 );
+	MUTATE( "levels that don't add up refused", copy[ OFFSET_LEVELS ] = 2 );
+	MUTATE( "wrong data size refused", memcpy( &u64, copy + OFFSET_DATA_SIZE, 8 ); u64 += 64; memcpy( copy + OFFSET_DATA_SIZE, &u64, 8 ) );
+	check( refused( data, 64 ), "truncated header refused" );
+
+	#undef MUTATE
+
+	memcpy( copy, data, size );
+	copy[ OFFSET_PIXELS ] ^= 1;
+	check( not_loaded( copy, size ), "corrupt pixels not loaded" );
+	check( not_loaded( data, size / 2 ), "truncated pixels not loaded" );
+	free( copy );
+}
+
+int main( void )
+{
+	imageio_raw_options_t options = { IMAGEIO_LAYOUT_NATIVE, 4, true };
+	imageio_mapped_image_t mapped;
+	imageio_view_t level;
+	image_t img, back, odd;
+	void* data    = NULL;
+	size_t size   = 0;
+	bool ok;
+
+	check_pattern_image( &img, 97, 61, 32 );
+
+	/* memory round trip */
+	ok = imageio_image_save_memory( &img, &data, &size, IMAGEIO_RAW ) &&
+	     imageio_image_load_memory( &back, data, size, IMAGEIO_RAW );
+	check( ok && back.width == img.width && back.height == img.height && back.bit_depth == img.bit_depth &&
+	       same_rows( back.pixels, imageio_image_stride( &back ), img.pixels, imageio_image_stride( &img ), (size_t) img.width * 4, img.height ),
+	       "memory round trip" );
+
+	if( ok )
+	{
+		imageio_image_destroy( &back );
+		check_malformed( (const uint8_t*) data, size );
+	}
+
+	imageio_free( data );
+
+	/* mip levels through a mapping */
+	ok = imageio_image_save_raw( &img, FILENAME, &options ) && imageio_image_map( &mapped, FILENAME, IMAGEIO_RAW );
+	check( ok && mapped.levels == 4 && mapped.layout == IMAGEIO_LAYOUT_RGBA8, "mapped with four levels" );
+
+	if( ok )
+	{
+		check( imageio_raw_level( &mapped, 0, &level ) &&
+		       same_rows( level.pixels, level.stride, img.pixels, imageio_image_stride( &img ), (size_t) img.width * 4, img.height ),
+		       "level 0 is the image" );
+		check( imageio_raw_level( &mapped, 3, &level ) && level.width == 12 && level.height == 7 && level.stride % 64 == 0,
+		       "level 3 is 12x7 with aligned rows" );
+		check( !imageio_raw_level( &mapped, 4, &level ), "level 4 refused" );
+		check( imageio_raw_verify( &mapped ), "checksums verified" );
+		imageio_image_unmap( &mapped );
+	}
+
+	ok = imageio_image_load( &back, FILENAME, IMAGEIO_RAW );
+	check( ok && same_rows( back.pixels, imageio_image_stride( &back ), img.pixels, imageio_image_stride( &img ), (size_t) img.width * 4, img.height ),
+	       "file round trip" );
+
+	if( ok )
+	{
+		imageio_image_destroy( &back );
+	}
+
+	remove( FILENAME );
+
+	/* nothing is saved that wouldn't load */
+	odd          = img;
+	odd.channels = 3;
+	check( !imageio_image_save_memory( &odd, &data, &size, IMAGEIO_RAW ), "channels not bit depth / 8 not saved" );
+	options.layout = IMAGEIO_LAYOUT_RGB8;
+	check( !imageio_image_save_raw( &img, FILENAME, &options ), "layout with other channels not saved" );
+	remove( FILENAME );
+
+	imageio_image_destroy( &img );
+	return check_result();
+}
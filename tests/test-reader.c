@@ -0,0 +1,121 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+
+/*
+ * Reads BMP, TGA and PNG files a few rows at a time, in several layouts,
+ * and checks the rows against what imageio_image_load_memory_ex stores.
+ * A file cut short has to stop the reader and mark it failed.
+ */
+/* Rows come out in chunks of 1, 2, 3, ... rows into a padded buffer. */
+static bool read_matches( const void* data, size_t size, image_file_format_t format, const imageio_load_options_t* options, const image_t* expected )
+{
+	imageio_reader_t* reader = imageio_reader_open_memory( data, size, format, options );
+	const size_t row_size    = (size_t) expected->width * (expected->bit_depth >> 3);
+	const size_t stride      = row_size + 5;
+	uint8_t* rows            = (uint8_t*) malloc( stride * expected->height );
+	uint32_t y = 0, count = 1, read;
+	bool ok;
+
+	ok = reader && rows &&
+	     imageio_reader_info( reader )->width == expected->width &&
+	     imageio_reader_info( reader )->height == expected->height &&
+	     imageio_reader_info( reader )->bit_depth == expected->bit_depth;
+
+	while( ok && y < expected->height )
+	{
+		read = imageio_reader_read_rows( reader, rows + y * stride, stride, count++ );
+		ok   = read > 0;
+		y   += read;
+	}
+
+	for( y = 0; ok && y < expected->height; y++ )
+	{
+		ok = memcmp( rows + y * stride, expected->pixels + y * imageio_image_stride( expected ), row_size ) == 0;
+	}
+
+	ok = ok && imageio_reader_read_rows( reader, rows, stride, 1 ) == 0 && !imageio_reader_failed( reader );
+
+	imageio_reader_close( reader );
+	free( rows );
+	return ok;
+}
+
+static bool truncated_fails( const void* data, size_t size, image_file_format_t format, uint32_t height )
+{
+	imageio_reader_t* reader = imageio_reader_open_memory( data, size - size / 3, format, NULL );
+	const imageio_info_t* info;
+	uint8_t* rows;
+	uint32_t read;
+	bool ok;
+
+	if( !reader )
+	{
+		return false;
+	}
+
+	info = imageio_reader_info( reader );
+	rows = (uint8_t*) malloc( (size_t) info->width * (info->bit_depth >> 3) * height );
+	read = imageio_reader_read_rows( reader, rows, 0, height );
+	ok   = read < height && imageio_reader_failed( reader );
+
+	imageio_reader_close( reader );
+	free( rows );
+	return ok;
+}
+
+static void read_case( const check_case_t* c )
+{
+	static const imageio_layout_t layouts[] = {
+		IMAGEIO_LAYOUT_NATIVE,
+		IMAGEIO_LAYOUT_RGBA8,
+		IMAGEIO_LAYOUT_BGR8,
+		IMAGEIO_LAYOUT_GRAY8,
+	};
+	size_t l;
+
+	for( l = 0; l < sizeof(layouts) / sizeof(layouts[ 0 ]); l++ )
+	{
+		imageio_load_options_t options = { layouts[ l ], 0 };
+		image_t expected;
+
+		if( !imageio_image_load_memory_ex( &expected, c->data, c->size, c->format, &options ) )
+		{
+			check( false, "%s layout %u  whole load", c->name, (uint32_t) layouts[ l ] );
+			continue;
+		}
+
+		check( read_matches( c->data, c->size, c->format, &options, &expected ), "%s layout %u  rows match a whole load", c->name, (uint32_t) layouts[ l ] );
+		imageio_image_destroy( &expected );
+	}
+
+	check( truncated_fails( c->data, c->size, c->format, c->image->height ), "%s  truncated file fails", c->name );
+}
+
+int main( void )
+{
+	check_each_format( 53, 41, CHECK_FORMATS, read_case );
+	return check_result();
+}
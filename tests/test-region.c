@@ -0,0 +1,153 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+
+/*
+ * Loads rectangles out of BMP, TGA and PNG files, with and without seek,
+ * and checks them against the same rectangle of a whole load. Rectangles
+ * that don't lie inside the image have to be refused.
+ */
+typedef struct buffer {
+	const uint8_t* data;
+	size_t size;
+	size_t position;
+} buffer_t;
+
+static size_t buffer_read( void* user, void* data, size_t size )
+{
+	buffer_t* buffer = (buffer_t*) user;
+	size_t left      = buffer->position < buffer->size ? buffer->size - buffer->position : 0;
+
+	size = size < left ? size : left;
+	memcpy( data, buffer->data + buffer->position, size );
+	buffer->position += size;
+	return size;
+}
+
+static int buffer_seek( void* user, long offset, int whence )
+{
+	buffer_t* buffer = (buffer_t*) user;
+	long base        = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? (long) buffer->position : (long) buffer->size;
+
+	if( base + offset < 0 )
+	{
+		return -1;
+	}
+
+	buffer->position = (size_t) (base + offset);
+	return 0;
+}
+
+static bool region_matches( const void* data, size_t size, image_file_format_t format, bool seekable, const image_t* whole,
+                            uint32_t x, uint32_t y, uint32_t width, uint32_t height )
+{
+	buffer_t buffer             = { (const uint8_t*) data, size, 0 };
+	imageio_io_t io             = { &buffer, buffer_read, NULL, seekable ? buffer_seek : NULL };
+	const uint32_t pixel_size   = whole->bit_depth >> 3;
+	image_t region;
+	uint32_t row;
+	bool ok;
+
+	if( !imageio_image_load_region_io( &region, &io, format, x, y, width, height, NULL ) )
+	{
+		return false;
+	}
+
+	ok = region.width == width && region.height == height && region.bit_depth == whole->bit_depth;
+
+	for( row = 0; ok && row < height; row++ )
+	{
+		ok = memcmp( region.pixels + row * imageio_image_stride( &region ),
+		             whole->pixels + (y + row) * imageio_image_stride( whole ) + (size_t) x * pixel_size,
+		             (size_t) width * pixel_size ) == 0;
+	}
+
+	imageio_image_destroy( &region );
+	return ok;
+}
+
+static bool region_refused( const void* data, size_t size, image_file_format_t format, uint32_t x, uint32_t y, uint32_t width, uint32_t height )
+{
+	buffer_t buffer = { (const uint8_t*) data, size, 0 };
+	imageio_io_t io = { &buffer, buffer_read, NULL, buffer_seek };
+	image_t region;
+
+	if( imageio_image_load_region_io( &region, &io, format, x, y, width, height, NULL ) )
+	{
+		imageio_image_destroy( &region );
+		return false;
+	}
+
+	return true;
+}
+
+static void region_case( const check_case_t* c )
+{
+	static const uint32_t rects[][ 4 ] = {
+		{ 0, 0, 61, 43 },   /* all of it */
+		{ 5, 7, 20, 11 },
+		{ 0, 0, 1, 1 },
+		{ 60, 42, 1, 1 },   /* the last pixel */
+		{ 13, 0, 48, 43 },  /* out to the right edge */
+		{ 0, 30, 61, 13 },  /* the bottom rows */
+	};
+	image_t whole;
+	bool ok = true;
+	size_t r;
+
+	if( !imageio_image_load_memory( &whole, c->data, c->size, c->format ) )
+	{
+		check( false, "%s  whole load", c->name );
+		return;
+	}
+
+	for( r = 0; r < sizeof(rects) / sizeof(rects[ 0 ]); r++ )
+	{
+		ok = ok && region_matches( c->data, c->size, c->format, true, &whole, rects[ r ][ 0 ], rects[ r ][ 1 ], rects[ r ][ 2 ], rects[ r ][ 3 ] );
+	}
+
+	check( ok, "%s  regions match a whole load", c->name );
+
+	for( ok = true, r = 0; r < sizeof(rects) / sizeof(rects[ 0 ]); r++ )
+	{
+		ok = ok && region_matches( c->data, c->size, c->format, false, &whole, rects[ r ][ 0 ], rects[ r ][ 1 ], rects[ r ][ 2 ], rects[ r ][ 3 ] );
+	}
+
+	check( ok, "%s  regions match without seek", c->name );
+
+	check( region_refused( c->data, c->size, c->format, 60, 0, 2, 1 ) &&
+	       region_refused( c->data, c->size, c->format, 0, 42, 1, 2 ) &&
+	       region_refused( c->data, c->size, c->format, 0, 0, 0, 5 ) &&
+	       region_refused( c->data, c->size, c->format, 0xFFFFFFFF, 0, 2, 1 ),
+	       "%s  rectangles outside refused", c->name );
+
+	imageio_image_destroy( &whole );
+}
+
+int main( void )
+{
+	check_each_format( 61, 43, CHECK_FORMATS, region_case );
+	return check_result();
+}
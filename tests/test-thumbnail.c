@@ -0,0 +1,178 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/imageio.h"
+
+/*
+ * Thumbnails a large PNG from memory through a counting allocator and
+ * checks that the most the library ever had allocated at once stays close
+ * to the size of the thumbnail, well under the size of the full image.
+ */
+typedef struct usage {
+	size_t live;
+	size_t peak;
+} usage_t;
+
+typedef struct buffer {
+	const uint8_t* data;
+	size_t size;
+	size_t position;
+} buffer_t;
+
+/* Each block starts with its size; 16 bytes keeps malloc's alignment. */
+#define HEADER_SIZE    16
+
+static void* counting_alloc( size_t size, void* user )
+{
+	usage_t* usage = (usage_t*) user;
+	uint8_t* block = (uint8_t*) malloc( size + HEADER_SIZE );
+
+	if( !block )
+	{
+		return NULL;
+	}
+
+	*(size_t*) block = size;
+	usage->live     += size;
+	usage->peak      = usage->live > usage->peak ? usage->live : usage->peak;
+	return block + HEADER_SIZE;
+}
+
+static void counting_free( void* ptr, void* user )
+{
+	usage_t* usage = (usage_t*) user;
+
+	if( ptr )
+	{
+		uint8_t* block = (uint8_t*) ptr - HEADER_SIZE;
+		usage->live   -= *(size_t*) block;
+		free( block );
+	}
+}
+
+static void* counting_realloc( void* ptr, size_t size, void* user )
+{
+	void* copy = counting_alloc( size, user );
+
+	if( copy && ptr )
+	{
+		size_t old_size = *(size_t*) ((uint8_t*) ptr - HEADER_SIZE);
+		memcpy( copy, ptr, old_size < size ? old_size : size );
+		counting_free( ptr, user );
+	}
+
+	return copy;
+}
+
+static size_t buffer_read( void* user, void* data, size_t size )
+{
+	buffer_t* buffer = (buffer_t*) user;
+	size_t left      = buffer->size - buffer->position;
+
+	size = size < left ? size : left;
+	memcpy( data, buffer->data + buffer->position, size );
+	buffer->position += size;
+	return size;
+}
+
+int main( void )
+{
+	static const uint32_t sizes[][ 2 ] = {
+		{ 2000, 1400 },     /* no whole box fits, resampled only */
+		{ 600, 400 },       /* boxes of 5 x 5, no resampling */
+		{ 1000, 700 },      /* boxes of 2 x 2, then resampled */
+	};
+	const uint32_t width  = 3000;
+	const uint32_t height = 2000;
+	usage_t usage         = { 0, 0 };
+	int failures          = 0;
+	void* data            = NULL;
+	size_t size           = 0;
+	size_t i, full_size;
+	image_t img;
+	uint32_t y;
+
+	imageio_set_allocator( counting_alloc, counting_realloc, counting_free, &usage );
+
+	if( !imageio_image_create( &img, width, height, 32 ) )
+	{
+		printf( "could not create a %ux%u image\n", width, height );
+		return 1;
+	}
+
+	full_size = imageio_image_stride( &img ) * height;
+
+	for( y = 0; y < height; y++ )
+	{
+		uint8_t* row = img.pixels + y * imageio_image_stride( &img );
+		uint32_t x;
+
+		for( x = 0; x < width; x++ )
+		{
+			row[ 4 * x + 0 ] = (uint8_t) x;
+			row[ 4 * x + 1 ] = (uint8_t) y;
+			row[ 4 * x + 2 ] = (uint8_t) (x + y);
+			row[ 4 * x + 3 ] = 255;
+		}
+	}
+
+	if( !imageio_image_save_memory( &img, &data, &size, IMAGEIO_PNG ) )
+	{
+		printf( "could not save the test image\n" );
+		imageio_image_destroy( &img );
+		return 1;
+	}
+
+	imageio_image_destroy( &img );
+
+	for( i = 0; i < sizeof(sizes) / sizeof(sizes[ 0 ]); i++ )
+	{
+		buffer_t buffer  = { (const uint8_t*) data, size, 0 };
+		imageio_io_t io  = { &buffer, buffer_read, NULL, NULL };
+		size_t baseline  = usage.live;
+		size_t peak, thumbnail_size;
+		bool ok;
+
+		usage.peak = baseline;
+
+		if( !imageio_load_thumbnail_io( &img, &io, IMAGEIO_PNG, sizes[ i ][ 0 ], sizes[ i ][ 1 ] ) )
+		{
+			printf( "%ux%u  thumbnail failed\n", sizes[ i ][ 0 ], sizes[ i ][ 1 ] );
+			failures++;
+			continue;
+		}
+
+		peak           = usage.peak - baseline;
+		thumbnail_size = imageio_image_stride( &img ) * img.height;
+		/* the thumbnail plus a few rows and libpng's state */
+		ok = peak < thumbnail_size + 1024 * 1024 && peak < full_size / 2;
+		printf( "%ux%u  -> %ux%u  peak %zu bytes, thumbnail %zu bytes  %s\n", sizes[ i ][ 0 ], sizes[ i ][ 1 ], img.width, img.height, peak, thumbnail_size, ok ? "ok" : "TOO MUCH" );
+		failures += ok ? 0 : 1;
+		imageio_image_destroy( &img );
+	}
+
+	imageio_free( data );
+	imageio_set_allocator( NULL, NULL, NULL, NULL );
+	return failures == 0 ? 0 : 1;
+}
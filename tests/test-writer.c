@@ -0,0 +1,139 @@
+/* Copyright (C) 2009-2015 by Joseph A. Marrero, http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+
+/*
+ * Writes BMP, TGA and PNG files a few rows at a time from a padded buffer
+ * and checks that they load back as the image they were written from,
+ * that BMP and TGA come out byte for byte as imageio_image_save_memory
+ * writes them, and that the rows handed in are left alone.
+ */
+typedef struct buffer {
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+} buffer_t;
+
+static size_t buffer_write( void* user, const void* data, size_t size )
+{
+	buffer_t* buffer = (buffer_t*) user;
+
+	if( buffer->size + size > buffer->capacity )
+	{
+		buffer->capacity = 2 * (buffer->size + size);
+		buffer->data     = (uint8_t*) realloc( buffer->data, buffer->capacity );
+	}
+
+	memcpy( buffer->data + buffer->size, data, size );
+	buffer->size += size;
+	return size;
+}
+
+/* Rows go in as chunks of 1, 2, 3, ... rows. */
+static bool write_rows( buffer_t* buffer, image_file_format_t format, const uint8_t* rows, size_t stride, uint32_t width, uint32_t height, uint32_t bit_depth )
+{
+	imageio_io_t io          = { buffer, NULL, buffer_write, NULL };
+	imageio_writer_t* writer = imageio_writer_open_io( &io, format, width, height, (uint8_t) bit_depth );
+	uint32_t y = 0, count = 1, written;
+	bool ok = writer != NULL;
+
+	while( ok && y < height )
+	{
+		written = imageio_writer_write_rows( writer, rows + y * stride, stride, count++ );
+		ok      = written > 0;
+		y      += written;
+	}
+
+	/* nothing goes past the last row */
+	ok = ok && imageio_writer_write_rows( writer, rows, stride, 1 ) == 0;
+	return imageio_writer_close( writer ) && ok;
+}
+
+static bool short_write_fails( image_file_format_t format, const uint8_t* rows, size_t stride, uint32_t width, uint32_t height, uint32_t bit_depth )
+{
+	buffer_t buffer          = { NULL, 0, 0 };
+	imageio_io_t io          = { &buffer, NULL, buffer_write, NULL };
+	imageio_writer_t* writer = imageio_writer_open_io( &io, format, width, height, (uint8_t) bit_depth );
+	bool ok;
+
+	ok = writer && imageio_writer_write_rows( writer, rows, stride, height - 1 ) == height - 1;
+	ok = !imageio_writer_close( writer ) && ok;
+	free( buffer.data );
+	return ok;
+}
+
+static void write_case( const check_case_t* c )
+{
+	const image_t* img    = c->image;
+	const size_t row_size = (size_t) img->width * (img->bit_depth >> 3);
+	const size_t stride   = row_size + 7;
+	uint8_t* rows         = (uint8_t*) malloc( stride * img->height );
+	uint8_t* original     = (uint8_t*) malloc( stride * img->height );
+	buffer_t buffer       = { NULL, 0, 0 };
+	image_t back;
+	uint32_t y;
+	bool ok;
+
+	/* the padding between rows holds bytes that must not get written */
+	check_pattern( rows, stride * img->height );
+
+	for( y = 0; y < img->height; y++ )
+	{
+		memcpy( rows + y * stride, img->pixels + y * imageio_image_stride( img ), row_size );
+	}
+
+	memcpy( original, rows, stride * img->height );
+
+	ok = write_rows( &buffer, c->format, rows, stride, img->width, img->height, img->bit_depth );
+	check( ok, "%s  written", c->name );
+	check( memcmp( rows, original, stride * img->height ) == 0, "%s  rows left alone", c->name );
+
+	ok = ok && imageio_image_load_memory( &back, buffer.data, buffer.size, c->format );
+	check( ok && back.width == img->width && back.height == img->height && back.bit_depth == img->bit_depth &&
+	       memcmp( back.pixels, img->pixels, imageio_image_stride( img ) * img->height ) == 0,
+	       "%s  loads back as the image", c->name );
+
+	if( ok )
+	{
+		imageio_image_destroy( &back );
+	}
+
+	if( c->format != IMAGEIO_PNG )
+	{
+		check( c->size == buffer.size && memcmp( c->data, buffer.data, c->size ) == 0, "%s  same bytes as a whole save", c->name );
+	}
+
+	check( short_write_fails( c->format, rows, stride, img->width, img->height, img->bit_depth ), "%s  closing short fails", c->name );
+
+	free( buffer.data );
+	free( original );
+	free( rows );
+}
+
+int main( void )
+{
+	check_each_format( 53, 41, CHECK_FORMATS, write_case );
+	return check_result();
+}